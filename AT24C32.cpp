@@ -0,0 +1,121 @@
+/**
+  AT24C32.cpp - Simple AT24C32 I2C EEPROM library
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "AT24C32.h"
+
+AT24C32::AT24C32() {
+}
+
+/**
+  Check the EEPROM is present (the I2C bus must be already initialized)
+
+  @param eepAddr the I2C address
+  @return true if the device acknowledged
+*/
+bool AT24C32::init(uint8_t twEEP) {
+  // Keep the address
+  eepAddr = twEEP;
+  // Check the device is present
+  eepOk = ready();
+  return eepOk;
+}
+
+/**
+  Wait for the internal write cycle to finish, using ACK polling: the
+  device does not acknowledge its address while writing.
+
+  @return true if the device is ready
+*/
+bool AT24C32::ready() {
+  for (uint8_t i = 0; i < EEP_POLLS; i++) {
+    Wire.beginTransmission(eepAddr);
+    if (Wire.endTransmission() == 0)
+      return true;
+    ackPolls++;
+    delayMicroseconds(100);
+  }
+  return false;
+}
+
+/**
+  Sequential read, split into chunks the Wire buffer can hold
+
+  @param addr the memory address
+  @param data the destination buffer
+  @param len number of bytes to read
+  @return true if all bytes were read
+*/
+bool AT24C32::read(uint16_t addr, uint8_t* data, uint8_t len) {
+  while (len > 0) {
+    // The read does not wrap at page boundaries, only at the Wire buffer
+    uint8_t cnt = len > EEP_PAGE ? EEP_PAGE : len;
+    // Make sure a previous write cycle is finished
+    if (not ready())
+      return false;
+    // Set the address pointer
+    Wire.beginTransmission(eepAddr);
+    Wire.write((uint8_t)(addr >> 8));
+    Wire.write((uint8_t)(addr & 0xFF));
+    if (Wire.endTransmission() != 0)
+      return false;
+    // Read the bytes
+    if (Wire.requestFrom(eepAddr, cnt) != cnt)
+      return false;
+    for (uint8_t i = 0; i < cnt; i++)
+      *data++ = Wire.read();
+    addr += cnt;
+    len  -= cnt;
+  }
+  return true;
+}
+
+/**
+  Page write, split at page boundaries and at the Wire buffer limit.
+  Does not wait for the last write cycle, the next access will poll.
+
+  @param addr the memory address
+  @param data the source buffer
+  @param len number of bytes to write
+  @return true if all bytes were written
+*/
+bool AT24C32::write(uint16_t addr, const uint8_t* data, uint8_t len) {
+  while (len > 0) {
+    // Bytes left in the current page
+    uint8_t cnt = EEP_PAGE - (addr % EEP_PAGE);
+    if (cnt > EEP_CHUNK) cnt = EEP_CHUNK;
+    if (cnt > len)       cnt = len;
+    // Make sure a previous write cycle is finished
+    if (not ready())
+      return false;
+    // Address and data
+    Wire.beginTransmission(eepAddr);
+    Wire.write((uint8_t)(addr >> 8));
+    Wire.write((uint8_t)(addr & 0xFF));
+    Wire.write(data, cnt);
+    if (Wire.endTransmission() != 0)
+      return false;
+    pageWrites++;
+    data += cnt;
+    addr += cnt;
+    len  -= cnt;
+  }
+  return true;
+}
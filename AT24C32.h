@@ -0,0 +1,52 @@
+/**
+  AT24C32.h - Simple AT24C32 I2C EEPROM library
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AT24C32_H
+#define AT24C32_H
+
+#include <Arduino.h>
+// The EEPROM I2C address is defined along with the RTC
+#include "DS3231.h"
+
+#define EEP_SIZE  4096  // Total size, in bytes
+#define EEP_PAGE  32    // Page size, in bytes
+#define EEP_CHUNK 30    // Maximum data bytes per I2C transaction (Wire buffer minus address)
+#define EEP_POLLS 200   // Maximum ACK polls while waiting for a write cycle (~20ms)
+
+
+class AT24C32 {
+  public:
+    AT24C32();
+    bool      init(uint8_t eepAddr = I2C_EEP);
+    bool      read(uint16_t addr, uint8_t* data, uint8_t len);
+    bool      write(uint16_t addr, const uint8_t* data, uint8_t len);
+
+    // Statistics
+    uint16_t  pageWrites  = 0;  // Write cycles issued
+    uint16_t  ackPolls    = 0;  // NACKs seen while waiting for write cycles
+
+    // Flags
+    bool      eepOk = false;
+
+  private:
+    bool      ready();
+    uint8_t   eepAddr = I2C_EEP;
+};
+
+#endif /* AT24C32_H */
@@ -9,7 +9,7 @@
 #include "Button.h"
 #include <Arduino.h>
 
-Button::Button(uint8_t pin, uint16_t dly): _pin(pin), _delay(dly), _state(HIGH), _ignore_until(0), _has_changed(false) {
+Button::Button(uint8_t pin, uint16_t dly): _pin(pin), _delay(dly), _state(HIGH), _has_changed(false), _changed_at(0) {
 }
 
 
@@ -23,12 +23,12 @@ void Button::begin() {
   @return the button state
 */
 bool Button::read() {
-  // Ignore any pin changes until after this delay
-  if (_ignore_until > millis()) {
+  // Ignore any pin changes until after this delay, safe across millis() rollover
+  if (millis() - _changed_at < _delay) {
   }
   // Check if the pin has changed
   else if (digitalRead(_pin) != _state) {
-    _ignore_until = millis() + _delay;
+    _changed_at = millis();
     _state = !_state;
     _has_changed = true;
   }
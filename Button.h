@@ -32,7 +32,7 @@ class Button {
     uint16_t  _delay;
     bool      _state;
     bool      _has_changed;
-    uint32_t  _ignore_until;
+    uint32_t  _changed_at;
 };
 
 #endif /* BUTTON_H */
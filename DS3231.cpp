@@ -38,59 +38,185 @@ DS3231::DS3231() {
 bool DS3231::init(uint8_t twRTC, bool twInit) {
   // Init i2c
   if (twInit) Wire.begin();
+#if defined(WIRE_HAS_TIMEOUT)
+  // Bound the I2C transactions, so a hung bus is reported and reset
+  // instead of blocking forever
+  Wire.setWireTimeout(RTC_I2C_TIMEOUT, true);
+#endif
   // Keep the address
   rtcAddr = twRTC;
-  // Check the device is present
-  Wire.beginTransmission(rtcAddr);
-  rtcOk = Wire.endTransmission() == 0;
   // Set century
   C = CENTURY * 100;
+  // Check the device is present, reading the status register
+  uint8_t x;
+  if (not readRegs(RTC_STATUS, &x, 1))
+    return false;
 
   /*
     // Debug: show all registers in DS3231
-    Wire.beginTransmission(rtcAddr);
-    Wire.write(0x00);
-    Wire.endTransmission();
-    // Request all bytes of data starting from 0x01
-    Wire.requestFrom(rtcAddr, (uint8_t)0x12);
+    uint8_t regs[RTC_REGS];
+    readRegs(RTC_SECONDS, regs, RTC_REGS);
     char buf[16];
-    for (uint8_t i = 0x00; i <= 0x12; i++) {
-      uint8_t x = Wire.read();
-      sprintf(buf, "%02x: %02x", i, x);
+    for (uint8_t i = 0x00; i < RTC_REGS; i++) {
+      sprintf(buf, "%02x: %02x", i, regs[i]);
       Serial.println(buf);
     }
   */
 
-  if (rtcOk) {
-    // Set Alarm 2 to trigger every minute
-    Wire.beginTransmission(rtcAddr);
-    // Alarm 2 minutes register
-    Wire.write(AL2_MINUTES);
-    Wire.write(0x80);         // 0x0B
-    Wire.write(0x80);         // 0x0C
-    Wire.write(0x80);         // 0x0D
-    Wire.endTransmission();
-
-    // Set the control register
+  // Set Alarm 2 to trigger every minute
+  uint8_t al2[] = {0x80, 0x80, 0x80};   // 0x0B, 0x0C, 0x0D
+  writeRegs(AL2_MINUTES, al2, sizeof(al2));
+  // Set the control register: start OSC, set INTCN, set ALRM2
+  writeReg(RTC_CONTROL, B00000110);
+  // Disable the 32kHz OSC
+  writeReg(RTC_STATUS, x & B11110111);
+  return rtcOk;
+}
+
+/**
+  Check the RTC responds, updating the health flag
+
+  @return true if the RTC is working
+*/
+bool DS3231::probe() {
+  uint8_t x;
+  return readRegs(RTC_STATUS, &x, 1);
+}
+
+/**
+  Clear the error counters
+*/
+void DS3231::clearErrors() {
+  memset(errors, 0, sizeof(errors));
+  busClears = 0;
+}
+
+/**
+  Account the result of a transaction: the RTC is considered down
+  after a number of consecutive failed transactions
+
+  @param reg the first register in transaction
+  @param ok the transaction result
+  @return the transaction result
+*/
+bool DS3231::health(uint8_t reg, bool ok) {
+  if (ok)
+    failStreak = 0;
+  else {
+    if (reg < RTC_REGS and errors[reg] < 0xFF)
+      errors[reg]++;
+    if (failStreak < 0xFF)
+      failStreak++;
+  }
+  rtcOk = failStreak < RTC_MAX_FAILS;
+  return ok;
+}
+
+/**
+  Recover the bus when a slave holds SDA low: clock SCL up to nine
+  times, until SDA is released, then issue a STOP condition.  The lines
+  are driven as open drain: output low or input with pull-up.
+*/
+void DS3231::busClear() {
+  Wire.end();
+  pinMode(SDA, INPUT_PULLUP);
+  pinMode(SCL, INPUT_PULLUP);
+  delayMicroseconds(5);
+  for (uint8_t i = 0; i < 9 and digitalRead(SDA) == LOW; i++) {
+    // SCL low
+    digitalWrite(SCL, LOW);
+    pinMode(SCL, OUTPUT);
+    delayMicroseconds(5);
+    // SCL released, high
+    pinMode(SCL, INPUT_PULLUP);
+    delayMicroseconds(5);
+  }
+  // STOP: SDA rising while SCL is high
+  digitalWrite(SDA, LOW);
+  pinMode(SDA, OUTPUT);
+  delayMicroseconds(5);
+  pinMode(SDA, INPUT_PULLUP);
+  delayMicroseconds(5);
+  // Restart the I2C interface
+  Wire.begin();
+#if defined(WIRE_HAS_TIMEOUT)
+  Wire.setWireTimeout(RTC_I2C_TIMEOUT, true);
+#endif
+  if (busClears < 0xFF)
+    busClears++;
+}
+
+/**
+  Check if a failed transaction left the bus hung and recover it
+*/
+void DS3231::busCheck() {
+  bool hung = digitalRead(SDA) == LOW;
+#if defined(WIRE_HAS_TIMEOUT)
+  if (Wire.getWireTimeoutFlag()) {
+    Wire.clearWireTimeoutFlag();
+    hung = true;
+  }
+#endif
+  if (hung)
+    busClear();
+}
+
+/**
+  Read consecutive registers, with retries and bus recovery
+
+  @param reg the first register
+  @param data the destination buffer
+  @param len number of registers
+  @return true if all registers were read
+*/
+bool DS3231::readRegs(uint8_t reg, uint8_t* data, uint8_t len) {
+  for (uint8_t t = 0; t < RTC_I2C_RETRIES; t++) {
     Wire.beginTransmission(rtcAddr);
-    Wire.write(RTC_CONTROL);
-    // Start OSC, set INTCN, set ALRM2
-    Wire.write(B00000110);
-    Wire.endTransmission();
+    Wire.write(reg);
+    if (Wire.endTransmission() == 0) {
+      if (Wire.requestFrom(rtcAddr, len) == len) {
+        for (uint8_t i = 0; i < len; i++)
+          data[i] = Wire.read();
+        return health(reg, true);
+      }
+      // Drop a short read
+      while (Wire.available())
+        Wire.read();
+    }
+    busCheck();
+  }
+  return health(reg, false);
+}
+
+/**
+  Write consecutive registers, with retries and bus recovery
 
-    // Set the status register
+  @param reg the first register
+  @param data the source buffer
+  @param len number of registers
+  @return true if all registers were written
+*/
+bool DS3231::writeRegs(uint8_t reg, const uint8_t* data, uint8_t len) {
+  for (uint8_t t = 0; t < RTC_I2C_RETRIES; t++) {
     Wire.beginTransmission(rtcAddr);
-    Wire.write(RTC_STATUS);
-    if (Wire.endTransmission() != 0)
-      return false;
-    // Request one byte
-    Wire.requestFrom(rtcAddr, (uint8_t)1);
-    uint8_t x = Wire.read();
-    // Disable the 32kHz OSC
-    Wire.write(x & B11110111);
-    Wire.endTransmission();
+    Wire.write(reg);
+    Wire.write(data, len);
+    if (Wire.endTransmission() == 0)
+      return health(reg, true);
+    busCheck();
   }
-  return rtcOk;
+  return health(reg, false);
+}
+
+/**
+  Write one register
+
+  @param reg the register
+  @param data the value
+  @return true if the register was written
+*/
+bool DS3231::writeReg(uint8_t reg, uint8_t data) {
+  return writeRegs(reg, &data, 1);
 }
 
 /**
@@ -99,23 +225,17 @@ bool DS3231::init(uint8_t twRTC, bool twInit) {
   @return true if the function succeeded
 */
 bool DS3231::readTime(bool readDate) {
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_SECONDS);
-  if (Wire.endTransmission() != 0)
+  uint8_t r[7];
+  // Read 3 or 7 bytes of data starting from 0x00
+  if (not readRegs(RTC_SECONDS, r, readDate ? 7 : 3))
     return false;
-  // Request 3 or 7 bytes of data starting from 0x00
-  uint8_t len = 3;
-  if (readDate) len = 7;
-  Wire.requestFrom(rtcAddr, len);
 
   // Seconds
-  S = Wire.read();
-  S = bcd2bin(S);
+  S = bcd2bin(r[0]);
   // Minutes
-  M = Wire.read();
-  M = bcd2bin(M);
+  M = bcd2bin(r[1]);
   // Hours
-  H = Wire.read();
+  H = r[2];
   // Check if 12 hours and PM and add 0x12 (BCD)
   if ((H & (1 << 6)) and (H & (1 << 5)))
     H = (H & 0x1F) + 0x12;
@@ -128,18 +248,15 @@ bool DS3231::readTime(bool readDate) {
     // Century
     uint16_t c = C;
     // Day of week, 1 is Monday
-    u = Wire.read();
-    u = bcd2bin(u & 0x07);
+    u = bcd2bin(r[3] & 0x07);
     // Day
-    d = Wire.read();
-    d = bcd2bin(d);
+    d = bcd2bin(r[4]);
     // Month and century
-    m = Wire.read();
+    m = r[5];
     if (m & (1 << 7)) c += 100;
     m = bcd2bin(m & 0x1F);
     // Year, short and long format
-    y = Wire.read();
-    y = bcd2bin(y);
+    y = bcd2bin(r[6]);
     Y = c + y;
   }
   return true;
@@ -152,21 +269,19 @@ bool DS3231::readTime(bool readDate) {
   @return true on '00 minutes
 */
 bool DS3231::readTimeBCD() {
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_MINUTES);
-  if (Wire.endTransmission() != 0)
+  uint8_t r[2];
+  // Read 2 bytes of data starting from RTC_MINUTES register
+  if (not readRegs(RTC_MINUTES, r, 2))
     return false;
-  // Request 2 bytes of data starting from RTC_MINUTES register
-  Wire.requestFrom(rtcAddr, (uint8_t)2);
 
   uint8_t x;
   // Minutes
-  x = Wire.read();
+  x = r[0];
   bool newHour = (x == 0x00);
   R[2] = x / 16; // (x & 0xF0) >> 4;
   R[3] = x % 16; // (x & 0x0F);
   // Hours
-  x = Wire.read() & 0x3F;
+  x = r[1] & 0x3F;
   R[0] = x / 16; // (x & 0xF0) >> 4;
   R[1] = x % 16; // (x & 0x0F);
   // Return true if new hour
@@ -179,15 +294,11 @@ bool DS3231::readTimeBCD() {
   @return seconds (BCD)
 */
 uint8_t DS3231::readSecondsBCD() {
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_SECONDS);
-  if (Wire.endTransmission() != 0)
+  uint8_t x;
+  if (not readRegs(RTC_SECONDS, &x, 1))
     return false;
-  // Request one byte
-  Wire.requestFrom(rtcAddr, (uint8_t)1);
-
   // Seconds
-  return Wire.read();
+  return x;
 }
 
 /**
@@ -196,32 +307,87 @@ uint8_t DS3231::readSecondsBCD() {
   @return integer temperature
 */
 int8_t DS3231::readTemperature(bool metric) {
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_TMP_MSB);
-  if (Wire.endTransmission() != 0)
+  int8_t t;
+  if (not readRegs(RTC_TMP_MSB, (uint8_t*)&t, 1))
     return 0x80;
-  // Request one byte
-  Wire.requestFrom(rtcAddr, (uint8_t)1);
-  int8_t t = Wire.read();
   // Check if the result should be in Celsius or Fahrenheit
   if (not metric)
     t = (int8_t)((float)t * 1.8 + 32.0);
   return t;
 }
 
+/**
+  Read the aging offset register
+
+  @param aging the aging offset, about 0.1ppm per step, positive is slower
+  @return true if read
+*/
+bool DS3231::readAging(int8_t &aging) {
+  return readRegs(RTC_AGING, (uint8_t*)&aging, 1);
+}
+
+/**
+  Write the aging offset register and force a temperature conversion,
+  so the new value is applied at once
+
+  @param aging the aging offset
+  @return true if written
+*/
+bool DS3231::writeAging(int8_t aging) {
+  if (not writeReg(RTC_AGING, (uint8_t)aging))
+    return false;
+  uint8_t x;
+  if (not readRegs(RTC_CONTROL, &x, 1))
+    return false;
+  // Set CONV
+  return writeReg(RTC_CONTROL, x | B00100000);
+}
+
+/**
+  Convert the last read date and time to seconds since 1970-01-01
+  (days from civil), the date must have been read
+
+  @return seconds since epoch
+*/
+uint32_t DS3231::unixTime() {
+  uint16_t yy  = Y - (m <= 2 ? 1 : 0);
+  uint16_t era = yy / 400;
+  uint16_t yoe = yy - era * 400;
+  uint16_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  uint32_t doe = yoe * 365UL + yoe / 4 - yoe / 100 + doy;
+  uint32_t days = era * 146097UL + doe - 719468UL;
+  return days * 86400UL + H * 3600UL + M * 60UL + S;
+}
+
+/**
+  Set the date and time from seconds since 1970-01-01 (civil from days)
+
+  @param t seconds since epoch
+  @return true if written
+*/
+bool DS3231::writeUnix(uint32_t t) {
+  uint32_t secs = t % 86400UL;
+  uint32_t z    = t / 86400UL + 719468UL;
+  uint32_t era  = z / 146097UL;
+  uint32_t doe  = z - era * 146097UL;
+  uint32_t yoe  = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint16_t doy  = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint8_t  mp   = (5 * doy + 2) / 153;
+  uint8_t  dd   = doy - (153 * mp + 2) / 5 + 1;
+  uint8_t  mm   = mp < 10 ? mp + 3 : mp - 9;
+  uint16_t yy   = yoe + era * 400 + (mm <= 2 ? 1 : 0);
+  return writeDateTime(secs % 60, (secs / 60) % 60, secs / 3600, dd, mm, yy);
+}
+
 /**
   Read the status bit of the RTC
 
   @return bool bit status
 */
 bool DS3231::lostPower() {
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_STATUS);
-  if (Wire.endTransmission() != 0)
+  uint8_t x;
+  if (not readRegs(RTC_STATUS, &x, 1))
     return true;
-  // Request one byte
-  Wire.requestFrom(rtcAddr, (uint8_t)1);
-  uint8_t x = Wire.read();
   // Return the OSF bit
   return (x & 0x80) != 0x00;
 }
@@ -232,26 +398,67 @@ bool DS3231::lostPower() {
   @return triggered alarm
 */
 uint8_t DS3231::checkAlarms() {
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_STATUS);
-  if (Wire.endTransmission() != 0)
+  uint8_t x;
+  if (not readRegs(RTC_STATUS, &x, 1))
     return false;
-  // Request one byte
-  Wire.requestFrom(rtcAddr, (uint8_t)1);
-  uint8_t x = Wire.read();
   uint8_t result = x & 0x03;
-  if (result) {
-    // Clear the alarms
-    Wire.beginTransmission(rtcAddr);
-    // Status Register
-    Wire.write(RTC_STATUS);
+  if (result)
     // Clear the two less significant bits
-    Wire.write(x & 0xFC);
-    Wire.endTransmission();
-  }
+    writeReg(RTC_STATUS, x & 0xFC);
   return result;
 }
 
+/**
+  Program the Alarm 1 to match the day of the week, the hour and the
+  minute, at second 00, and enable its interrupt
+
+  @param u day of week 1..7, 1 is Monday
+  @param H hour 00..23
+  @param M minute 00..59
+  @return true if the registers were written
+*/
+bool DS3231::setAlarm1(uint8_t u, uint8_t H, uint8_t M) {
+  // A1M1..A1M4 cleared, DY/DT set to match the day of the week
+  uint8_t al1[] = {0x00, bin2bcd(M % 60), bin2bcd(H % 24), (uint8_t)(0x40 | (u & 0x07))};
+  uint8_t x;
+  if (not writeRegs(AL1_SECONDS, al1, sizeof(al1)))
+    return false;
+  if (not readRegs(RTC_CONTROL, &x, 1))
+    return false;
+  // Set A1IE
+  return writeReg(RTC_CONTROL, x | B00000001);
+}
+
+/**
+  Disable the Alarm 1 interrupt
+
+  @return true if the control register was written
+*/
+bool DS3231::clearAlarm1() {
+  uint8_t x;
+  if (not readRegs(RTC_CONTROL, &x, 1))
+    return false;
+  // Clear A1IE
+  return writeReg(RTC_CONTROL, x & B11111110);
+}
+
+/**
+  Select the function of the INT/SQW pin: the 1Hz square wave or the
+  alarm interrupts.  The alarm flags are set in both cases.
+
+  @param sqw true for the 1Hz square wave
+  @return true if the control register was written
+*/
+bool DS3231::setSQW(bool sqw) {
+  uint8_t x;
+  if (not readRegs(RTC_CONTROL, &x, 1))
+    return false;
+  // Clear INTCN for the square wave, RS2 and RS1 cleared select 1Hz
+  if (sqw) x &= B11100011;
+  else     x |= B00000100;
+  return writeReg(RTC_CONTROL, x);
+}
+
 /**
    Set RTC date and time and clear the status flag
 
@@ -269,32 +476,25 @@ bool DS3231::writeDateTime(uint8_t S, uint8_t M, uint8_t H,
   if (u == 0) u = 7;
   // Century flag
   uint8_t c = 0x00;
-
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_SECONDS);                   // Seconds register
-  Wire.write(bin2bcd(S % 60));        // Seconds, 00..59
-  Wire.write(bin2bcd(M % 60));        // Minutes, 00..59
-  Wire.write(bin2bcd(H % 24) & 0x3F); // Hours, 00..23
-  Wire.write(u);                      // Day of week, Mon first
-  Wire.write(bin2bcd(d % 31) & 0x3F); // Day in month, 01..31
   if (Y > (C + 99)) c = 1 << 7;
-  Wire.write(bin2bcd(m % 12) + c);    // Month, 01..12, and century flag
-  Wire.write(bin2bcd(Y % 100));       // Year, 00..99
-  Wire.endTransmission();
+
+  uint8_t r[] = {
+    bin2bcd(S % 60),                    // Seconds, 00..59
+    bin2bcd(M % 60),                    // Minutes, 00..59
+    (uint8_t)(bin2bcd(H % 24) & 0x3F),  // Hours, 00..23
+    u,                                  // Day of week, Mon first
+    (uint8_t)(bin2bcd(d) & 0x3F),       // Day in month, 01..31
+    (uint8_t)(bin2bcd(m) + c),          // Month, 01..12, and century flag
+    bin2bcd(Y % 100)                    // Year, 00..99
+  };
+  if (not writeRegs(RTC_SECONDS, r, sizeof(r)))
+    return false;
 
   // Clear the status flag
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_STATUS);
-  Wire.endTransmission();
-  // Request one byte
-  Wire.requestFrom(rtcAddr, (uint8_t)1);
-  uint8_t x = Wire.read();
-  // Clear the status bit
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_STATUS);
-  Wire.write(x & 0x7F);
-  Wire.endTransmission();
-  return true;
+  uint8_t x;
+  if (not readRegs(RTC_STATUS, &x, 1))
+    return false;
+  return writeReg(RTC_STATUS, x & 0x7F);
 }
 
 /**
@@ -302,10 +502,7 @@ bool DS3231::writeDateTime(uint8_t S, uint8_t M, uint8_t H,
 */
 bool DS3231::resetSeconds() {
   S = 0;
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_SECONDS);
-  Wire.write(S);
-  return (Wire.endTransmission() == 0);
+  return writeReg(RTC_SECONDS, S);
 }
 
 /**
@@ -329,10 +526,7 @@ bool DS3231::setMinutes(int8_t dir, bool readRTC) {
     else        M--;
   }
 
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_MINUTES);
-  Wire.write(bin2bcd(M));
-  return (Wire.endTransmission() == 0);
+  return writeReg(RTC_MINUTES, bin2bcd(M));
 }
 
 /**
@@ -360,10 +554,7 @@ bool DS3231::setHours(int8_t dir, bool readRTC) {
   if (H > 12) I = H - 12;
   else        I = H;
 
-  Wire.beginTransmission(rtcAddr);
-  Wire.write(RTC_HOURS);
-  Wire.write(bin2bcd(H & 0x3F));
-  return (Wire.endTransmission() == 0);
+  return writeReg(RTC_HOURS, bin2bcd(H & 0x3F));
 }
 
 /**
@@ -32,6 +32,13 @@
 // Default century
 #define CENTURY   19
 
+// I2C transaction timeout, us
+#define RTC_I2C_TIMEOUT 25000
+// Attempts for each I2C transaction
+#define RTC_I2C_RETRIES 3
+// Consecutive failed transactions before the RTC is considered down
+#define RTC_MAX_FAILS   4
+
 // DS3232 Register Addresses
 #define RTC_SECONDS 0x00
 #define RTC_MINUTES 0x01
@@ -52,18 +59,28 @@
 #define RTC_AGING   0x10
 #define RTC_TMP_MSB 0x11
 #define RTC_TMP_LSB 0x12
+#define RTC_REGS    0x13
 
 
 class DS3231 {
   public:
     DS3231();
     bool      init(uint8_t rtcAddr = I2C_RTC, bool twInit = true);
+    bool      probe();
+    void      clearErrors();
     bool      readTime(bool readDate = false);
     bool      readTimeBCD();
     uint8_t   readSecondsBCD();
     int8_t    readTemperature(bool metric = true);
+    bool      readAging(int8_t &aging);
+    bool      writeAging(int8_t aging);
+    uint32_t  unixTime();
+    bool      writeUnix(uint32_t t);
     bool      lostPower();
     uint8_t   checkAlarms();
+    bool      setSQW(bool sqw);
+    bool      setAlarm1(uint8_t u, uint8_t H, uint8_t M);
+    bool      clearAlarm1();
     bool      writeDateTime(uint8_t S, uint8_t M, uint8_t H, uint8_t d, uint8_t m, uint16_t Y);
     bool      resetSeconds();
     bool      setMinutes(int8_t dir = 1, bool readRTC = true);
@@ -94,8 +111,20 @@ class DS3231 {
     // Flags
     bool      rtcOk = false;
 
+    // Failed transactions, by first register, and bus recoveries
+    uint8_t   errors[RTC_REGS] = {0};
+    uint8_t   busClears = 0;
+
   private:
+    bool      readRegs(uint8_t reg, uint8_t* data, uint8_t len);
+    bool      writeRegs(uint8_t reg, const uint8_t* data, uint8_t len);
+    bool      writeReg(uint8_t reg, uint8_t data);
+    bool      health(uint8_t reg, bool ok);
+    void      busCheck();
+    void      busClear();
+
     uint8_t   rtcAddr = I2C_RTC;
+    uint8_t   failStreak = RTC_MAX_FAILS;
 };
 
 #endif /* DS3231_H */
@@ -21,36 +21,54 @@
 #include <SPI.h>
 
 #include "DotMatrix.h"
+#include "SPIArbiter.h"
+#include "MatrixBackend.h"
 
-DotMatrix::DotMatrix() {
+/**
+  Use the framebuffers and the MAX7219 driver of the derived class
+
+  @param fb the back framebuffer, devices * lines bytes
+  @param front the front framebuffer, devices * lines bytes
+  @param chain the MAX7219 chain driver, the default one
+  @param devices the maximum number of matrices
+  @param lines the maximum scan lines number
+*/
+DotMatrixBase::DotMatrixBase(uint8_t* fb, uint8_t* front, MAX7219Backend* chain, uint8_t devices, uint8_t lines):
+  fbData(fb), _front(front), _chain(chain), _maxDevices(devices), _maxLines(lines),
+  _scanlimit(lines), _devices(devices), maxFB(devices * lines), _drv(chain) {
+}
+
+// The RAM font, shared by all the chains
+uint8_t     DotMatrixBase::_fontRAM = 0xFF;
+uint8_t     DotMatrixBase::FONT[fontChars][maxWidth];
+chrLimits_t DotMatrixBase::chrLimits[fontChars];
+
+DotMatrix::DotMatrix():
+  DotMatrixBase(_fbOne, _fbTwo, &_max, MAX_MATRICES, MAX_SCANLIMIT) {
 }
 
 /**
-  Initialize the matrices
+  Initialize the display driver, the MAX7219 chain unless another one
+  was set
 
-  @param csPin the CipSelect pin
+  @param csPin the CipSelect pin of the MAX7219 chain
   @param devices the number of matrices
   @param lines the scan lines number
 */
-void DotMatrix::init(uint8_t csPin, uint8_t devices, uint8_t lines) {
+void DotMatrixBase::init(uint8_t csPin, uint8_t devices, uint8_t lines) {
   /* Pin configuration */
-  SPI_CS = csPin;
-  /* The number of matrices */
-  if (devices <= 0 || devices > MAX_MATRICES)
-    devices = MAX_MATRICES;
+  _chain->pin(csPin);
+  /* The number of matrices, no more than the buffers can hold */
+  if (devices <= 0 || devices > _maxDevices)
+    devices = _maxDevices;
   _devices = devices;
-  /* Configure the pins and SPI */
-  pinMode(MOSI, OUTPUT);
-  pinMode(SCK, OUTPUT);
-  pinMode(SPI_CS, OUTPUT);
-  SPI.setBitOrder(MSBFIRST);
-  SPI.setDataMode(SPI_MODE0);
-  SPI.begin();
-  digitalWrite(SPI_CS, HIGH);
+  /* The driver sets its bus up */
+  _drv->begin(_devices, clampLines(lines));
+  _ready = true;
   /* Set the scan limit */
   this->scanlimit(lines);
   /* Set the maximum framebuffer size */
-  maxFB = devices * lines;
+  maxFB = _devices * _scanlimit;
 }
 
 /**
@@ -58,8 +76,8 @@ void DotMatrix::init(uint8_t csPin, uint8_t devices, uint8_t lines) {
 
   @param value the decoding mode 0..0x0F
 */
-void DotMatrix::decodemode(uint8_t value) {
-  sendAllSPI(OP_DECODE, value & 0x0F);
+void DotMatrixBase::decodemode(uint8_t value) {
+  ctrlSend(CT_DECODE, value & 0x0F);
 }
 
 /**
@@ -67,9 +85,44 @@ void DotMatrix::decodemode(uint8_t value) {
 
   @param value the brightness 0..0x0F
 */
-void DotMatrix::intensity(uint8_t value) {
-  if (value <= 0x0F)
-    sendAllSPI(OP_INTENS, value);
+void DotMatrixBase::intensity(uint8_t value) {
+  if (value <= 0x0F) {
+    _intensity = value;
+    ctrlSend(CT_INTENS, value < _cap ? value : _cap);
+  }
+}
+
+/**
+  Limit the LED brightness, the requested intensity is restored when
+  the limit is raised
+
+  @param cap the maximum brightness 0..0x0F
+*/
+void DotMatrixBase::intensityCap(uint8_t cap) {
+  _cap = cap < 0x0F ? cap : 0x0F;
+  uint8_t value = _intensity < _cap ? _intensity : _cap;
+  if (value != _ctrl[CT_INTENS])
+    ctrlSend(CT_INTENS, value);
+}
+
+/**
+  Get the LED brightness, as written to the matrices
+
+  @return the brightness 0..0x0F
+*/
+uint8_t DotMatrixBase::level() {
+  return _ctrl[CT_INTENS];
+}
+
+/**
+  Estimate the current the display draws, as its driver does
+
+  @param lit the lit pixels
+  @param level the brightness 0..0x0F
+  @return the current in mA
+*/
+uint16_t DotMatrixBase::current(uint16_t lit, uint8_t level) {
+  return _drv->current(lit, level);
 }
 
 /**
@@ -77,9 +130,20 @@ void DotMatrix::intensity(uint8_t value) {
 
   @param value the scan limit 0..0x07
 */
-void DotMatrix::scanlimit(uint8_t value) {
-  _scanlimit = ((value - 1) & 0x07) + 1;
-  sendAllSPI(OP_SCNLMT, _scanlimit - 1);
+void DotMatrixBase::scanlimit(uint8_t value) {
+  _scanlimit = clampLines(value);
+  ctrlSend(CT_SCNLMT, _scanlimit - 1);
+}
+
+/**
+  Limit the scan lines to the register and the buffers
+
+  @param value the scan lines number
+  @return the scan lines number to use
+*/
+uint8_t DotMatrixBase::clampLines(uint8_t value) {
+  value = ((value - 1) & 0x07) + 1;
+  return value > _maxLines ? _maxLines : value;
 }
 
 /**
@@ -87,9 +151,9 @@ void DotMatrix::scanlimit(uint8_t value) {
 
   @param yesno the on/off switch
 */
-void DotMatrix::shutdown(bool yesno) {
+void DotMatrixBase::shutdown(bool yesno) {
   uint8_t data = yesno ? 0 : 1;
-  sendAllSPI(OP_SHTDWN, data);
+  ctrlSend(CT_SHTDWN, data);
 }
 
 /**
@@ -97,31 +161,77 @@ void DotMatrix::shutdown(bool yesno) {
 
   @param yesno the test on/off switch
 */
-void DotMatrix::displaytest(bool yesno) {
+void DotMatrixBase::displaytest(bool yesno) {
   uint8_t data = yesno ? 1 : 0;
-  sendAllSPI(OP_DSPTST, data);
+  ctrlSend(CT_DSPTST, data);
+}
+
+/**
+  Keep the value of a control register and send it to all devices
+
+  @param ctrl the control register index
+  @param value the register value
+*/
+void DotMatrixBase::ctrlSend(uint8_t ctrl, uint8_t value) {
+  _ctrl[ctrl] = value;
+  spiBytes += _drv->control(ctrl, value);
+  if (_drv->redraw)
+    fbQueue();
+}
+
+/**
+  Rewrite the next control register, round-robin, from its kept value.
+  Called from fbWrite(), so the register goes out on the chain's turn on
+  the bus.
+*/
+void DotMatrixBase::ctrlScrub() {
+  uint16_t sent = _drv->scrub(_scrub, _ctrl[_scrub]);
+  spiBytes   += sent;
+  scrubBytes += sent;
+  if (++_scrub >= CT_COUNT)
+    _scrub = 0;
 }
 
 /**
   Clear the matrix (all leds off)
 */
-void DotMatrix::clear() {
-  for (uint8_t l = 0; l < _scanlimit; l++)
-    sendAllSPI(l + 1, 0x00);
+void DotMatrixBase::clear() {
+  // The front framebuffer keeps what the matrices show
+  memset(_front, 0, maxFB);
+  spiBytes += _drv->write(_front, (1 << _scanlimit) - 1);
 }
 
 /**
-  Load the specified font into RAM
+  Use the specified font and load it into RAM
 
   @param font the font id
 */
-void DotMatrix::loadFont(uint8_t font) {
-  uint8_t chrbuf[8] = {0};
+void DotMatrixBase::loadFont(uint8_t font) {
   font %= fontCount;
+  // Already in use
+  if (font == _font)
+    return;
+  _font = font;
+  fontRAM();
+  // The layout depends on the font
+  lytLen = 0;
+}
+
+/**
+  Load the font of this chain into the RAM copy, which all the chains
+  share: a chain using another font than the last one loaded gets its
+  own back before rendering.
+*/
+void DotMatrixBase::fontRAM() {
+  uint8_t chrbuf[8] = {0};
+  // Already loaded
+  if (_font == _fontRAM)
+    return;
+  _fontRAM = _font;
   // Load each character into RAM
   for (int i = 0; i < fontChars; i++) {
     // Load into temporary buffer
-    memcpy_P(&chrbuf, &FONTS[font][i], 8);
+    memcpy_P(&chrbuf, &FONTS[_font][i], 8);
     // Rotate
     for (uint8_t j = 0; j < 8; j++) {
       for (uint8_t k = 0; k < 8; k++) {
@@ -147,7 +257,7 @@ void DotMatrix::loadFont(uint8_t font) {
   @param the character to compute the limits and width for
   @return the character limits struct
 */
-chrLimits_t DotMatrix::getLimits(uint8_t ch) {
+chrLimits_t DotMatrixBase::getLimits(uint8_t ch) {
   chrLimits_t lmt = {maxWidth, maxWidth, 0};
   // The characters are already rotated, just find the non-zero bytes
   for (uint8_t l = 0; l < maxWidth; l++) {
@@ -166,27 +276,324 @@ chrLimits_t DotMatrix::getLimits(uint8_t ch) {
   return lmt;
 }
 
+/**
+  Get the limits of any printable character: font characters, ASCII
+  characters using the fallback font or, for anything else, the limits
+  of the digits
+
+  @param chr the character code
+  @return the character limits struct
+*/
+chrLimits_t DotMatrixBase::glyphLimits(uint8_t chr) {
+  // Current font
+  if (_font != _fontRAM)
+    fontRAM();
+  if (chr < fontChars)
+    return chrLimits[chr];
+  // Invalid characters take the space of a digit
+  if (chr < ascFirst or chr > ascLast)
+    return chrLimits[0];
+  // Fallback font, trim the empty columns
+  chrLimits_t lmt = {ascWidth, ascWidth, 0};
+  for (uint8_t l = 0; l < ascWidth; l++) {
+    if (ascColumn(chr, l) != 0) {
+      if (lmt.right == ascWidth) lmt.right = l;
+      lmt.left = l;
+    }
+  }
+  if (lmt.right != ascWidth)
+    lmt.width = lmt.left - lmt.right + 1;
+  else {
+    // Space
+    lmt.right = 0;
+    lmt.width = ascSpace;
+  }
+  return lmt;
+}
+
+/**
+  Get one column of a character in the fallback font, rotated like the
+  RAM font: column 0 is the rightmost and the top row is the MSB
+
+  @param chr the ASCII character
+  @param col the column
+  @return the column bits
+*/
+uint8_t DotMatrixBase::ascColumn(uint8_t chr, uint8_t col) {
+  uint8_t b = pgm_read_byte(&FNTASC[(chr - ascFirst) * ascWidth + ascWidth - 1 - col]);
+  // Reverse the bits
+  b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+  b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+  b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+  return b;
+}
+
+/**
+  Get one column of any printable character, rotated like the RAM font
+
+  @param chr the character code
+  @param col the column
+  @return the column bits, zero for invalid characters
+*/
+uint8_t DotMatrixBase::glyphColumn(uint8_t chr, uint8_t col) {
+  if (_font != _fontRAM)
+    fontRAM();
+  if (chr < fontChars)
+    return FONT[chr][col];
+  if (chr >= ascFirst and chr <= ascLast)
+    return ascColumn(chr, col);
+  return 0;
+}
+
+/**
+  Get the character code to print for an ASCII character: the index in
+  the current font if the font defines it, or the ASCII code itself, to
+  be printed with the fallback font
+
+  @param c the ASCII character
+  @return the character code
+*/
+uint8_t DotMatrixBase::glyph(char c) {
+  uint8_t chr = c;
+  if (chr < ascFirst or chr > ascLast)
+    return ascLast;
+  uint8_t idx = pgm_read_byte(&ASCIDX[chr - ascFirst]);
+  return idx == 0xFF ? chr : idx;
+}
+
 /**
   Clear the framebuffer
 */
-void DotMatrix::fbClear() {
+void DotMatrixBase::fbClear() {
   memset(fbData, 0, maxFB);
+  // The cached layout is no longer on the framebuffer
+  lytLen = 0;
 }
 
 /**
-  Display the framebuffer
+  Count the lit pixels in the back framebuffer
+
+  @return the number of pixels on
 */
-void DotMatrix::fbDisplay() {
-  /* Repeat for each line in matrix */
-  for (uint8_t i = 0; i < _scanlimit; i++) {
-    /* Compose an array containing the same line in all matrices */
-    uint8_t data[_devices] = {0};
-    /* Fill the array from the frambuffer */
-    for (uint8_t m = 0; m < _devices; m++)
-      data[m] = fbData[m * _scanlimit + i];
-    /* Send the array */
-    sendAllSPI(i + 1, data, _devices);
+uint16_t DotMatrixBase::fbLit() {
+  uint16_t lit = 0;
+  for (uint8_t i = 0; i < maxFB; i++) {
+    uint8_t v = fbData[i];
+    /* Count the bits in pairs, nibbles, then the byte */
+    v = v - ((v >> 1) & 0x55);
+    v = (v & 0x33) + ((v >> 2) & 0x33);
+    lit += (v + (v >> 4)) & 0x0F;
   }
+  return lit;
+}
+
+/**
+  Display the framebuffer, sending all the lines
+*/
+void DotMatrixBase::fbDisplay() {
+  fbFlush(0xFF);
+}
+
+/**
+  Present the back framebuffer, sending only the changed lines
+*/
+void DotMatrixBase::fbPresent() {
+  fbFlush(0);
+}
+
+/**
+  Drop the changes in the back framebuffer, back to the presented frame
+*/
+void DotMatrixBase::fbRevert() {
+  memcpy(fbData, _front, maxFB);
+  // The cached layout is no longer on the framebuffer
+  lytLen = 0;
+}
+
+/**
+  Get the front framebuffer, as shown on the matrices
+
+  @return the front framebuffer
+*/
+const uint8_t* DotMatrixBase::fbFront() {
+  return _front;
+}
+
+/**
+  Defer the display of the framebuffer to a sync point.  While
+  deferred, the frame is composed in the back framebuffer and nothing
+  is sent; ending the deferral presents the frame, complete.  The sync
+  point is the end of the mode composition, in the loop, not the RTC
+  SQW edge or a timer tick: the SQW/INT pin carries the alarm interrupt
+  and is a square wave only while a timer runs.
+
+  @param defer defer the display or present the frame now
+*/
+void DotMatrixBase::fbSync(bool defer) {
+  _defer = defer;
+  if (not defer and _queued) {
+    _queued = false;
+    fbFlush(_pending);
+    _pending = 0;
+  }
+}
+
+/**
+  Display only the framebuffer columns in the specified range
+
+  @param lo the first column
+  @param hi the last column
+*/
+void DotMatrixBase::fbDisplay(uint8_t lo, uint8_t hi) {
+  uint8_t lines = 0;
+  // Each column is a line in one of the matrices
+  if (hi - lo + 1 >= _scanlimit)
+    lines = 0xFF;
+  else
+    for (uint8_t c = lo; c <= hi; c++)
+      lines |= 1 << (c % _scanlimit);
+  fbFlush(lines);
+}
+
+/**
+  Present the back framebuffer: swap it with the front one, if it
+  differs from the previous frame, and queue the changed lines, along
+  with the specified lines.  They are written now or, if the chain
+  shares the bus, when the arbiter services it.  The back framebuffer
+  keeps the frame, the rendering is incremental.
+
+  @param lines the lines to send even if unchanged, bitmask
+*/
+void DotMatrixBase::fbFlush(uint8_t lines) {
+  /* At the sync point only */
+  if (_defer) {
+    _pending |= lines;
+    _queued = true;
+    return;
+  }
+  /* Compare each line in all matrices to the previous frame and swap
+     the framebuffers; the lines queued and not yet written stay queued,
+     they are written from the new front framebuffer */
+  _dirty |= lines | fbSwap();
+  frames++;
+  fbQueue();
+}
+
+/**
+  Every SCRUB_WAIT ms, whether frames are presented or not, queue one
+  line, round-robin, for refresh and the next control register for
+  scrubbing.  A module knocked into test mode, shutdown or a wrong scan
+  limit by a glitch recovers within CT_COUNT * SCRUB_WAIT ms, when its
+  register comes again.  A chain on an arbiter is scrubbed by its
+  service(), which writes what is queued; otherwise, it is written now.
+
+  @return true if queued
+*/
+bool DotMatrixBase::scrub() {
+  uint32_t now = millis();
+  if (not _ready or now - _scrubLast < SCRUB_WAIT)
+    return false;
+  _scrubLast = now;
+  _scrubs |= 1 << _scrubLine;
+  if (++_scrubLine >= _scanlimit)
+    _scrubLine = 0;
+  _ctrlDue = true;
+  if (not _arb)
+    fbWrite();
+  return true;
+}
+
+/**
+  Write the queued lines now or, if the chain shares the bus, ask the
+  arbiter to
+*/
+void DotMatrixBase::fbQueue() {
+  if (_arb)
+    _arb->request(_arbId);
+  else
+    fbWrite();
+}
+
+/**
+  Write the queued lines of the front framebuffer, in a single SPI
+  transaction, all matrices at once for each line, then the control
+  register due for scrubbing, if any
+
+  @return the number of lines written
+*/
+uint8_t DotMatrixBase::fbWrite() {
+  if (_drv->redraw)
+    _dirty = 0xFF;
+  uint8_t lines = (_dirty | _scrubs) & ((1 << _scanlimit) - 1);
+  uint8_t count = 0;
+  if (not lines and not _ctrlDue)
+    return 0;
+  /* Keep the traffic and the time of this write */
+  uint32_t start = micros();
+  uint32_t sent  = spiBytes;
+  /* The driver writes the lines its own way; the unchanged ones, only
+     refreshed, take their share of the bytes as scrubbing */
+  if (lines) {
+    uint16_t bytes = _drv->write(_front, lines);
+    uint8_t  refreshed = 0;
+    for (uint8_t l = lines; l; l >>= 1)
+      count += l & 1;
+    for (uint8_t l = lines & ~_dirty; l; l >>= 1)
+      refreshed += l & 1;
+    spiBytes   += bytes;
+    scrubBytes += (uint32_t)bytes * refreshed / count;
+  }
+  _dirty  = 0;
+  _scrubs = 0;
+  /* On the same bus turn, the control register due for scrubbing */
+  if (_ctrlDue) {
+    _ctrlDue = false;
+    ctrlScrub();
+  }
+  frameBytes = spiBytes - sent;
+  frameTime  = micros() - start;
+  return count;
+}
+
+/**
+  Compare the back framebuffer to the previous frame and swap them, at
+  runtime size
+
+  @return the lines that changed, bitmask
+*/
+uint8_t DotMatrixBase::fbSwap() {
+  return swapLines(_devices, _scanlimit);
+}
+
+/**
+  Drive other hardware than the MAX7219 chain, best set before init();
+  set later, the driver is started and gets the control registers
+  already written.  Nothing is sent to the MAX7219 chain anymore; the
+  self-test and the clock are those of the driver.
+
+  @param drv the display driver
+*/
+void DotMatrixBase::backend(MatrixBackend* drv) {
+  _drv = drv;
+  if (not _ready)
+    return;
+  _drv->begin(_devices, _scanlimit);
+  for (uint8_t c = 0; c < CT_COUNT; c++)
+    spiBytes += _drv->control(c, _ctrl[c]);
+  _dirty = 0xFF;
+  fbQueue();
+}
+
+/**
+  Share the bus through an arbiter, the frames are written when it
+  services the chain
+
+  @param arb the arbiter
+  @param id the chain id in arbiter
+*/
+void DotMatrixBase::arbiter(SPIArbiter* arb, uint8_t id) {
+  _arb   = arb;
+  _arbId = id;
 }
 
 /**
@@ -196,15 +603,25 @@ void DotMatrix::fbDisplay() {
   @param digit the character/digit to print
   @param alogn print alignment
 */
-void DotMatrix::fbPrint(uint8_t pos, uint8_t digit) {
+void DotMatrixBase::fbPrint(uint8_t pos, uint8_t digit) {
   // Print only if the character is valid
-  if (digit < fontChars)
+  if (digit < fontChars) {
+    if (_font != _fontRAM)
+      fontRAM();
     // Process each line of the character
     for (uint8_t l = 0; l < chrLimits[digit].width; l++)
       // Print only if inside framebuffer
       if (pos + l < maxFB)
         // Print
         fbData[pos + l] |= FONT[digit][l + chrLimits[digit].right] ;
+  }
+  // Fallback font
+  else if (digit >= ascFirst and digit <= ascLast) {
+    chrLimits_t lmt = glyphLimits(digit);
+    for (uint8_t l = 0; l < lmt.width; l++)
+      if (pos + l < maxFB)
+        fbData[pos + l] |= ascColumn(digit, l + lmt.right);
+  }
 }
 
 /**
@@ -215,110 +632,223 @@ void DotMatrix::fbPrint(uint8_t pos, uint8_t digit) {
   @param len number of characters
   @param alogn print alignment
 */
-void DotMatrix::fbPrint(uint8_t* poss, uint8_t* chars, uint8_t len) {
+void DotMatrixBase::fbPrint(uint8_t* poss, uint8_t* chars, uint8_t len) {
   // Clear the framebuffer
   fbClear();
   // Print each character at specified position on framebuffer
   for (uint8_t d = 0; d < len; d++)
     fbPrint(poss[d], chars[d]);
-  // Display the framebuffer
-  fbDisplay();
+  // Display the changes
+  fbFlush(0);
 }
 
 /**
-  Print the characters, with auto positioning
+  Print the characters, with auto positioning.  The layout is cached:
+  if the cells keep their widths, only the changed ones are printed and
+  only their columns are sent to the matrices.
 
   @param digit the characters array to print
   @param len number of characters
   @param alogn print alignment
 */
-void DotMatrix::fbPrint(uint8_t* chars, uint8_t len, uint8_t align) {
-  uint8_t poss[maxFB] = {0};
-  uint8_t pos = 0;
+void DotMatrixBase::fbPrint(uint8_t* chars, uint8_t len, uint8_t align) {
+  // Check if the cached layout can be used
+  bool same = (len > 0) and (len == lytLen) and (align == lytAlign);
+  for (uint8_t d = 0; same and d < len; d++)
+    if (chars[d] != lytChars[d] and
+        glyphLimits(chars[d]).width != glyphLimits(lytChars[d]).width)
+      same = false;
+
+  if (same) {
+    bool changed = false;
+    for (uint8_t d = 0; d < len; d++) {
+      if (chars[d] == lytChars[d])
+        continue;
+      // Clear the cell and print the new character
+      uint8_t pos = lytPoss[d];
+      uint8_t wdt = glyphLimits(chars[d]).width;
+      for (uint8_t l = pos; l < pos + wdt and l < maxFB; l++)
+        fbData[l] = 0;
+      fbPrint(pos, chars[d]);
+      lytChars[d] = chars[d];
+      changed = true;
+    }
+    // Display only the changed lines
+    if (changed)
+      fbFlush(0);
+    return;
+  }
 
-  // First, compute the right-aligned positions
-  for (int8_t d = len - 1; d >= 0; d--) {
+  // First, compute the right-aligned width
+  uint8_t pos = 0;
+  for (int8_t d = len - 1; d >= 0; d--)
     // Check if the character is valid and compute its print and next postions
     // using its limits or use the limits of the digits by default
-    uint8_t chr = chars[d] < fontChars ? chars[d] : 0;
-    poss[d] = pos;
-    pos += chrLimits[chr].width + 1;
-  }
+    pos += glyphLimits(chars[d]).width + 1;
 
   // Alignment
-  if (align == CENTER and pos < maxFB) {
+  uint8_t offset = 0;
+  if (align == CENTER and pos < maxFB)
     // Get the offset to center the text
-    uint8_t offset = (maxFB - (pos - 1)) / 2;
-    // Add the offset to positions
-    for (uint8_t d = 0; d < len; d++)
-      poss[d] += offset;
-  }
-  else if (align == LEFT and pos < maxFB) {
+    offset = (maxFB - (pos - 1)) / 2;
+  else if (align == LEFT and pos < maxFB)
     // Get the offset to left-align the text
-    uint8_t offset = maxFB - (pos - 1);
-    // Add the offset to positions
-    for (uint8_t d = 0; d < len; d++)
-      poss[d] += offset;
-  }
+    offset = maxFB - (pos - 1);
 
-  // Print each character at computed position on framebuffer
-  fbPrint(poss, chars, len);
+  // Clear the framebuffer
+  fbClear();
+  // Print each character at computed position on framebuffer, keeping
+  // the layout if it fits the cache
+  bool keep = len <= maxCells;
+  pos = offset;
+  for (int8_t d = len - 1; d >= 0; d--) {
+    fbPrint(pos, chars[d]);
+    if (keep) {
+      lytPoss[d]  = pos;
+      lytChars[d] = chars[d];
+    }
+    pos += glyphLimits(chars[d]).width + 1;
+  }
+  lytLen   = keep ? len : 0;
+  lytAlign = align;
+  // Display the changes
+  fbFlush(0);
 }
 
 /**
-  Send data to one device
+  Print the characters in a region of the framebuffer, with auto
+  positioning inside the region and clipped to it.  The region is
+  cleared first and nothing is sent, the frame is displayed by the
+  caller.
+
+  @param lo the rightmost column of the region
+  @param hi the leftmost column of the region
+  @param rows the rows of the region, bitmask, the MSB is the top row
+  @param chars the characters array to print
+  @param len number of characters
+  @param align print alignment
 */
-void DotMatrix::sendSPI(uint8_t matrix, uint8_t reg, uint8_t data) {
-  uint8_t offset = matrix * 2;
+void DotMatrixBase::fbRegion(uint8_t lo, uint8_t hi, uint8_t rows, uint8_t* chars, uint8_t len, uint8_t align) {
+  if (hi >= maxFB)
+    hi = maxFB - 1;
+  if (lo > hi)
+    return;
+  uint8_t wdt = hi - lo + 1;
+  // Compute the width
+  uint8_t pos = 0;
+  for (uint8_t d = 0; d < len; d++)
+    pos += glyphLimits(chars[d]).width + 1;
+  // Alignment inside the region
+  uint8_t offset = 0;
+  if (align == CENTER and pos < wdt)
+    offset = (wdt - (pos - 1)) / 2;
+  else if (align == LEFT and pos < wdt)
+    offset = wdt - (pos - 1);
+  // Clear the region
+  for (uint8_t c = lo; c <= hi; c++)
+    fbData[c] &= ~rows;
+  // Print each character, only the columns inside the region
+  pos = lo + offset;
+  for (int8_t d = len - 1; d >= 0; d--) {
+    chrLimits_t lmt = glyphLimits(chars[d]);
+    for (uint8_t l = 0; l < lmt.width and pos + l <= hi; l++)
+      fbData[pos + l] |= glyphColumn(chars[d], l + lmt.right) & rows;
+    pos += lmt.width + 1;
+  }
+  // The cached layout is no longer on the framebuffer
+  lytLen = 0;
+}
 
-  /* Clear the command buffer */
-  memset(cmdBuffer, 0, _devices * 2);
-  /* Write the data into command buffer */
-  cmdBuffer[offset] = data;
-  cmdBuffer[offset + 1] = reg;
+/**
+  Draw a bar in a region of the framebuffer, growing from the left,
+  clipped to the region.  As for fbRegion(), nothing is sent.
 
-  /* Chip select */
-  digitalWrite(SPI_CS, LOW);
-  /* Send the data */
-  SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));
-  for (int i = _devices * 2; i > 0; i--)
-    SPI.transfer(cmdBuffer[i - 1]);
-  SPI.endTransaction();
-  /* Latch data */
-  digitalWrite(SPI_CS, HIGH);
+  @param lo the rightmost column of the region
+  @param hi the leftmost column of the region
+  @param rows the rows of the region, bitmask
+  @param len the bar length, columns
+*/
+void DotMatrixBase::fbBar(uint8_t lo, uint8_t hi, uint8_t rows, uint8_t len) {
+  if (hi >= maxFB)
+    hi = maxFB - 1;
+  if (lo > hi)
+    return;
+  for (uint8_t c = lo; c <= hi; c++)
+    if (hi - c < len)
+      fbData[c] |= rows;
+    else
+      fbData[c] &= ~rows;
+  // The cached layout is no longer on the framebuffer
+  lytLen = 0;
 }
 
 /**
-  Send the same data to all device, at once
+  Print a text, with auto positioning.  The characters the current
+  font does not define are printed using the fallback font.
+
+  @param text the text to print
+  @param align print alignment
 */
-void DotMatrix::sendAllSPI(uint8_t reg, uint8_t data) {
-  /* Chip select */
-  digitalWrite(SPI_CS, LOW);
-  /* Send the data */
-  SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));
-  for (int i = _devices; i > 0; i--) {
-    SPI.transfer(reg);
-    SPI.transfer(data);
+void DotMatrixBase::fbPrint(const char* text, uint8_t align) {
+  uint8_t chars[maxText];
+  uint8_t len = 0;
+  // Get the character codes
+  while (text[len] and len < maxText) {
+    chars[len] = glyph(text[len]);
+    len++;
   }
-  SPI.endTransaction();
-  /* Latch data */
-  digitalWrite(SPI_CS, HIGH);
+  fbPrint(chars, len, align);
 }
 
 /**
-  Send the data in array to device, at once
+  Self-test the chain, see MAX7219Backend::chainTest()
+
+  @param speed the SPI clock to test
+  @param rounds the number of patterns to check
+  @return the devices in the chain, CHAIN_NONE if there is no loopback
+          or the driver has none, CHAIN_FAULT for a broken module or bit
+          errors at this clock
 */
-void DotMatrix::sendAllSPI(uint8_t reg, uint8_t* data, uint8_t size) {
-  /* Chip select */
-  digitalWrite(SPI_CS, LOW);
-  /* Send the data */
-  SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));
-  for (int i = size; i > 0; i--) {
-    SPI.transfer(reg);
-    SPI.transfer(data[i - 1]);
+uint8_t DotMatrixBase::chainTest(uint32_t speed, uint8_t rounds) {
+  uint16_t bytes;
+  uint8_t found = _drv->chainTest(speed, rounds, bytes);
+  spiBytes += bytes;
+  return found;
+}
+
+/**
+  Step up the SPI clock, from SPI_SPEED to SPI_SPEED_MAX, as long as the
+  chain self-test finds all the devices
+
+  @return the SPI clock in use, 0 if the self-test fails at SPI_SPEED
+*/
+uint32_t DotMatrixBase::tune() {
+  _drv->speed(SPI_SPEED);
+  if (chainTest(SPI_SPEED) != _devices)
+    return 0;
+  for (uint32_t s = SPI_SPEED * 2; s <= SPI_SPEED_MAX; s *= 2) {
+    if (chainTest(s, 8) != _devices)
+      break;
+    _drv->speed(s);
   }
-  SPI.endTransaction();
-  /* Latch data */
-  digitalWrite(SPI_CS, HIGH);
+  return _drv->speed();
+}
+
+/**
+  Get the bus clock of the driver
+
+  @return the clock in use, 0 if it has none to tune
+*/
+uint32_t DotMatrixBase::speed() {
+  return _drv->speed();
 }
 
+/**
+  Set the bus clock of the driver, as tuned for another chain on the
+  same bus
+
+  @param hz the clock, limited by the driver
+*/
+void DotMatrixBase::speed(uint32_t hz) {
+  _drv->speed(hz);
+}
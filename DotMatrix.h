@@ -20,11 +20,12 @@
 #ifndef DOTMATRIX_H
 #define DOTMATRIX_H
 
-#define MAX_MATRICES  8
-#define MAX_SCANLIMIT 8
-#define SPI_SPEED     1000000
+#define SCRUB_WAIT    1000
 
 #include "Arduino.h"
+#include <SPI.h>
+
+#include "MatrixBackend.h"
 
 /* Fonts */
 
@@ -373,14 +374,167 @@ const uint64_t FNTUNC[] PROGMEM = {
   0x101070f000000000,
 };
 
+/*
+  Tiny 3x5 font, fits MM:SS.hh on four matrices
+  https://xantorohara.github.io/led-matrix-editor/#0000070505050700|0000070202030200|0000070107040700|0000070407040700|0000040407050500|0000070407010700|0000070507010700|0000020204040700|0000070507050700|0000070407050700|0000000100010000|0000010000000000|0000070101010700|0000000000030300|0000000007000000|0000010107010700
+*/
+const uint64_t FNTTNY[] PROGMEM = {
+  0x0000070505050700,
+  0x0000070202030200,
+  0x0000070107040700,
+  0x0000070407040700,
+  0x0000040407050500,
+  0x0000070407010700,
+  0x0000070507010700,
+  0x0000020204040700,
+  0x0000070507050700,
+  0x0000070407050700,
+  0x0000000100010000,
+  0x0000010000000000,
+  0x0000070101010700,
+  0x0000000000030300,
+  0x0000000007000000,
+  0x0000010107010700,
+};
+
 const uint64_t* const FONTS[] = {FNTSTD, FNTSKD, FNTBLD, FNTSML,
                                  FNTNCS, FNTLTW, FNTHLV, FNTSQR,
                                  FNTSPX, FNTNOK, FNTMDN, FNTTLO,
-                                 FNTLRG, FNTHND, FNTUNC
+                                 FNTLRG, FNTHND, FNTUNC, FNTTNY
                                 };
 const uint8_t fontChars = sizeof(FNTSTD) / sizeof(*FNTSTD); // Characters in font
 const uint8_t fontCount = sizeof(FONTS)  / sizeof(*FONTS);  // Number of fonts
 const uint8_t maxWidth = 8;                                 // Font maximal width
+const uint8_t fontTiny = fontCount - 1;                     // The tiny font, for long numbers
+
+/*
+  ASCII 5x7 fallback font, shared by all fonts, for the characters the
+  current font does not define.  Five columns per character, left to
+  right, the least significant bit is the top row.
+*/
+const uint8_t FNTASC[] PROGMEM = {
+  0x00, 0x00, 0x00, 0x00, 0x00, // space
+  0x00, 0x00, 0x5F, 0x00, 0x00, // !
+  0x00, 0x07, 0x00, 0x07, 0x00, // "
+  0x14, 0x7F, 0x14, 0x7F, 0x14, // #
+  0x24, 0x2A, 0x7F, 0x2A, 0x12, // $
+  0x23, 0x13, 0x08, 0x64, 0x62, // %
+  0x36, 0x49, 0x55, 0x22, 0x50, // &
+  0x00, 0x05, 0x03, 0x00, 0x00, // '
+  0x00, 0x1C, 0x22, 0x41, 0x00, // (
+  0x00, 0x41, 0x22, 0x1C, 0x00, // )
+  0x14, 0x08, 0x3E, 0x08, 0x14, // *
+  0x08, 0x08, 0x3E, 0x08, 0x08, // +
+  0x00, 0x50, 0x30, 0x00, 0x00, // ,
+  0x08, 0x08, 0x08, 0x08, 0x08, // -
+  0x00, 0x60, 0x60, 0x00, 0x00, // .
+  0x20, 0x10, 0x08, 0x04, 0x02, // /
+  0x3E, 0x51, 0x49, 0x45, 0x3E, // 0
+  0x00, 0x42, 0x7F, 0x40, 0x00, // 1
+  0x42, 0x61, 0x51, 0x49, 0x46, // 2
+  0x21, 0x41, 0x45, 0x4B, 0x31, // 3
+  0x18, 0x14, 0x12, 0x7F, 0x10, // 4
+  0x27, 0x45, 0x45, 0x45, 0x39, // 5
+  0x3C, 0x4A, 0x49, 0x49, 0x30, // 6
+  0x01, 0x71, 0x09, 0x05, 0x03, // 7
+  0x36, 0x49, 0x49, 0x49, 0x36, // 8
+  0x06, 0x49, 0x49, 0x29, 0x1E, // 9
+  0x00, 0x36, 0x36, 0x00, 0x00, // :
+  0x00, 0x56, 0x36, 0x00, 0x00, // ;
+  0x08, 0x14, 0x22, 0x41, 0x00, // <
+  0x14, 0x14, 0x14, 0x14, 0x14, // =
+  0x00, 0x41, 0x22, 0x14, 0x08, // >
+  0x02, 0x01, 0x51, 0x09, 0x06, // ?
+  0x32, 0x49, 0x79, 0x41, 0x3E, // @
+  0x7E, 0x11, 0x11, 0x11, 0x7E, // A
+  0x7F, 0x49, 0x49, 0x49, 0x36, // B
+  0x3E, 0x41, 0x41, 0x41, 0x22, // C
+  0x7F, 0x41, 0x41, 0x22, 0x1C, // D
+  0x7F, 0x49, 0x49, 0x49, 0x41, // E
+  0x7F, 0x09, 0x09, 0x01, 0x01, // F
+  0x3E, 0x41, 0x41, 0x51, 0x32, // G
+  0x7F, 0x08, 0x08, 0x08, 0x7F, // H
+  0x00, 0x41, 0x7F, 0x41, 0x00, // I
+  0x20, 0x40, 0x41, 0x3F, 0x01, // J
+  0x7F, 0x08, 0x14, 0x22, 0x41, // K
+  0x7F, 0x40, 0x40, 0x40, 0x40, // L
+  0x7F, 0x02, 0x04, 0x02, 0x7F, // M
+  0x7F, 0x04, 0x08, 0x10, 0x7F, // N
+  0x3E, 0x41, 0x41, 0x41, 0x3E, // O
+  0x7F, 0x09, 0x09, 0x09, 0x06, // P
+  0x3E, 0x41, 0x51, 0x21, 0x5E, // Q
+  0x7F, 0x09, 0x19, 0x29, 0x46, // R
+  0x46, 0x49, 0x49, 0x49, 0x31, // S
+  0x01, 0x01, 0x7F, 0x01, 0x01, // T
+  0x3F, 0x40, 0x40, 0x40, 0x3F, // U
+  0x1F, 0x20, 0x40, 0x20, 0x1F, // V
+  0x7F, 0x20, 0x18, 0x20, 0x7F, // W
+  0x63, 0x14, 0x08, 0x14, 0x63, // X
+  0x03, 0x04, 0x78, 0x04, 0x03, // Y
+  0x61, 0x51, 0x49, 0x45, 0x43, // Z
+  0x00, 0x7F, 0x41, 0x41, 0x00, // [
+  0x02, 0x04, 0x08, 0x10, 0x20, // backslash
+  0x00, 0x41, 0x41, 0x7F, 0x00, // ]
+  0x04, 0x02, 0x01, 0x02, 0x04, // ^
+  0x40, 0x40, 0x40, 0x40, 0x40, // _
+  0x00, 0x01, 0x02, 0x04, 0x00, // `
+  0x20, 0x54, 0x54, 0x54, 0x78, // a
+  0x7F, 0x48, 0x44, 0x44, 0x38, // b
+  0x38, 0x44, 0x44, 0x44, 0x20, // c
+  0x38, 0x44, 0x44, 0x48, 0x7F, // d
+  0x38, 0x54, 0x54, 0x54, 0x18, // e
+  0x08, 0x7E, 0x09, 0x01, 0x02, // f
+  0x08, 0x14, 0x54, 0x54, 0x3C, // g
+  0x7F, 0x08, 0x04, 0x04, 0x78, // h
+  0x00, 0x44, 0x7D, 0x40, 0x00, // i
+  0x20, 0x40, 0x44, 0x3D, 0x00, // j
+  0x7F, 0x10, 0x28, 0x44, 0x00, // k
+  0x00, 0x41, 0x7F, 0x40, 0x00, // l
+  0x7C, 0x04, 0x18, 0x04, 0x78, // m
+  0x7C, 0x08, 0x04, 0x04, 0x78, // n
+  0x38, 0x44, 0x44, 0x44, 0x38, // o
+  0x7C, 0x14, 0x14, 0x14, 0x08, // p
+  0x08, 0x14, 0x14, 0x18, 0x7C, // q
+  0x7C, 0x08, 0x04, 0x04, 0x08, // r
+  0x48, 0x54, 0x54, 0x54, 0x20, // s
+  0x04, 0x3F, 0x44, 0x40, 0x20, // t
+  0x3C, 0x40, 0x40, 0x20, 0x7C, // u
+  0x1C, 0x20, 0x40, 0x20, 0x1C, // v
+  0x3C, 0x40, 0x30, 0x40, 0x3C, // w
+  0x44, 0x28, 0x10, 0x28, 0x44, // x
+  0x0C, 0x50, 0x50, 0x50, 0x3C, // y
+  0x44, 0x64, 0x54, 0x4C, 0x44, // z
+  0x00, 0x08, 0x36, 0x41, 0x00, // {
+  0x00, 0x00, 0x7F, 0x00, 0x00, // 
+  0x00, 0x41, 0x36, 0x08, 0x00, // }
+  0x08, 0x04, 0x08, 0x10, 0x08, // ~
+  0x7F, 0x7F, 0x7F, 0x7F, 0x7F, // unknown
+};
+const uint8_t ascFirst = 0x20;                              // First ASCII character
+const uint8_t ascLast  = 0x7F;                              // Last ASCII character, the 'unknown' glyph
+const uint8_t ascWidth = 5;                                 // ASCII font width
+const uint8_t ascSpace = 2;                                 // Width of the space character
+
+/*
+  ASCII to glyph index: the characters defined by all the fonts map to
+  their index in the font, all the others (0xFF) use the fallback font
+*/
+const uint8_t ASCIDX[] PROGMEM = {
+  //  !     "     #     $     %     &     '     (     )     *     +     ,     -     .     /
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x0D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x0E, 0x0B, 0xFF,
+  // 0  1     2     3     4     5     6     7     8     9     :     ;     <     =     >     ?
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  // @  A     B     C     D     E     F     G     H     I     J     K     L     M     N     O
+  0xFF, 0xFF, 0xFF, 0x0C, 0xFF, 0xFF, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  // P  Q     R     S     T     U     V     W     X     Y     Z     [     \     ]     ^     _
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  // `  a     b     c     d     e     f     g     h     i     j     k     l     m     n     o
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  // p  q     r     s     t     u     v     w     x     y     z     {     |     }     ~
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+const uint8_t maxText = 32;                                 // Maximum text length
+const uint8_t maxCells = 16;                                // Maximum cells in cached layout
 
 // Character limits type
 struct chrLimits_t {
@@ -392,26 +546,39 @@ struct chrLimits_t {
 
 /* DotMatrix */
 
-enum DotMatrixOps {OP_NOOP,   OP_DIGIT0, OP_DIGIT1, OP_DIGIT2, OP_DIGIT3,
-                   OP_DIGIT4, OP_DIGIT5, OP_DIGIT6, OP_DIGIT7, OP_DECODE,
-                   OP_INTENS, OP_SCNLMT, OP_SHTDWN, OP_DSPTST = 0x0F
-                  };
+class SPIArbiter;
 
-class DotMatrix {
+/*
+  The matrices driver.  The frames are rendered in the back framebuffer,
+  fbData, and presented by swapping it with the front one, which keeps
+  what the matrices show; only the changed lines are sent.  The frame is
+  presented when the mode has drawn it, or at the end of the deferral,
+  see fbSync().  The framebuffers and the MAX7219 driver are owned by
+  the derived classes:
+  DotMatrix sizes them for the largest chain and is configured at
+  runtime, DotMatrixFixed sizes them exactly for the chain it is
+  instantiated for.  Several chains, on their own CS pins, can share the
+  bus through an SPIArbiter, which writes their frames in batches.  The
+  lines and the control registers go out through a MatrixBackend, the
+  MAX7219 chain unless other hardware is set, see backend().
+*/
+class DotMatrixBase {
   public:
-    DotMatrix();
-    void init(uint8_t csPin, uint8_t devices, uint8_t lines = MAX_SCANLIMIT);
-
     void decodemode(uint8_t value);
     void intensity(uint8_t value);
-    void scanlimit(uint8_t value);
+    void intensityCap(uint8_t cap);
+    uint8_t level();
+    uint16_t current(uint16_t lit, uint8_t level);
     void shutdown(bool yesno);
     void displaytest(bool yesno);
     void clear();
 
-    void sendSPI(uint8_t matrix, uint8_t reg, uint8_t data);
-    void sendAllSPI(uint8_t reg, uint8_t data);
-    void sendAllSPI(uint8_t reg, uint8_t* data, uint8_t size);
+    void      arbiter(SPIArbiter* arb, uint8_t id);
+    void      backend(MatrixBackend* drv);
+    uint8_t   chainTest(uint32_t speed, uint8_t rounds = 4);
+    uint32_t  tune();
+    uint32_t  speed();
+    void      speed(uint32_t hz);
 
     const static uint8_t LEFT   = 0;
     const static uint8_t CENTER = 1;
@@ -420,22 +587,157 @@ class DotMatrix {
     void    loadFont(uint8_t font);
     void    fbClear();
     void    fbDisplay();
+    void    fbDisplay(uint8_t lo, uint8_t hi);
+    void    fbPresent();
+    void    fbSync(bool defer);
+    void    fbRevert();
+    bool    scrub();
+    const uint8_t* fbFront();
+    uint8_t fbWrite();
+    uint16_t fbLit();
     void    fbPrint(uint8_t pos, uint8_t digit);
     void    fbPrint(uint8_t* poss, uint8_t* chars, uint8_t len);
     void    fbPrint(uint8_t* chars, uint8_t len, uint8_t align = CENTER);
+    void    fbPrint(const char* text, uint8_t align = CENTER);
+    void    fbRegion(uint8_t lo, uint8_t hi, uint8_t rows, uint8_t* chars, uint8_t len, uint8_t align = CENTER);
+    void    fbBar(uint8_t lo, uint8_t hi, uint8_t rows, uint8_t len);
+    uint8_t glyph(char c);
 
-    uint8_t fbData[MAX_MATRICES * MAX_SCANLIMIT] = {0};
+    uint8_t*  fbData;                                       // Back framebuffer, rightmost column first
 
-  private:
-    uint8_t   _scanlimit = MAX_SCANLIMIT;
-    uint8_t   _devices   = MAX_MATRICES;
-    uint8_t   maxFB = MAX_MATRICES * MAX_SCANLIMIT;         // Maximum framebuffer size (compute at init)
-    uint8_t   cmdBuffer[MAX_MATRICES * 2] = {0};
-    int       SPI_CS;                                       // Chip Select pin
-    uint8_t   FONT[fontChars][maxWidth];                    // RAM copy of the current font
-    struct    chrLimits_t chrLimits[fontChars];             // Limits of the characters
+    uint32_t  spiBytes   = 0;                               // Bytes sent to the matrices
+    uint16_t  frameBytes = 0;                               // Bytes sent by the last frame write
+    uint16_t  frameTime  = 0;                               // Duration of the last frame write, us
+    uint32_t  scrubBytes = 0;                               // Bytes sent by the register scrubber
+    uint16_t  frames     = 0;                               // Frames presented
+
+  protected:
+    DotMatrixBase(uint8_t* fb, uint8_t* front, MAX7219Backend* chain, uint8_t devices, uint8_t lines);
+    void init(uint8_t csPin, uint8_t devices, uint8_t lines = MAX_SCANLIMIT);
+    void scanlimit(uint8_t value);
+    virtual uint8_t fbSwap();
+    inline uint8_t  swapLines(uint8_t devices, uint8_t lines) __attribute__((always_inline));
 
+  private:
+    uint8_t*  _front;                                       // Front framebuffer, as on the matrices
+    MAX7219Backend* const _chain;                           // The MAX7219 chain driver
+    const uint8_t   _maxDevices;                            // Devices the buffers can hold
+    const uint8_t   _maxLines;                              // Scan lines the buffers can hold
+    uint8_t   _scanlimit;
+    uint8_t   _devices;
+    uint8_t   maxFB;                                        // Maximum framebuffer size (compute at init)
+    uint8_t   _ctrl[CT_COUNT] = {0};                        // Control registers values, as written
+    uint8_t   _scrub = 0;                                   // Next control register to scrub
+    uint8_t   _scrubLine = 0;                               // Next line to refresh
+    uint32_t  _scrubLast = 0;                               // Last refresh, see SCRUB_WAIT
+    bool      _ctrlDue = false;                             // A control register is due for scrubbing
+    uint8_t   _dirty = 0;                                   // Lines queued for writing, bitmask
+    uint8_t   _scrubs = 0;                                  // Unchanged lines queued for refresh, bitmask
+    SPIArbiter* _arb = nullptr;                             // Bus arbiter, if shared
+    uint8_t   _arbId = 0;                                   // Chain id in arbiter
+    MatrixBackend* _drv;                                    // Display driver, the MAX7219 chain by default
+    bool      _ready = false;                               // Initialized
+    uint8_t   _intensity = 0;                               // Requested brightness
+    uint8_t   _cap = 0x0F;                                  // Maximum brightness
+    uint8_t   _font = 0xFF;                                 // Font in use
+    bool      _defer = false;                               // Present the frame at the sync point
+    bool      _queued = false;                              // A frame is waiting for the sync point
+    uint8_t   _pending = 0;                                 // Lines to send at the sync point
+    static uint8_t _fontRAM;                                // Font in the RAM copy
+    static uint8_t FONT[fontChars][maxWidth];               // RAM copy of a font, shared by the chains
+    static struct chrLimits_t chrLimits[fontChars];         // Limits of its characters
+
+    uint8_t   lytChars[maxCells];                           // Cached layout: characters
+    uint8_t   lytPoss[maxCells];                            // Cached layout: positions
+    uint8_t   lytLen = 0;                                   // Cached layout: cells, 0 if invalid
+    uint8_t   lytAlign = CENTER;                            // Cached layout: alignment
+
+    void        fbFlush(uint8_t lines);
+    void        fontRAM();
     chrLimits_t getLimits(uint8_t ch);
+    chrLimits_t glyphLimits(uint8_t chr);
+    uint8_t     ascColumn(uint8_t chr, uint8_t col);
+    uint8_t     glyphColumn(uint8_t chr, uint8_t col);
+    void        ctrlSend(uint8_t ctrl, uint8_t value);
+    void        ctrlScrub();
+    void        fbQueue();
+    uint8_t     clampLines(uint8_t value);
+};
+
+/*
+  Runtime configured matrices, up to MAX_MATRICES devices and
+  MAX_SCANLIMIT lines
+*/
+class DotMatrix: public DotMatrixBase {
+  public:
+    DotMatrix();
+    using DotMatrixBase::init;
+    using DotMatrixBase::scanlimit;
+
+  private:
+    uint8_t   _fbOne[MAX_MATRICES * MAX_SCANLIMIT] = {0};
+    uint8_t   _fbTwo[MAX_MATRICES * MAX_SCANLIMIT] = {0};
+    MAX7219Backend _max;
+};
+
+/**
+  Compare the back framebuffer to the front one, which holds the
+  previous frame and, if any line changed, swap them.  The new back
+  framebuffer, the previous frame, catches up on the changed lines
+  only, the rendering being incremental.
+
+  @param devices the number of matrices
+  @param lines the scan lines number
+  @return the lines that changed, bitmask
+*/
+inline uint8_t DotMatrixBase::swapLines(uint8_t devices, uint8_t lines) {
+  uint8_t dirty = 0;
+  for (uint8_t m = 0; m < devices; m++)
+    for (uint8_t i = 0; i < lines; i++) {
+      uint8_t j = m * lines + i;
+      if (fbData[j] != _front[j])
+        dirty |= 1 << i;
+    }
+  if (dirty) {
+    uint8_t* fb = fbData;
+    fbData = _front;
+    _front = fb;
+    for (uint8_t i = 0; i < lines; i++)
+      if (dirty & (1 << i))
+        for (uint8_t j = i; j < devices * lines; j += lines)
+          fbData[j] = _front[j];
+  }
+  return dirty;
+}
+
+/*
+  Matrices with the chain size known at compile time: the buffers are
+  sized exactly and the framebuffer compare and the MAX7219 line write
+  loops get the sizes as constants.  The chain size is set by init()
+  only, the loops and the buffers depend on it: the base class keeps
+  the runtime init() and scanlimit() protected, DotMatrix only exposes
+  them.
+*/
+template <uint8_t Devices, uint8_t ScanLimit>
+class DotMatrixFixed: public DotMatrixBase {
+    static_assert(Devices > 0 and Devices <= MAX_MATRICES, "Devices out of range");
+    static_assert(ScanLimit > 0 and ScanLimit <= MAX_SCANLIMIT, "ScanLimit out of range");
+
+  public:
+    DotMatrixFixed(): DotMatrixBase(_fbOne, _fbTwo, &_max, Devices, ScanLimit) {};
+    void init(uint8_t csPin) {
+      DotMatrixBase::init(csPin, Devices, ScanLimit);
+    };
+
+  protected:
+    uint8_t fbSwap() {
+      return swapLines(Devices, ScanLimit);
+    };
+
+  private:
+    uint8_t   _fbOne[Devices * ScanLimit] = {0};
+    uint8_t   _fbTwo[Devices * ScanLimit] = {0};
+    MAX7219Fixed<Devices, ScanLimit> _max;
 };
 
 #endif /* DOTMATRIX_H */
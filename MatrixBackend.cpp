@@ -0,0 +1,534 @@
+/**
+  MatrixBackend.cpp - Display drivers: MAX7219, HT16K33 and APA102
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <Wire.h>
+
+#include "MatrixBackend.h"
+
+/* HT16K33 commands */
+#define HT_OSC_ON   0x21    // System setup, oscillator on
+#define HT_ROW_OUT  0xA0    // ROW/INT pin as row output
+#define HT_DISPLAY  0x80    // Display setup, bit 0 display on
+#define HT_DIMMING  0xE0    // Dimming set, 16 steps
+
+/* APA102 frames */
+#define APA_SPEED   4000000 // SPI clock
+#define APA_LED     0xE0    // LED frame header, with the 5 bits brightness
+
+/* The currents, for the LED current budget */
+#define MAX_ISEG    40      // MAX7219 segment current, mA (RSET 10k)
+#define MAX_IDEV    8       // Quiescent current of a MAX7219, mA
+#define HT_IROW     25      // HT16K33 row driver current, mA
+#define HT_ICOM     8       // HT16K33 commons, multiplexed
+#define HT_IDEV     1       // Quiescent current of a HT16K33, mA
+#define APA_ICH     20      // APA102 channel current at full level, mA
+#define APA_IIDLE   700     // Quiescent current of an APA102 LED, uA
+
+/**
+  Rewrite a control register, the same as setting it, for the drivers
+  that send every value
+
+  @param ctrl the control register index
+  @param value the register value
+  @return the bytes sent
+*/
+uint16_t MatrixBackend::scrub(uint8_t ctrl, uint8_t value) {
+  return control(ctrl, value);
+}
+
+/**
+  Self-test the chain, none by default
+
+  @param speed the clock to test
+  @param rounds the number of patterns to check
+  @param bytes the bytes sent, none
+  @return CHAIN_NONE, no loopback
+*/
+uint8_t MatrixBackend::chainTest(uint32_t /* speed */, uint8_t /* rounds */, uint16_t &bytes) {
+  bytes = 0;
+  return CHAIN_NONE;
+}
+
+/**
+  Get the bus clock, none by default
+
+  @return the clock in use, 0 if it can not be tuned
+*/
+uint32_t MatrixBackend::speed() {
+  return 0;
+}
+
+/**
+  Set the bus clock, ignored by default
+
+  @param hz the clock
+*/
+void MatrixBackend::speed(uint32_t /* hz */) {
+}
+
+/**
+  MAX7219 chain: the Chip Select pin, before begin()
+
+  @param csPin the CipSelect pin
+*/
+void MAX7219Backend::pin(uint8_t csPin) {
+  _cs = csPin;
+}
+
+/**
+  Configure the pins and SPI
+
+  @param devices the number of matrices
+  @param lines the scan lines number
+*/
+void MAX7219Backend::begin(uint8_t devices, uint8_t lines) {
+  _devices = devices;
+  _lines   = lines;
+  pinMode(MOSI, OUTPUT);
+  pinMode(SCK, OUTPUT);
+  pinMode(_cs, OUTPUT);
+  SPI.setBitOrder(MSBFIRST);
+  SPI.setDataMode(SPI_MODE0);
+  SPI.begin();
+  digitalWrite(_cs, HIGH);
+}
+
+/**
+  Write lines of the framebuffer, at runtime size
+
+  @param fb the framebuffer
+  @param mask the lines to write
+  @return the bytes sent
+*/
+uint16_t MAX7219Backend::write(const uint8_t* fb, uint8_t mask) {
+  return sendLines(fb, mask, _devices, _lines);
+}
+
+/**
+  Send a control register to all devices, each time
+
+  @param ctrl the control register index
+  @param value the register value
+  @return the bytes sent
+*/
+uint16_t MAX7219Backend::control(uint8_t ctrl, uint8_t value) {
+  return sendAllSPI(pgm_read_byte(&ctrlRegs[ctrl]), value);
+}
+
+/**
+  Estimate the current: a lit pixel draws the segment current while its
+  line is scanned, for (2 * level + 1) / 32 of that time, and each
+  device its quiescent current
+
+  @param lit the lit pixels
+  @param level the brightness 0..0x0F
+  @return the current in mA
+*/
+uint16_t MAX7219Backend::current(uint16_t lit, uint8_t level) {
+  return (uint32_t)MAX_ISEG * (2 * level + 1) * lit / (32 * _lines) + _devices * MAX_IDEV;
+}
+
+/**
+  The test pattern byte, the even ones are no-op register addresses
+
+  @param j the byte index
+  @param seed the pattern seed
+  @return the pattern byte
+*/
+uint8_t MAX7219Backend::chainPattern(uint8_t j, uint8_t seed) {
+  uint8_t v = (j + 1) * 0x9D + seed * 0x3B;
+  v ^= v >> 3;
+  return (j & 1) ? v : (v & 0xF0);
+}
+
+/**
+  Shift known patterns through the chain and read them back from the
+  DOUT of the last device, looped back to MISO.  Each device delays the
+  stream by two bytes.  Only no-op commands are latched at the end, so
+  the matrices are not changed.  MISO is expected to be pulled up: if
+  all it reads is the idle level, there is no loopback; anything else
+  that does not match the patterns is a fault in the chain.
+
+  @param speed the SPI clock to test
+  @param rounds the number of patterns to check
+  @param bytes the bytes sent
+  @return the devices in the chain, CHAIN_NONE if there is no loopback,
+          CHAIN_FAULT for a broken module or bit errors at this clock
+*/
+uint8_t MAX7219Backend::chainTest(uint32_t speed, uint8_t rounds, uint16_t &bytes) {
+  uint8_t found = 0;
+  bool    idle  = true;
+  bytes = 0;
+  for (uint8_t r = 0; r < rounds; r++) {
+    /* Candidate chain lengths, bit n - 1 for n devices */
+    uint8_t cand = 0xFF;
+    digitalWrite(_cs, LOW);
+    SPI.beginTransaction(SPISettings(speed, MSBFIRST, SPI_MODE0));
+    for (uint8_t j = 0; j < chainBytes; j++) {
+      uint8_t in = SPI.transfer(chainPattern(j, r));
+      if (in != 0xFF)
+        idle = false;
+      for (uint8_t n = 1; n <= MAX_MATRICES; n++)
+        if (j >= 2 * n and in != chainPattern(j - 2 * n, r))
+          cand &= ~(1 << (n - 1));
+    }
+    SPI.endTransaction();
+    bytes += chainBytes;
+    /* Latch the no-ops */
+    digitalWrite(_cs, HIGH);
+    /* The chain length must be the same in all rounds */
+    uint8_t n = 0;
+    while (n < MAX_MATRICES and not (cand & (1 << n)))
+      n++;
+    n = (n < MAX_MATRICES) ? n + 1 : CHAIN_FAULT;
+    if (r == 0)
+      found = n;
+    else if (n != found)
+      found = CHAIN_FAULT;
+  }
+  return idle ? CHAIN_NONE : found;
+}
+
+/**
+  Get the SPI clock
+
+  @return the SPI clock in use
+*/
+uint32_t MAX7219Backend::speed() {
+  return _speed;
+}
+
+/**
+  Set the SPI clock, as tuned or as for another chain on the same bus
+
+  @param hz the SPI clock, limited to SPI_SPEED_MAX
+*/
+void MAX7219Backend::speed(uint32_t hz) {
+  _speed = min(hz, (uint32_t)SPI_SPEED_MAX);
+}
+
+/**
+  Send data to one device, the no-op to the others
+
+  @param matrix the device
+  @param reg the register
+  @param data the register value
+  @return the bytes sent
+*/
+uint16_t MAX7219Backend::sendSPI(uint8_t matrix, uint8_t reg, uint8_t data) {
+  if (matrix >= _devices)
+    return 0;
+  /* Chip select */
+  digitalWrite(_cs, LOW);
+  /* Send the data, the last device first */
+  SPI.beginTransaction(SPISettings(_speed, MSBFIRST, SPI_MODE0));
+  for (uint8_t m = _devices; m > 0; m--) {
+    SPI.transfer(m - 1 == matrix ? reg : (uint8_t)OP_NOOP);
+    SPI.transfer(m - 1 == matrix ? data : 0x00);
+  }
+  SPI.endTransaction();
+  /* Latch data */
+  digitalWrite(_cs, HIGH);
+  return _devices * 2;
+}
+
+/**
+  Send the same data to all devices, at once
+
+  @param reg the register
+  @param data the register value
+  @return the bytes sent
+*/
+uint16_t MAX7219Backend::sendAllSPI(uint8_t reg, uint8_t data) {
+  /* Chip select */
+  digitalWrite(_cs, LOW);
+  /* Send the data */
+  SPI.beginTransaction(SPISettings(_speed, MSBFIRST, SPI_MODE0));
+  for (uint8_t m = _devices; m > 0; m--) {
+    SPI.transfer(reg);
+    SPI.transfer(data);
+  }
+  SPI.endTransaction();
+  /* Latch data */
+  digitalWrite(_cs, HIGH);
+  return _devices * 2;
+}
+
+/**
+  Send the data in array to the devices, at once, the last one first
+
+  @param reg the register
+  @param data the register values, one for each device
+  @param size the number of values
+  @return the bytes sent
+*/
+uint16_t MAX7219Backend::sendAllSPI(uint8_t reg, const uint8_t* data, uint8_t size) {
+  /* Chip select */
+  digitalWrite(_cs, LOW);
+  /* Send the data */
+  SPI.beginTransaction(SPISettings(_speed, MSBFIRST, SPI_MODE0));
+  for (uint8_t i = size; i > 0; i--) {
+    SPI.transfer(reg);
+    SPI.transfer(data[i - 1]);
+  }
+  SPI.endTransaction();
+  /* Latch data */
+  digitalWrite(_cs, HIGH);
+  return size * 2;
+}
+
+/**
+  HT16K33 backpacks
+
+  @param addr the I2C address of the rightmost matrix
+*/
+HT16K33Backend::HT16K33Backend(uint8_t addr): _addr(addr) {
+}
+
+/**
+  Start the oscillators and set the row outputs
+
+  @param devices the number of matrices
+  @param lines the lines in each matrix
+*/
+void HT16K33Backend::begin(uint8_t devices, uint8_t lines) {
+  _devices = devices;
+  _lines   = lines;
+  Wire.begin();
+  command(HT_OSC_ON);
+  command(HT_ROW_OUT);
+  // Send the dimming and the display setup again
+  _dim  = 0xFF;
+  _disp = 0xFF;
+}
+
+/**
+  Send a command to all backpacks
+
+  @param cmd the command byte
+  @return the bytes sent
+*/
+uint16_t HT16K33Backend::command(uint8_t cmd) {
+  for (uint8_t m = 0; m < _devices; m++) {
+    Wire.beginTransmission(_addr + m);
+    Wire.write(cmd);
+    Wire.endTransmission();
+  }
+  return _devices;
+}
+
+/**
+  Write the lines from the first changed one to the last, each in the
+  low byte of a display RAM row, all in one transfer for each backpack
+
+  @param fb the framebuffer
+  @param mask the lines to write
+  @return the bytes sent
+*/
+uint16_t HT16K33Backend::write(const uint8_t* fb, uint8_t mask) {
+  uint16_t bytes = 0;
+  if (not mask)
+    return 0;
+  uint8_t first = 0, last = _lines - 1;
+  while (not (mask & (1 << first)))
+    first++;
+  while (not (mask & (1 << last)))
+    last--;
+  for (uint8_t m = 0; m < _devices; m++) {
+    Wire.beginTransmission(_addr + m);
+    Wire.write(first * 2);
+    for (uint8_t i = first; i <= last; i++) {
+      Wire.write(fb[m * _lines + i]);
+      Wire.write(0x00);
+    }
+    Wire.endTransmission();
+    bytes += 1 + (last - first + 1) * 2;
+  }
+  return bytes;
+}
+
+/**
+  Set the dimming and the display on or off, only when changed; there is
+  no test mode, decoding or scan limit
+
+  @param ctrl the control register index
+  @param value the register value
+  @return the bytes sent
+*/
+uint16_t HT16K33Backend::control(uint8_t ctrl, uint8_t value) {
+  uint8_t cmd;
+  switch (ctrl) {
+    case CT_INTENS:
+      cmd = HT_DIMMING | (value & 0x0F);
+      if (cmd == _dim)
+        return 0;
+      _dim = cmd;
+      return command(cmd);
+    case CT_SHTDWN:
+      cmd = HT_DISPLAY | (value & 0x01);
+      if (cmd == _disp)
+        return 0;
+      _disp = cmd;
+      return command(cmd);
+  }
+  return 0;
+}
+
+/**
+  Estimate the current: a lit pixel draws the row current while its
+  common is driven, one of HT_ICOM, for (level + 1) / 16 of that time,
+  and each backpack its quiescent current
+
+  @param lit the lit pixels
+  @param level the brightness 0..0x0F
+  @return the current in mA
+*/
+uint16_t HT16K33Backend::current(uint16_t lit, uint8_t level) {
+  return (uint32_t)HT_IROW * (level + 1) * lit / (16 * HT_ICOM) + _devices * HT_IDEV;
+}
+
+/**
+  Send the dimming or the display setup again, even if not changed, so
+  a backpack reset by a glitch gets it back; the oscillator and the row
+  outputs, also lost, go along with the display setup
+
+  @param ctrl the control register index
+  @param value the register value
+  @return the bytes sent
+*/
+uint16_t HT16K33Backend::scrub(uint8_t ctrl, uint8_t value) {
+  uint16_t bytes = 0;
+  if (ctrl == CT_INTENS)
+    _dim  = 0xFF;
+  else if (ctrl == CT_SHTDWN) {
+    bytes += command(HT_OSC_ON);
+    bytes += command(HT_ROW_OUT);
+    _disp = 0xFF;
+  }
+  return bytes + control(ctrl, value);
+}
+
+/**
+  APA102 LEDs
+
+  @param enPin the bus buffer enable pin, active low
+  @param red the red level of the lit pixels
+  @param green the green level of the lit pixels
+  @param blue the blue level of the lit pixels
+*/
+APA102Backend::APA102Backend(uint8_t enPin, uint8_t red, uint8_t green, uint8_t blue):
+  _en(enPin), _rgb{blue, green, red} {
+}
+
+/**
+  Configure the enable pin, the LEDs are written with the first frame
+
+  @param devices the number of 8x8 panels
+  @param lines the columns in each panel
+*/
+void APA102Backend::begin(uint8_t devices, uint8_t lines) {
+  _devices = devices;
+  _lines   = lines;
+  pinMode(_en, OUTPUT);
+  digitalWrite(_en, HIGH);
+  redraw = true;
+}
+
+/**
+  Stream the pixels up to the last changed column, in all panels
+
+  @param fb the framebuffer
+  @param mask the lines to write
+  @return the bytes sent
+*/
+uint16_t APA102Backend::write(const uint8_t* fb, uint8_t mask) {
+  redraw = false;
+  if (not mask)
+    return 0;
+  uint8_t last = _lines - 1;
+  while (not (mask & (1 << last)))
+    last--;
+  uint8_t cols = (_devices - 1) * _lines + last + 1;
+  digitalWrite(_en, LOW);
+  SPI.beginTransaction(SPISettings(APA_SPEED, MSBFIRST, SPI_MODE0));
+  /* Start frame */
+  for (uint8_t i = 0; i < 4; i++)
+    SPI.transfer(0x00);
+  for (uint8_t c = 0; c < cols; c++) {
+    /* The even columns downwards, the odd ones upwards */
+    for (uint8_t r = 0; r < 8; r++) {
+      uint8_t row = (c & 1) ? r : 7 - r;
+      bool lit = _on and (fb[c] & (1 << row));
+      SPI.transfer(APA_LED | _bright);
+      for (uint8_t k = 0; k < 3; k++)
+        SPI.transfer(lit ? _rgb[k] : 0x00);
+    }
+  }
+  /* End frame, half a clock for each LED, to push the data through */
+  uint8_t end = (cols * 8 + 15) / 16;
+  for (uint8_t i = 0; i < end; i++)
+    SPI.transfer(0x00);
+  SPI.endTransaction();
+  digitalWrite(_en, HIGH);
+  return 4 + cols * 8 * 4 + end;
+}
+
+/**
+  Estimate the current: a lit pixel draws the current of its channels,
+  as set by the colour levels, scaled by the global brightness, and
+  each LED, lit or not, its quiescent current; the LEDs are not
+  multiplexed
+
+  @param lit the lit pixels
+  @param level the brightness 0..0x0F
+  @return the current in mA
+*/
+uint16_t APA102Backend::current(uint16_t lit, uint8_t level) {
+  uint16_t rgb = (uint16_t)_rgb[0] + _rgb[1] + _rgb[2];
+  uint16_t leds = (uint16_t)_devices * _lines * 8;
+  return (uint32_t)APA_ICH * rgb * (2 * level + 1) / 255 * lit / 31 + (uint32_t)leds * APA_IIDLE / 1000;
+}
+
+/**
+  Keep the brightness and the display on or off; the brightness is in
+  each pixel, so any change needs all pixels written again
+
+  @param ctrl the control register index
+  @param value the register value
+  @return the bytes sent, none
+*/
+uint16_t APA102Backend::control(uint8_t ctrl, uint8_t value) {
+  if (ctrl == CT_INTENS) {
+    uint8_t bright = ((value & 0x0F) << 1) | 0x01;
+    if (bright != _bright) {
+      _bright = bright;
+      redraw = true;
+    }
+  }
+  else if (ctrl == CT_SHTDWN) {
+    bool on = value & 0x01;
+    if (on != _on) {
+      _on = on;
+      redraw = true;
+    }
+  }
+  return 0;
+}
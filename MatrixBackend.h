@@ -0,0 +1,192 @@
+/**
+  MatrixBackend.h - Display drivers: MAX7219, HT16K33 and APA102
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MATRIXBACKEND_H
+#define MATRIXBACKEND_H
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#define MAX_MATRICES  8
+#define MAX_SCANLIMIT 8
+#define SPI_SPEED     1000000
+#define SPI_SPEED_MAX 8000000
+#define CHAIN_NONE    0x00      // Chain self-test: no loopback, MISO idle
+#define CHAIN_FAULT   0xFF      // Chain self-test: a broken module or bit errors
+
+enum DotMatrixOps {OP_NOOP,   OP_DIGIT0, OP_DIGIT1, OP_DIGIT2, OP_DIGIT3,
+                   OP_DIGIT4, OP_DIGIT5, OP_DIGIT6, OP_DIGIT7, OP_DECODE,
+                   OP_INTENS, OP_SCNLMT, OP_SHTDWN, OP_DSPTST = 0x0F
+                  };
+
+/* The control registers kept for scrubbing, in this order */
+enum DotMatrixCtrls {CT_DECODE, CT_INTENS, CT_SCNLMT, CT_SHTDWN, CT_DSPTST, CT_COUNT};
+const uint8_t ctrlRegs[CT_COUNT] PROGMEM = {OP_DECODE, OP_INTENS, OP_SCNLMT, OP_SHTDWN, OP_DSPTST};
+
+/*
+  A display driver.  DotMatrixBase keeps rendering in its framebuffers,
+  one byte per column, bit 7 the top row, the rightmost column first,
+  and hands the driver the front framebuffer with the lines to write.
+  The control registers are those of the MAX7219, in DotMatrixCtrls
+  order; a driver maps them on its hardware or ignores them.  A driver
+  that sends them only on change sends them anyway when scrubbed.  Only
+  a driver on a chain with a loopback can self-test it, and only a
+  driver on SPI has a clock to tune.  Each driver estimates the current
+  its hardware draws, for the LED current budget.
+*/
+class MatrixBackend {
+  public:
+    virtual void      begin(uint8_t devices, uint8_t lines) = 0;
+    virtual uint16_t  write(const uint8_t* fb, uint8_t mask) = 0;
+    virtual uint16_t  control(uint8_t ctrl, uint8_t value) = 0;
+    virtual uint16_t  current(uint16_t lit, uint8_t level) = 0;
+    virtual uint16_t  scrub(uint8_t ctrl, uint8_t value);
+    virtual uint8_t   chainTest(uint32_t speed, uint8_t rounds, uint16_t &bytes);
+    virtual uint32_t  speed();
+    virtual void      speed(uint32_t hz);
+
+    bool      redraw = false;     // All lines must be written again
+};
+
+/*
+  MAX7219/MAX7221 chains on SPI, the default driver.  Each line is sent
+  to all devices at once, the last device first, and latched by the
+  chip select.  With the DOUT of the last device looped back to MISO,
+  the chain can be self-tested and clocked as fast as it passes.
+*/
+class MAX7219Backend: public MatrixBackend {
+  public:
+    void      pin(uint8_t csPin);
+    void      begin(uint8_t devices, uint8_t lines);
+    uint16_t  write(const uint8_t* fb, uint8_t mask);
+    uint16_t  control(uint8_t ctrl, uint8_t value);
+    uint16_t  current(uint16_t lit, uint8_t level);
+    uint8_t   chainTest(uint32_t speed, uint8_t rounds, uint16_t &bytes);
+    uint32_t  speed();
+    void      speed(uint32_t hz);
+
+    uint16_t  sendSPI(uint8_t matrix, uint8_t reg, uint8_t data);
+    uint16_t  sendAllSPI(uint8_t reg, uint8_t data);
+    uint16_t  sendAllSPI(uint8_t reg, const uint8_t* data, uint8_t size);
+
+  protected:
+    inline uint16_t sendLines(const uint8_t* fb, uint8_t mask, uint8_t devices, uint8_t lines) __attribute__((always_inline));
+
+  private:
+    uint8_t   chainPattern(uint8_t j, uint8_t seed);
+    const static uint8_t chainBytes = MAX_MATRICES * 2 + 16;  // Self-test pattern length
+    uint8_t   _cs = 0;                                      // Chip Select pin
+    uint8_t   _devices = 1;
+    uint8_t   _lines = MAX_SCANLIMIT;
+    uint32_t  _speed = SPI_SPEED;                           // SPI clock, see DotMatrixBase::tune()
+};
+
+/**
+  Write lines of the framebuffer, in a single SPI transaction, all
+  matrices at once for each line
+
+  @param fb the framebuffer
+  @param mask the lines to write
+  @param devices the number of matrices
+  @param lines the scan lines number
+  @return the bytes sent
+*/
+inline uint16_t MAX7219Backend::sendLines(const uint8_t* fb, uint8_t mask, uint8_t devices, uint8_t lines) {
+  uint16_t bytes = 0;
+  SPI.beginTransaction(SPISettings(_speed, MSBFIRST, SPI_MODE0));
+  for (uint8_t i = 0; i < lines; i++) {
+    if (not (mask & (1 << i)))
+      continue;
+    /* Chip select */
+    digitalWrite(_cs, LOW);
+    /* The last matrix first */
+    for (uint8_t m = devices; m > 0; m--) {
+      SPI.transfer(i + 1);
+      SPI.transfer(fb[(m - 1) * lines + i]);
+    }
+    /* Latch data */
+    digitalWrite(_cs, HIGH);
+    bytes += devices * 2;
+  }
+  SPI.endTransaction();
+  return bytes;
+}
+
+/*
+  A MAX7219 chain with the size known at compile time, the line write
+  loops get the sizes as constants
+*/
+template <uint8_t Devices, uint8_t Lines>
+class MAX7219Fixed: public MAX7219Backend {
+  public:
+    uint16_t write(const uint8_t* fb, uint8_t mask) {
+      return sendLines(fb, mask, Devices, Lines);
+    };
+};
+
+/*
+  HT16K33 I2C backpacks, one per matrix, at consecutive addresses, each
+  row output driving a matrix column.  The changed lines are written in
+  a single transfer for each backpack, from the first one to the last,
+  using the display RAM address auto-increment.
+*/
+class HT16K33Backend: public MatrixBackend {
+  public:
+    HT16K33Backend(uint8_t addr = 0x70);
+    void      begin(uint8_t devices, uint8_t lines);
+    uint16_t  write(const uint8_t* fb, uint8_t mask);
+    uint16_t  control(uint8_t ctrl, uint8_t value);
+    uint16_t  current(uint16_t lit, uint8_t level);
+    uint16_t  scrub(uint8_t ctrl, uint8_t value);
+
+  private:
+    uint16_t  command(uint8_t cmd);
+    uint8_t   _addr;
+    uint8_t   _devices;
+    uint8_t   _lines;
+    uint8_t   _dim = 0xFF;        // Dimming, as sent
+    uint8_t   _disp = 0xFF;       // Display setup, as sent
+};
+
+/*
+  APA102 (or SK9822) addressable LEDs on SPI, a column after another,
+  zig-zag, starting with the rightmost column at the top.  Each pixel is
+  shifted out from the packed framebuffer, on or off, with no buffer.
+  The LEDs keep their colors, so the stream stops after the last changed
+  column.  A bus buffer gated by the enable pin keeps the LEDs off the
+  bus while other devices are written.
+*/
+class APA102Backend: public MatrixBackend {
+  public:
+    APA102Backend(uint8_t enPin, uint8_t red, uint8_t green, uint8_t blue);
+    void      begin(uint8_t devices, uint8_t lines);
+    uint16_t  write(const uint8_t* fb, uint8_t mask);
+    uint16_t  control(uint8_t ctrl, uint8_t value);
+    uint16_t  current(uint16_t lit, uint8_t level);
+
+  private:
+    uint8_t   _en;
+    uint8_t   _rgb[3];
+    uint8_t   _devices;
+    uint8_t   _lines;
+    uint8_t   _bright = 0x01;     // Global brightness 0..31
+    bool      _on = false;        // Shown or all dark
+};
+
+#endif /* MATRIXBACKEND_H */
@@ -22,11 +22,18 @@
 // Watchdog, sleep
 #include <avr/wdt.h>
 #include <avr/sleep.h>
+#include <util/atomic.h>
 #include <IRLremote.h>
 
 #include "Button.h"
 #include "DotMatrix.h"
+#include "SPIArbiter.h"
+#include "MatrixBackend.h"
 #include "DS3231.h"
+#include "AT24C32.h"
+
+// Loop profiling, comment out to compile it out
+#define PROFILING
 
 // Software name and vesion
 const char DEVNAME[]  PROGMEM = "MatrixChronograph";
@@ -48,7 +55,7 @@ const int LIGHT_PIN = A0;
 
 // Buttons
 Button btn1(BTN1_PIN);
-Button btn2(BTN1_PIN);
+Button btn2(BTN2_PIN);
 Button intsq(INTSQ_PIN);
 
 // Choose the IR protocol of your remote
@@ -57,26 +64,229 @@ CNec iRed;
 
 // The RTC
 DS3231 rtc;
-uint32_t  mtxDisplayWait  = 1000UL;                             // Wait interval
-uint32_t  mtxDisplayUntil = 0UL;                                // Display check until
+uint32_t  rtcCheckLast    = 0UL;                                // Last health check, when the RTC is down
+uint32_t  rtcCheckWait    = 10000UL;                            // Health check interval
+// The EEPROM on the RTC module
+AT24C32 eep;
+uint32_t  mtxDisplayLast  = 0UL;                                // Last display check
 bool      mtxDisplayNow   = true;                               // Force display
 
 // The matrix object
 #define MATRICES  4
 #define SCANLIMIT 8
-DotMatrix mtx = DotMatrix();
+DotMatrixFixed<MATRICES, SCANLIMIT> mtx;
+uint8_t   mtxChain        = CHAIN_NONE;                         // Devices found by the chain self-test, or CHAIN_FAULT
+
+// Other display hardware instead of the MAX7219 chain, uncomment one:
+// HT16K33 backpacks from this I2C address up, or APA102 panels on SPI,
+// behind a bus buffer enabled by CS_PIN.
+//#define MTX_HT16K33 0x70
+//#define MTX_APA102
+#if defined(MTX_HT16K33)
+HT16K33Backend mtxDrv(MTX_HT16K33);
+#elif defined(MTX_APA102)
+APA102Backend mtxDrv(CS_PIN, 0xFF, 0x40, 0x00);
+#endif
+
+// A second matrices chain, on its own CS pin, showing the temperature;
+// uncomment to use it.  The chains share the RAM copy of the font, the
+// second one takes 161 bytes of RAM.
+//#define MTX2_CS_PIN 9
+#ifdef MTX2_CS_PIN
+DotMatrixFixed<MATRICES, SCANLIMIT> mtx2;
+uint32_t  mtx2DisplayLast = 0UL;                                // Last display of the second chain
+const uint32_t mtx2DisplayWait = 10000UL;                       // Display interval of the second chain
+#endif
+
+// The chains share the SPI bus, their frames are written in batches
+SPIArbiter arb;
 
 // Automatic brightness steps
-uint32_t brgtCheckUntil = 0UL;
+uint32_t brgtCheckLast  = 0UL;
 uint32_t brgtCheckWait  = 100UL;
 
+// LED current budget, the current as the display driver estimates it
+#define   LED_VLOW  4600                                        // Supply sag to react to, mV
+#define   LED_VOK   4750                                        // Supply recovered, mV
+uint16_t  ledMa         = 0;                                    // Estimated current, last frame, mA
+uint16_t  ledPeak       = 0;                                    // Peak estimated current, mA
+uint32_t  ledAvg        = 0UL;                                  // Average estimated current, mA * 16
+int8_t    ledTrim       = 0;                                    // Cap correction from the supply, steps
+uint16_t  ledVcc        = 0;                                    // Last supply voltage, mV
+uint32_t  ledCheckLast  = 0UL;
+const uint32_t ledCheckWait = 1000UL;
+const uint32_t ledSettle    = 10UL;                             // Bandgap settling, between two passes
+
+// ADC multiplexer: Vcc reference, measure the internal 1.1V bandgap
+#define   ADC_VCC   (_BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1))
+
+// Night mode: in the night window, the display is either shut down, and
+// woken up for a while by a button or a remote key, or dimmed and
+// showing only the time; the display is polled less often
+enum      ngtStates {NGT_DAY, NGT_DIM, NGT_OFF, NGT_WAKE};
+#define   NGT_POLL  5000                                        // Display poll at night, ms
+#define   NGT_DIM_CAP 0                                         // Brightness cap when dimmed
+uint8_t   ngtState      = NGT_DAY;                              // Night state
+uint32_t  ngtCheckLast  = 0UL;
+const uint32_t ngtCheckWait = 60000UL;                          // Check the night window every minute
+uint32_t  ngtWakeLast   = 0UL;                                  // Time of the last wake up
+const uint32_t ngtWakeWait  = 15000UL;                          // Keep the display on after a wake up
+uint32_t  ngtSecLast    = 0UL;                                  // Energy accounting, once a second
+uint16_t  ngtDayMa      = 0;                                    // Average day draw, mA
+uint32_t  ngtDayCharge  = 0UL;                                  // Drawn this day, mA * s
+uint32_t  ngtDaySecs    = 0UL;                                  // Seconds accounted this day
+uint32_t  ngtSaved      = 0UL;                                  // Saved this night, mA * s
+uint32_t  ngtSavedLast  = 0UL;                                  // Saved last night, mA * s
+
 // Display modes
 enum      mtxModes {MODE_HHMM, MODE_SS, MODE_DDMM, MODE_YY,
-                    MODE_TEMP, MODE_VCC, MODE_MCU, MODE_ALL
+                    MODE_TEMP, MODE_VCC, MODE_MCU, MODE_CHRN,
+                    MODE_CNTD, MODE_SPLT, MODE_ALL
                    };
 uint8_t   mtxMode       = MODE_HHMM;                            // Initial mode
-uint32_t  mtxModeUntil  = 0UL;                                  // Expiration time, 0 is never
+uint32_t  mtxModeLast   = 0UL;                                  // Time the mode was set
+bool      mtxModeExp    = false;                                // The mode expires
 uint32_t  mtxModeWait   = 10000UL;                              // Expiration interval
+uint32_t  mtxMemo       = 0UL;                                  // Last value shown by the current mode
+// How often the data source of each mode changes, so it is polled at this rate, ms
+const uint16_t mtxModePoll[] PROGMEM = {
+  1000,   // HHMM, checks the RTC alarm flag
+  250,    // SS, catch the second change early
+  1000,   // DDMM, checks the RTC alarm flag
+  1000,   // YY, checks the RTC alarm flag
+  64000,  // TEMP, the RTC converts every 64 seconds
+  2000,   // VCC, ADC
+  2000,   // MCU, ADC
+  20,     // CHRN, 50 frames per second
+  20,     // CNTD, 50 frames per second
+  250,    // SPLT, the regions keep their own poll periods
+};
+
+// Split mode: the display is composed of regions, each showing a data
+// source with its own font and poll period, rendered only on changes
+enum      rgnSources {SRC_NONE, SRC_TIME, SRC_SECS, SRC_SBAR, SRC_TEMP};
+struct rgnDef_t {
+  uint8_t   lo;         // Rightmost column
+  uint8_t   hi;         // Leftmost column
+  uint8_t   rows;       // Rows, bitmask, the MSB is the top row
+  uint8_t   src;        // Data source
+  uint8_t   font;       // Font, 0xFF for the configured one
+  uint16_t  poll;       // Source poll period, ms
+};
+#define   RGN_MAX     2                                         // Regions in a layout
+#define   RGN_LAYOUTS 3                                         // Layouts
+const rgnDef_t rgnLayouts[RGN_LAYOUTS][RGN_MAX] PROGMEM = {
+  // HH:MM, a seconds bar on the bottom row
+  {{0,  31, 0xFE, SRC_TIME, 0xFF,     1000}, {0, 31, 0x01, SRC_SBAR, 0xFF,     250}},
+  // HH:MM and the temperature
+  {{15, 31, 0xFF, SRC_TIME, fontTiny, 1000}, {0, 13, 0xFF, SRC_TEMP, fontTiny, 64000}},
+  // HH:MM :SS
+  {{15, 31, 0xFF, SRC_TIME, fontTiny, 1000}, {4, 13, 0xFF, SRC_SECS, fontTiny, 250}},
+};
+uint32_t  rgnMemo[RGN_MAX];                                     // Last value shown by each region
+uint32_t  rgnLast[RGN_MAX];                                     // Last poll of each region
+
+// Framebuffer streaming over serial, both ways: each frame is sent as the
+// XOR delta against the previous one, run-length encoded, in a packet:
+// sync, type, payload length, payload, CRC8 of type, length and payload.
+// The payload is a list of runs: a control byte 0x80 + n - 1 skips n
+// unchanged bytes, n - 1 (n <= 128) is followed by n XOR bytes.  A key
+// frame is the delta against a clear frame.  While ingesting, "+++"
+// between two silences of the guard time returns to the console.
+enum      mirModes {MIR_OFF, MIR_MIRROR, MIR_INGEST};
+enum      mirTypes {MIR_KEY, MIR_DELTA, MIR_END};
+enum      mirStates {MIR_SYNC, MIR_TYPE, MIR_LEN, MIR_CTL, MIR_LIT, MIR_CRC};
+#define   MIR_SYNC_BYTE 0xFE                                    // Never in the console text
+#define   MIR_MAX   (3 + MATRICES * SCANLIMIT * 3 / 2 + 1)     // Largest packet
+#define   MIR_KEYS  32                                          // A key frame every so many frames
+uint8_t   mirMode       = MIR_OFF;                              // Streaming mode
+uint8_t   mirPrev[MATRICES * SCANLIMIT];                        // The last frame mirrored
+uint16_t  mirFrames     = 0;                                    // Display frame last mirrored
+uint8_t   mirKeyLeft    = 0;                                    // Frames to the next key frame
+uint16_t  mirCount      = 0;                                    // Frames streamed
+uint16_t  mirCountLast  = 0;                                    // Frames streamed, one second ago
+uint16_t  mirFps        = 0;                                    // Frames streamed in the last second
+uint16_t  mirErrors     = 0;                                    // Bad packets ingested
+uint32_t  mirSecLast    = 0UL;                                  // Frame rate, once a second
+uint32_t  mirRcvLast    = 0UL;                                  // Time of the last byte ingested
+const uint32_t mirRcvWait = 10000UL;                            // Leave the ingest mode when idle
+const uint32_t mirGuard   = 1000UL;                             // Escape guard time, around "+++"
+uint8_t   mirPlus       = 0;                                    // Escape characters received
+uint8_t   mirState      = MIR_SYNC;                             // Ingest decoder state
+uint8_t   mirType, mirLeft, mirRun, mirPos, mirCrc;             // Ingest decoder packet
+bool      mirBad        = false;                                // Ingest decoder packet is invalid
+
+// Chronograph and countdown, timed by Timer1 at 100Hz, disciplined by the RTC 1Hz output
+#define   CHR_HZ      100                                       // Timer ticks per second
+#define   CHR_COUNTS  (F_CPU / 8)                               // Timer1 counts per second, prescaler 8
+#define   CHR_LAPS    4                                         // Laps kept in memory
+enum      chrTimers {CHR_CHRN, CHR_CNTD};
+volatile uint32_t chrTicks[2]   = {0UL, 0UL};                   // Elapsed hundredths, for each timer
+volatile uint8_t  chrRun        = 0;                            // Running timers, bitmask
+volatile uint32_t chrCounts     = 0UL;                          // Timer1 counts, at the last compare match
+volatile uint32_t chrPeriod     = CHR_COUNTS;                   // Timer1 counts in one RTC second
+volatile uint16_t chrBase       = CHR_COUNTS / CHR_HZ;          // Timer1 counts in one tick
+volatile uint8_t  chrRem        = 0;                            // Ticks one count longer, each second
+volatile uint8_t  chrPhase      = 0;                            // Tick in the current second
+volatile uint32_t chrEdge       = 0UL;                          // Timer1 counts at the last RTC edge
+volatile bool     chrEdgeOk     = false;                        // The last RTC edge is valid
+volatile uint16_t chrSyncs      = 0;                            // RTC seconds used to discipline the timer
+uint32_t  chrPreset     = 30000UL;                              // Countdown preset, hundredths
+uint32_t  chrLaps[CHR_LAPS];                                    // Lap times, hundredths, ring buffer
+uint8_t   chrLapCount   = 0;                                    // Laps taken
+uint16_t  chrDropped    = 0;                                    // Frames not rendered in time
+
+// Loop stages, profiled and supervised by the watchdog
+enum      loopStages {STG_IR, STG_AT, STG_BRGT, STG_MODE, STG_DISP, STG_LOG, STG_LOOP, STG_SETUP};
+const char stgNames[] PROGMEM = "IR  AT  BRGTMODEDISPLOG LOOPSETP";  // Stage names, 4 chars each
+#ifdef PROFILING
+#include "Profiler.h"
+Profiler  prof;
+#define   PROF_START(stage) prof.start(stage)
+#define   PROF_STOP(stage)  prof.stop(stage)
+#define   PROF_LOOP()       prof.loop()
+#else
+#define   PROF_START(stage)
+#define   PROF_STOP(stage)
+#define   PROF_LOOP()
+#endif
+
+// Watchdog supervision: the active stage and the last stall survive the reset
+#define   WDT_MAGIC 0xA5
+struct wdtInfo_t {
+  uint8_t   magic;      // Valid record marker
+  uint8_t   check;      // Complement of the magic
+  uint8_t   stage;      // Stage active when the watchdog fired
+  uint8_t   count;      // Watchdog stalls since power on
+};
+volatile uint8_t  wdtStage __attribute__ ((section (".noinit")));
+wdtInfo_t         wdtInfo  __attribute__ ((section (".noinit")));
+// The enclosing stages, restored when leaving a nested stage
+#define   STG_DEPTH 4
+uint8_t   stgStack[STG_DEPTH];                                  // Enclosing stages
+uint8_t   stgDepth      = 0;                                    // Nesting depth, may exceed the stack
+// Enter and leave a loop stage
+#define   STAGE_START(stage) do { stgPush(); wdtStage = stage; PROF_START(stage); } while (0)
+#define   STAGE_STOP(stage)  do { PROF_STOP(stage); stgPop(stage); } while (0)
+
+// Memory usage: the free RAM is painted at boot, the stack wipes the paint
+#define   MEM_PAINT 0xC5
+extern char __data_start, __data_end, __bss_start, __bss_end;
+extern char __noinit_start, __noinit_end, __heap_start;
+extern char *__brkval;
+void memPaint() __attribute__ ((naked, used, section (".init3")));
+// The watchdog, still on after a watchdog reset, is turned off at boot
+void wdtOff() __attribute__ ((naked, used, section (".init3")));
+
+// The configuration layout version, bumped with any change of the
+// layout; cfgMigrate() reads the previous ones.  Version 0 had 8 bytes,
+// 7 of them used, and the CRC8 right after them; version 1 had 16
+// bytes, 9 of them used, up to the snooze interval, and the version in
+// the next one
+#define CFG_VERSION 2
+#define CFG_V0_SIZE 8
+#define CFG_V0_USED 7
+#define CFG_V1_USED 9
 
 // Define the configuration type
 struct cfgEE_t {
@@ -97,8 +307,16 @@ struct cfgEE_t {
       uint8_t scqt: 1;  // Serial console quiet mode (negate)
       uint8_t bfst: 5;  // First hour to beep
       uint8_t blst: 5;  // Last hour to beep
+      uint8_t lgiv: 6;  // Data logger interval, minutes
+      uint8_t snoz: 5;  // Alarm snooze interval, minutes
+      uint8_t ibdg: 8;  // LED current budget, 10mA, 0 for none
+      uint8_t nfst: 5;  // First night hour
+      uint8_t nlst: 5;  // Last night hour
+      uint8_t nmod: 2;  // Night mode: none, display off, dimmed
+      uint8_t splt: 2;  // Split mode layout
+      uint8_t vers: 8;  // Layout version
     };
-    uint8_t data[8];    // We use 8 bytes in the structure
+    uint8_t data[16];   // We use 16 bytes in the structure
   };
   uint8_t crc8;         // CRC8
 };
@@ -107,27 +325,109 @@ const cfgEE_t cfgDefault = {{{
       .font = 0x01, .brgt = 0x01, .mnbr = 0x00, .mxbr = 0x0F,
       .aubr = 0x01, .tmpu = 0x01, .spkm = 0x01, .spkl = 0x01,
       .echo = 0x01, .dst  = 0x00, .kvcc = 0x00, .ktmp = 0x00,
-      .scqt = 0x00, .bfst = 0x08, .blst = 0x14,
+      .scqt = 0x00, .bfst = 0x08, .blst = 0x14, .lgiv = 0x0F,
+      .snoz = 0x05, .ibdg = 50,   .nfst = 0x17, .nlst = 0x06,
+      .nmod = 0x00, .splt = 0x01, .vers = CFG_VERSION,
     }
-  }
+  }, 0
 };
 // The global configuration structure
 struct cfgEE_t  cfgData;
 // EEPROM address to store the configuration to
 uint16_t        cfgEEAddress = 0x0180;
 
+// Alarm time, on the days of week in the mask
+struct almTime_t {
+  uint8_t   hh;         // Hour 0..23
+  uint8_t   mm;         // Minute 0..59
+  uint8_t   days;       // Days of week, bit 0 is Monday, none is disabled
+};
+// The stored alarms
+#define   ALM_COUNT 4
+struct almEE_t {
+  almTime_t alm[ALM_COUNT];
+  uint8_t   crc8;       // CRC8
+};
+struct almEE_t  almData;
+// EEPROM address to store the alarms to
+uint16_t        almEEAddress = 0x01A0;
+almTime_t       almSnoozed   = {0, 0, 0};                       // The snoozed alarm, once
+almTime_t       almNext      = {0, 0, 0};                       // The alarm programmed in the RTC
+bool            almRinging   = false;                           // An alarm is ringing
+#define         ALM_RINGS    176                                // Repeat the alarm chime, 1.36s each, about 4 minutes
+// RTC interrupts
+volatile bool   rtcInt       = false;                           // The INT pin went low
+uint8_t         rtcAlarms    = 0;                               // Alarm flags read and not used yet
+uint32_t        rtcPollLast  = 0UL;                             // Last poll, while the pin is the square wave
+
+// RTC drift discipline: the offsets to the host reference time, kept in EEPROM
+#define   DRF_POINTS  8                                         // Sync points kept
+#define   DRF_SPAN    21600UL                                   // Minimal span to correct the drift, seconds
+#define   DRF_RES     10L                                       // Minimal offset the drift made over the span, ms
+#define   DRF_MAX_OFS 60000L                                    // Largest offset kept, ms, set the time past it
+#define   DRF_MAX_AGE 31622400UL                                // Longest history, seconds, the sums keep in 64 bits
+struct drfPoint_t {
+  uint32_t  t;          // Host time, seconds since the base
+  int32_t   o;          // RTC offset, ms, positive if ahead
+};
+struct drfEE_t {
+  uint32_t    base;     // Host time of the first point, seconds since epoch
+  drfPoint_t  pts[DRF_POINTS];
+  uint8_t     n;        // Points kept
+  uint8_t     corr;     // Aging corrections applied
+  int8_t      step;     // The last correction, aging steps
+  uint8_t     crc8;     // CRC8
+};
+struct drfEE_t  drfData;
+// EEPROM address to store the drift history to
+uint16_t        drfEEAddress = 0x01B0;
+int16_t         drfPpm       = 0;                               // Estimated drift, 1/100 ppm, positive is fast
+int16_t         drfSe        = 0;                               // Standard error of the drift, 1/100 ppm
+
+// Host time synchronization
+uint32_t        tsEpoch      = 0UL;                             // Host time at millis() 0, seconds
+uint16_t        tsEpochMs    = 0;                               // Host time at millis() 0, milliseconds
+
+// Chime sequencer, Timer2 at 100Hz: each step is the buzzer state in the
+// most significant bit and the duration in ticks, a zero step ends
+const uint8_t chmAlarm[] PROGMEM = {0x88, 0x08, 0x88, 0x08, 0x88, 0x08, 0x88, 0x50, 0x00};
+const uint8_t chmChime[] PROGMEM = {0x94, 0x0A, 0x94, 0x28, 0x00};
+const uint8_t*          chmFirst = NULL;                        // The pattern
+const uint8_t* volatile chmNote  = NULL;                        // Next step in the pattern
+volatile uint8_t        chmLoops = 0;                           // Pattern repetitions left
+volatile uint8_t        chmLeft  = 0;                           // Ticks left in the current step
+
+// Data logger record, stored in the AT24C32 ring buffer
+struct logRec_t {
+  uint8_t   seq;        // Sequence number, modulo 255 (0xFF is empty)
+  uint16_t  dt;         // Seconds since the previous record, 0 after reset
+  int8_t    rtcT;       // RTC temperature, Celsius
+  uint16_t  vcc;        // Supply voltage, mV
+  int8_t    mcuT;       // MCU temperature, Celsius
+  uint8_t   ldr;        // Light level, 8 bits
+} __attribute__ ((packed));                                     // 8 bytes, a page holds whole records
+const uint16_t  logRecs   = EEP_SIZE / sizeof(logRec_t);        // Records in the ring buffer
+uint16_t        logHead   = 0;                                  // Next record to write
+uint16_t        logCount  = 0;                                  // Valid records
+uint8_t         logSeq    = 0;                                  // Next sequence number
+uint32_t        logLast   = 0UL;                                // Time of the last record
+
 // Several Hayes related globals
 const int8_t  HAYES_NUM_ERROR = -128;
 // String buffer
 char buf[65] = "";
 // Line buffer length
-int8_t len = -1;
+int8_t len = 0;
 // Buffer index
 uint8_t idx = 0;
 // Numeric value
 int8_t value = 0;
 // Command result
 bool result = false;
+// Time the last line was received, millis()
+uint32_t hayesRcv = 0UL;
+// The line did not fit in the buffer, discard it up to the EOL
+bool hayesOvf = false;
 
 
 /**
@@ -189,8 +489,12 @@ int16_t getInteger(char* buf, int8_t idx, uint8_t len = 32) {
     while ((isdigit(buf[ldx]))
            and (ldx - sdx < len)
            and (buf[ldx] != 0)) {
-      // Build the result
-      result = (result * 10) + (buf[ldx] - '0');
+      // Build the result, saturate instead of overflowing
+      uint8_t dgt = buf[ldx] - '0';
+      if (result > (0x7FFF - dgt) / 10)
+        result = 0x7FFF;
+      else
+        result = (result * 10) + dgt;
       // Move forward
       ldx++;
     }
@@ -224,6 +528,30 @@ int16_t getValidInteger(char* buf, int8_t idx, int16_t low, int16_t hgh, int16_t
   return res;
 }
 
+/**
+  Parse the buffer and return an unsigned long integer, skipping the
+  leading non-digit characters
+
+  @param buf the char buffer to parse
+  @param idx index to start with, moved after the number
+  @return the integer found or zero
+*/
+uint32_t getLong(char* buf, uint8_t &idx) {
+  uint32_t result = 0;
+  // Preamble
+  while (buf[idx] != 0 and not isdigit(buf[idx]))
+    idx++;
+  // Parse the digits, saturate instead of overflowing
+  while (isdigit(buf[idx])) {
+    uint8_t dgt = buf[idx++] - '0';
+    if (result > (0xFFFFFFFFUL - dgt) / 10)
+      result = 0xFFFFFFFFUL;
+    else
+      result = result * 10 + dgt;
+  }
+  return result;
+}
+
 /**
   Parse the buffer and return one digit integer
 
@@ -339,7 +667,8 @@ bool cfgWriteEE() {
 }
 
 /**
-  Read the configuration from EEPROM, along with CRC8, and verify
+  Read the configuration from EEPROM, along with CRC8, and verify both
+  the checksum and the layout version
 */
 bool cfgReadEE(bool useDefaults = false) {
   // Temporary configuration structure
@@ -348,10 +677,41 @@ bool cfgReadEE(bool useDefaults = false) {
   EEPROM.get(cfgEEAddress, cfgTemp);
   // Compute the CRC8 checksum of the read data
   uint8_t crc8 = cfgEECRC(cfgTemp);
-  // And compare with the read crc8 checksum
-  if      (cfgTemp.crc8 == crc8)  cfgData = cfgTemp;
+  // And compare with the read crc8 checksum; a record in the first
+  // layout may pass the check by chance, the version tells it apart
+  bool valid = (cfgTemp.crc8 == crc8) and (cfgTemp.vers == CFG_VERSION);
+  if      (valid)                 cfgData = cfgTemp;
+  else if (cfgMigrate(cfgTemp, cfgTemp.crc8 == crc8)) return true;
   else if (useDefaults)           cfgDefaults();
-  return (cfgTemp.crc8 == crc8);
+  return valid;
+}
+
+/**
+  Migrate a configuration stored in a previous layout: keep its fields,
+  the same at the start of the current layout, and use the defaults for
+  the new ones, then store it in the current layout
+
+  @param cfg the configuration read
+  @param crcOk the CRC8 of the whole record matches
+  @return true if a valid configuration in a previous layout was found
+*/
+bool cfgMigrate(const struct cfgEE_t &cfg, bool crcOk) {
+  uint8_t used = 0;
+  if (crcOk and cfg.data[CFG_V1_USED] == 1)
+    used = CFG_V1_USED;
+  else {
+    uint8_t crc8 = 0;
+    for (uint8_t i = 0; i < CFG_V0_SIZE; i++)
+      crc8 = CRC8(crc8, cfg.data[i]);
+    if (cfg.data[CFG_V0_SIZE] == crc8)
+      used = CFG_V0_USED;
+  }
+  if (not used)
+    return false;
+  cfgData = cfgDefault;
+  memcpy(cfgData.data, cfg.data, used);
+  cfgWriteEE();
+  return true;
 }
 
 /**
@@ -359,7 +719,8 @@ bool cfgReadEE(bool useDefaults = false) {
 */
 bool cfgDefaults() {
   cfgData = cfgDefault;
-};
+  return true;
+}
 
 
 /**
@@ -370,6 +731,15 @@ bool cfgDefaults() {
 long readRaw() {
   // Wait for voltage to settle (bandgap stabilizes in 40-80 us)
   delay(10);
+  return adcConvert();
+}
+
+/**
+  Analog conversion on the selected channel, right away
+
+  @return raw analog read value (long)
+*/
+long adcConvert() {
   // Start conversion
   ADCSRA |= _BV(ADSC);
   // Wait to finish
@@ -427,15 +797,187 @@ int16_t readMCUTemp(int8_t k = 0) {
 */
 uint16_t readVcc(int8_t k = 0) {
   // Set the reference to Vcc and the measurement to the internal 1.1V reference
-  ADMUX = _BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1);
+  ADMUX = ADC_VCC;
 
   // Raw analog read
-  long wADC = readRaw();
+  return vccFromRaw(readRaw(), k);
+}
+
+/**
+  Convert the bandgap reading to the power supply voltage
 
+  @param wADC the raw reading of the 1V1 reference
+  @param k relative bandgap adjustment (/1000)
+  @return voltage in millivolts
+*/
+uint16_t vccFromRaw(long wADC, int8_t k) {
   // Return Vcc in mV; 1125300 = 1.1 * 1024 * 1000
   return (uint16_t)(1.1 * 1024.0 * (1000 + k) / wADC);
 }
 
+/**
+  Cap the brightness so the next frame fits the current budget, lowered
+  further while the supply sags, and keep the draw statistics
+*/
+void ledLimit() {
+  uint16_t lit = mtx.fbLit();
+  // The dimmed night mode starts from the minimum brightness, the budget
+  // still applies below it.  The scan limit is not lowered at night: it
+  // clips the columns of the modules, it is no power lever.
+  int8_t top = ngtState == NGT_DIM ? NGT_DIM_CAP : 0x0F;
+  int8_t cap = top;
+  if (cfgData.ibdg) {
+    uint16_t budget = cfgData.ibdg * 10;
+    while (cap > 0 and mtx.current(lit, cap) > budget)
+      cap--;
+    cap += ledTrim;
+    if (cap < 0)
+      cap = 0;
+    else if (cap > top)
+      cap = top;
+  }
+  mtx.intensityCap(cap);
+  // Statistics
+  ledMa = mtx.current(lit, mtx.level());
+  if (ledMa > ledPeak)
+    ledPeak = ledMa;
+  ledAvg = ledAvg - (ledAvg >> 4) + ledMa;
+}
+
+/**
+  Correct the cap from the measured supply: one step down while it
+  sags, one step back up once it has recovered.  Not to block the loop,
+  the bandgap is selected on a pass and measured on the next one, after
+  it settled, if no other reading took the ADC meanwhile.
+*/
+void ledCheckVcc() {
+  if (ADMUX != ADC_VCC) {
+    ADMUX = ADC_VCC;
+    // Come back when settled
+    ledCheckLast -= ledCheckWait - ledSettle;
+    return;
+  }
+  ledVcc = vccFromRaw(adcConvert(), cfgData.kvcc);
+  if (ledVcc < LED_VLOW and ledTrim > -0x0F)
+    ledTrim--;
+  else if (ledVcc > LED_VOK and ledTrim < 0)
+    ledTrim++;
+}
+
+/**
+  Print the LED current budget and the estimated draw
+*/
+void ledReport() {
+  Serial.print(F("*I: "));      Serial.print(cfgData.ibdg * 10);
+  Serial.print(F("mA, now "));  Serial.print(ledMa);
+  Serial.print(F(", peak "));   Serial.print(ledPeak);
+  Serial.print(F(", avg "));    Serial.print((uint16_t)(ledAvg >> 4));
+  Serial.print(F(", level "));  Serial.print(mtx.level());
+  Serial.print(F(", trim "));   Serial.print(ledTrim);
+  Serial.print(F(", "));        Serial.print(ledVcc);
+  Serial.println(F("mV"));
+}
+
+/**
+  Check if the hour is in the night window, which may span midnight
+
+  @param hh the hour 0..23
+  @return true if in the window
+*/
+bool ngtWindow(uint8_t hh) {
+  if (cfgData.nfst <= cfgData.nlst)
+    return (hh >= cfgData.nfst) and (hh <= cfgData.nlst);
+  else
+    return (hh >= cfgData.nfst) or (hh <= cfgData.nlst);
+}
+
+/**
+  Enter or leave the night mode, as the time and the configuration say
+*/
+void ngtCheck() {
+  bool night = cfgData.nmod and rtc.rtcOk and rtc.readTime() and ngtWindow(rtc.H);
+  uint8_t state = not night ? NGT_DAY : (cfgData.nmod == 1 ? NGT_OFF : NGT_DIM);
+  // A woken up display stays on until its timeout
+  if (state == ngtState or (state == NGT_OFF and ngtState == NGT_WAKE))
+    return;
+  if (ngtState == NGT_DAY) {
+    // The day draw to compare to, averaged over the whole day
+    ngtDayMa = ngtDaySecs ? ngtDayCharge / ngtDaySecs : ledMa;
+    ngtSaved = 0;
+  }
+  else if (state == NGT_DAY) {
+    ngtSavedLast = ngtSaved;
+    // A new day to account
+    ngtDayCharge = 0;
+    ngtDaySecs   = 0;
+  }
+  ngtState = state;
+  mtx.shutdown(state == NGT_OFF);
+  if (state == NGT_DIM)
+    mtxSetMode(MODE_HHMM);
+  mtxDisplayNow = true;
+}
+
+/**
+  Wake the display up, if shut down for the night, or keep it awake
+
+  @return true if the display was off, so the key is used up
+*/
+bool ngtWake() {
+  ngtWakeLast = millis();
+  if (ngtState != NGT_OFF)
+    return false;
+  ngtState = NGT_WAKE;
+  mtx.shutdown(false);
+  mtxDisplayNow = true;
+  return true;
+}
+
+/**
+  Check the night window, shut the display down again after a wake up
+  and keep the energy account
+
+  @param now the current millis()
+*/
+void ngtTick(uint32_t now) {
+  if (now - ngtCheckLast >= ngtCheckWait) {
+    ngtCheckLast = now;
+    ngtCheck();
+  }
+  if (ngtState == NGT_WAKE and not almRinging and (now - ngtWakeLast >= ngtWakeWait)) {
+    ngtState = NGT_OFF;
+    mtx.shutdown(true);
+  }
+  if (now - ngtSecLast >= 1000UL) {
+    ngtSecLast = now;
+    if (ngtState == NGT_DAY) {
+      ngtDayCharge += ledMa;
+      ngtDaySecs++;
+    }
+    else {
+      // The matrices draw almost nothing while shut down
+      uint16_t ma = (ngtState == NGT_OFF) ? 0 : ledMa;
+      if (ngtDayMa > ma)
+        ngtSaved += ngtDayMa - ma;
+    }
+  }
+}
+
+/**
+  Print the night window, the mode, the state and the estimated charge
+  saved, last night and this night so far
+*/
+void ngtReport() {
+  Serial.print(F("*N: "));        Serial.print(cfgData.nmod);
+  Serial.print(F(" "));           Serial.print(cfgData.nfst);
+  Serial.print(F(".."));          Serial.print(cfgData.nlst);
+  Serial.print(F(", state "));    Serial.print(ngtState);
+  Serial.print(F(", day "));      Serial.print(ngtDayMa);
+  Serial.print(F("mA, saved "));  Serial.print(ngtSavedLast / 3600);
+  Serial.print(F("mAh last night, ")); Serial.print(ngtSaved / 3600);
+  Serial.println(F("mAh now"));
+}
+
 /**
   Compute the brightness
 */
@@ -469,174 +1011,1279 @@ uint8_t brightness() {
     return cfgData.brgt;
 }
 
+/**
+  Find the head of the data logger ring buffer: the sequence numbers
+  are contiguous, modulo 255, up to the newest record.  Since the ring
+  length is not a multiple of 255, the wrap is always detected.
+*/
+void logInit() {
+  uint8_t seq, prv = 0xFF;
+  logHead = 0;
+  logCount = 0;
+  logSeq = 0;
+  if (not eep.eepOk)
+    return;
+  for (uint16_t r = 0; r < logRecs; r++) {
+    // Read only the sequence number
+    if (not eep.read(r * sizeof(logRec_t), &seq, 1))
+      break;
+    // Stop on empty record or sequence break
+    if (seq == 0xFF or (r > 0 and seq != (prv + 1) % 0xFF)) {
+      logHead = r;
+      logCount = (seq == 0xFF) ? r : logRecs;
+      break;
+    }
+    prv = seq;
+    logCount = r + 1;
+  }
+  // Continue the sequence
+  if (logCount > 0)
+    logSeq = (prv + 1) % 0xFF;
+  // Force the first record, marking the reset
+  logLast = 0UL;
+}
+
+/**
+  Append one record to the data logger ring buffer
+
+  @param now current millis
+*/
+void logWrite(uint32_t now) {
+  logRec_t rec;
+  rec.seq   = logSeq;
+  rec.dt    = (logLast == 0UL) ? 0 : (now - logLast + 500UL) / 1000UL;
+  rec.rtcT  = rtc.readTemperature();
+  rec.vcc   = readVcc(cfgData.kvcc);
+  rec.mcuT  = readMCUTemp(cfgData.ktmp) / 100;
+  rec.ldr   = readAnalog(LIGHT_PIN) >> 2;
+  // The records are page aligned, so this is a single page write
+  if (eep.write(logHead * sizeof(logRec_t), (uint8_t*)&rec, sizeof(rec))) {
+    logSeq = (logSeq + 1) % 0xFF;
+    logHead = (logHead + 1) % logRecs;
+    if (logCount < logRecs) logCount++;
+  }
+  logLast = now;
+}
+
+/**
+  Dump the data logger records, oldest first, one page chunk per line,
+  in hexadecimal
+*/
+void logDump() {
+  uint8_t page[EEP_PAGE];
+  // Start with the oldest record
+  uint16_t addr = ((logCount < logRecs) ? 0 : logHead) * sizeof(logRec_t);
+  uint16_t left = logCount * sizeof(logRec_t);
+  Serial.print(F("*G: ")); Serial.print(logCount);
+  Serial.print(F(" ")); Serial.println(sizeof(logRec_t));
+  while (left > 0) {
+    // Read up to the end of the page
+    uint8_t cnt = EEP_PAGE - (addr % EEP_PAGE);
+    if (cnt > left) cnt = left;
+    if (not eep.read(addr, page, cnt))
+      break;
+    for (uint8_t i = 0; i < cnt; i++) {
+      if (page[i] < 0x10) Serial.print(F("0"));
+      Serial.print(page[i], HEX);
+    }
+    Serial.println();
+    // Long dump, keep the watchdog happy
+    wdtFeed();
+    addr = (addr + cnt) % EEP_SIZE;
+    left -= cnt;
+  }
+}
+
 /**
   Simple short BEEP
 
   @param duration beep duration in ms
 */
 void beep(uint16_t duration = 10) {
-  if (cfgData.spkl > 0) {
-    pinMode(BEEP_PIN, OUTPUT);
+  // Do not cut a playing pattern
+  if (cfgData.spkl > 0 and chmNote == NULL) {
+    // The level scales the duration, in ticks
+    uint16_t ticks = duration * sq(cfgData.spkl) / 10;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      chmLoops = 0;
+      chmLeft  = ticks > 0xFF ? 0xFF : (ticks ? ticks : 1);
+    }
     digitalWrite(BEEP_PIN, HIGH);
-    delay(duration * sq(cfgData.spkl));
-    digitalWrite(BEEP_PIN, LOW);
+    TCNT2 = 0;
+    TIMSK2 |= _BV(OCIE2A);
   }
 }
 
 /**
-  Show the time specfied in unpacked BCD (4 bytes)
+  Play a pattern
 
-  @param HHMM 4-bytes array containing hours and minutes in unpacked BCD format
+  @param pattern the pattern, in program memory
+  @param loops times to repeat it
 */
-void showTimeBCD(uint8_t* HHMM) {
-  // Create a new array, containing the hours (2 digits), the colon symbol and
-  // the minutes (2 digits)
-  uint8_t data[] = {HHMM[0], HHMM[1], 0x0A, HHMM[2], HHMM[3]};
-  // Print on framebuffer
-  mtx.fbPrint(data, sizeof(data) / sizeof(*data));
-  // Print to console
-  if (not cfgData.scqt) {
-    Serial.print(F("*O")); Serial.print(MODE_HHMM); Serial.print(F(": "));
-    Serial.print(data[0], 10); Serial.print(data[1], 10); Serial.print(F(":"));
-    Serial.print(data[3], 10); Serial.print(data[4], 10); Serial.println();
+void chmPlay(const uint8_t* pattern, uint8_t loops) {
+  if (cfgData.spkl > 0) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      chmFirst = pattern;
+      chmNote  = pattern;
+      chmLoops = loops;
+      chmLeft  = 0;
+    }
+    TCNT2 = 0;
+    TIMSK2 |= _BV(OCIE2A);
   }
 }
 
 /**
-  Show the time
-
-  @param hh hours   0..23
-  @param mm minutes 0..59
+  Stop playing and silence the buzzer
 */
-void showTime(uint8_t hh, uint8_t mm) {
-  // Convert hhmm to unpacked BCD, 4 digits
-  uint8_t HHMM[4] = {hh / 10, hh % 10, mm / 10, mm % 10};
+void chmStop() {
+  TIMSK2 &= ~_BV(OCIE2A);
+  chmNote  = NULL;
+  chmLoops = 0;
+  chmLeft  = 0;
+  digitalWrite(BEEP_PIN, LOW);
+}
 
-  // Display the time in unpacked BCD
-  showTimeBCD(HHMM);
+/**
+  Check if the sequencer is playing
+
+  @return true if playing
+*/
+bool chmBusy() {
+  return TIMSK2 & _BV(OCIE2A);
 }
 
 /**
-  Check and display mode HHMM
+  Timer2 compare match, 100 times a second: count the current step and
+  start the next one
 */
-void showModeHHMM() {
-  if (rtc.rtcOk) {
-    // Check the alarms, the Alarm 2 triggers once per minute
-    if ((rtc.checkAlarms() & 0x02) or mtxDisplayNow) {
-      // Read the RTC, in BCD format
-      bool newHour = rtc.readTimeBCD();
-      // Check DST adjustments each new hour and read RTC if adjusted
-      if (newHour)
-        if (checkDST())
-          rtc.readTimeBCD();
-      // Show the time
-      showTimeBCD(rtc.R);
-      // Beep each hour, on the dot
-      if (newHour) {
-        // Get the hour in binary
-        uint8_t hh = 10 * rtc.R[0] + rtc.R[1];
-        // Check the Speaker mode switch and hours interval
-        if (((cfgData.spkm == 1) and (hh >= cfgData.bfst) and (hh <= cfgData.blst)) or
-            (cfgData.spkm == 2))
-          beep();
-      }
+ISR(TIMER2_COMPA_vect) {
+  if (chmLeft and --chmLeft)
+    return;
+  uint8_t step = 0;
+  if (chmNote != NULL) {
+    step = pgm_read_byte(chmNote++);
+    // End of the pattern, repeat it
+    if (step == 0 and chmLoops) {
+      chmLoops--;
+      chmNote = chmFirst;
+      step = pgm_read_byte(chmNote++);
     }
   }
+  if (step == 0) {
+    // Done, stop the timer interrupt
+    chmNote = NULL;
+    digitalWrite(BEEP_PIN, LOW);
+    TIMSK2 &= ~_BV(OCIE2A);
+  }
+  else {
+    digitalWrite(BEEP_PIN, (step & 0x80) ? HIGH : LOW);
+    chmLeft = step & 0x7F;
+  }
 }
 
 /**
-  Display mode SS
+  Set up the buzzer pin and Timer2: CTC mode, prescaler 1024, 100Hz,
+  the interrupt enabled only while playing
 */
-void showModeSS() {
-  // Read the seconds from RTC, as BCD
-  if (rtc.rtcOk) {
-    // Read seconds
-    uint8_t bcdSS = rtc.readSecondsBCD();
-    // Convert to unpacked BCD, colon and 2 digits
-    uint8_t data[] = {0xFF, 0xFF, 0x0A, bcdSS / 0x10, bcdSS % 0x10};
-    // Print on framebuffer
-    mtx.fbPrint(data, sizeof(data) / sizeof(*data));
-    // Print to console
-    if (not cfgData.scqt) {
-      Serial.print(F("*O")); Serial.print(MODE_SS); Serial.print(F(": "));
-      Serial.print(data[3], 10); Serial.print(data[4], 10); Serial.println();
-    }
-  }
+void chmInit() {
+  pinMode(BEEP_PIN, OUTPUT);
+  digitalWrite(BEEP_PIN, LOW);
+  TIMSK2 &= ~_BV(OCIE2A);
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS22) | _BV(CS21) | _BV(CS20);
+  OCR2A  = F_CPU / 1024 / 100 - 1;
 }
 
 /**
-  Display mode DDMM
+  Print the characters on the framebuffer and display it
+
+  @param chars the characters array to print
+  @param len number of characters
+  @param align print alignment
 */
-void showModeDDMM() {
-  // Read the full RTC time and date
-  if (rtc.rtcOk and rtc.readTime(true)) {
-    // Convert to unpacked BCD, day (2 digits), dot, month (2 digits)
-    uint8_t data[] = {rtc.d / 10, rtc.d % 10, 0x0B, rtc.m / 10, rtc.m % 10};
-    // Print on framebuffer
-    mtx.fbPrint(data, sizeof(data) / sizeof(*data));
-    // Print to console
-    if (not cfgData.scqt) {
-      Serial.print(F("*O")); Serial.print(MODE_DDMM); Serial.print(F(": "));
-      Serial.print(data[0], 10); Serial.print(data[1], 10); Serial.print(F("."));
-      Serial.print(data[3], 10); Serial.print(data[4], 10); Serial.println();
+void mtxPrint(uint8_t* chars, uint8_t len, uint8_t align = DotMatrix::CENTER) {
+  STAGE_START(STG_DISP);
+  mtx.fbPrint(chars, len, align);
+  STAGE_STOP(STG_DISP);
+}
+
+/**
+  Print a text on the framebuffer and display it
+
+  @param text the text to print
+  @param align print alignment
+*/
+void mtxPrint(const char* text, uint8_t align = DotMatrix::CENTER) {
+  STAGE_START(STG_DISP);
+  mtx.fbPrint(text, align);
+  STAGE_STOP(STG_DISP);
+}
+
+#ifdef PROFILING
+/**
+  Report the profiling statistics: count, min, mean, max and histogram
+  for each stage, in microseconds
+*/
+void profReport() {
+  Serial.print(F("*P: ")); Serial.print(prof.lps); Serial.println(F(" loops/s"));
+  for (uint8_t i = 0; i < PRF_STAGES; i++) {
+    for (uint8_t c = 0; c < 4; c++)
+      Serial.write(pgm_read_byte(&stgNames[i * 4 + c]));
+    Serial.print(F(" "));   Serial.print(prof.stages[i].cnt);
+    Serial.print(F(" "));   Serial.print(prof.stages[i].cnt ? prof.stages[i].min : 0);
+    Serial.print(F("/"));   Serial.print(prof.mean(i));
+    Serial.print(F("/"));   Serial.print(prof.stages[i].max);
+    Serial.print(F(" |"));
+    for (uint8_t b = 0; b < PRF_BUCKETS; b++) {
+      Serial.print(F(" ")); Serial.print(prof.stages[i].hist[b]);
     }
+    Serial.println();
   }
 }
+#endif
 
 /**
-  Check and display mode YY
+  Timer1 compare match, 100 times a second: count the running timers
+  and dither the next period, so that an RTC second holds exactly
+  chrPeriod timer counts
 */
-void showModeYY() {
-  // Read the full RTC time and date
-  if (rtc.rtcOk and rtc.readTime(true)) {
-    // Convert to unpacked BCD, 4 digits
-    uint8_t data[] = {rtc.Y / 1000, (rtc.Y % 1000) / 100, (rtc.Y % 100) / 10, rtc.Y % 10};
-    // Print on framebuffer
-    mtx.fbPrint(data, sizeof(data) / sizeof(*data));
-    // Print to console
-    if (not cfgData.scqt) {
-      Serial.print(F("*O")); Serial.print(MODE_YY); Serial.print(F(": "));
-      Serial.println(rtc.Y);
+ISR(TIMER1_COMPA_vect) {
+  chrCounts += OCR1A + 1;
+  if (++chrPhase >= CHR_HZ)
+    chrPhase = 0;
+  OCR1A = chrBase - 1 + (chrPhase < chrRem ? 1 : 0);
+  if (chrRun & _BV(CHR_CHRN)) chrTicks[CHR_CHRN]++;
+  if (chrRun & _BV(CHR_CNTD)) chrTicks[CHR_CNTD]++;
+}
+
+/**
+  RTC INT/SQW pin change: flag the alarm interrupt or, while a timer
+  runs, measure the timer counts between two falling edges of the 1Hz
+  output and adjust the timer period
+*/
+ISR(PCINT1_vect) {
+  if (digitalRead(INTSQ_PIN) == HIGH)
+    return;
+  // Not the square wave, an alarm interrupt
+  if (not chrRun) {
+    rtcInt = true;
+    return;
+  }
+  // Timer1 counts now, including a compare match not yet serviced
+  uint16_t tcnt = TCNT1;
+  uint32_t now = chrCounts + tcnt;
+  if ((TIFR1 & _BV(OCF1A)) and tcnt < (OCR1A >> 1))
+    now += OCR1A + 1;
+  if (chrEdgeOk) {
+    uint32_t cnt = now - chrEdge;
+    // Ignore the missed or spurious edges, more than 1% off
+    if (cnt > CHR_COUNTS - CHR_COUNTS / 100 and cnt < CHR_COUNTS + CHR_COUNTS / 100) {
+      // Low pass filter the jitter of the interrupt latency
+      chrPeriod += ((int32_t)(cnt - chrPeriod)) / 4;
+      chrBase = chrPeriod / CHR_HZ;
+      chrRem  = chrPeriod % CHR_HZ;
+      chrSyncs++;
     }
   }
+  chrEdge = now;
+  chrEdgeOk = true;
 }
 
 /**
-  Display the mode TEMP
+  Start or stop the timer hardware: Timer1 in CTC mode and the RTC
+  square wave on the INT/SQW pin.  The timer count is kept while
+  stopped.
+
+  @param on start or stop
 */
-void showModeTEMP() {
-  // Get the temperature
-  int8_t temp = rtc.readTemperature(cfgData.tmpu);
-  // Absolute value
-  uint8_t atemp = abs(temp);
-  if (atemp >= 100) {
-    // Create an array with the sign, value (3 digits) the degree symbol and units letter
-    uint8_t data[] = {temp < 0 ? 0x0E : 0xFF, atemp / 100, (atemp % 100) / 10, atemp % 10, 0x0D, cfgData.tmpu ? 0x0C : 0x0F};
-    // Print on framebuffer
-    mtx.fbPrint(data, sizeof(data) / sizeof(*data));
+void chrTimer(bool on) {
+  if (on) {
+    // The first edge only sets the reference
+    chrEdgeOk = false;
+    if (rtc.rtcOk)
+      rtc.setSQW(true);
+    // CTC mode, prescaler 8
+    TCCR1A = 0;
+    OCR1A  = chrBase - 1 + (chrPhase < chrRem ? 1 : 0);
+    TIMSK1 |= _BV(OCIE1A);
+    TCCR1B = _BV(WGM12) | _BV(CS11);
   }
   else {
-    // Create an array with the sign, value (2 digits) the degree symbol and units letter
-    uint8_t data[] = {temp < 0 ? 0x0E : 0xFF, atemp / 10,  atemp % 10, 0x0D, cfgData.tmpu ? 0x0C : 0x0F};
-    // Print on framebuffer
-    mtx.fbPrint(data, sizeof(data) / sizeof(*data));
+    // No clock source
+    TCCR1B = _BV(WGM12);
+    if (rtc.rtcOk)
+      rtc.setSQW(false);
   }
-  // Print to console
-  if (not cfgData.scqt) {
-    Serial.print(F("*O")); Serial.print(MODE_TEMP); Serial.print(F(": "));
-    Serial.print(temp); Serial.println(cfgData.tmpu ? "C" : "F");
+}
+
+/**
+  Read a timer
+
+  @param t the timer
+  @return elapsed time, hundredths
+*/
+uint32_t chrRead(uint8_t t) {
+  uint32_t x;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    x = chrTicks[t];
   }
+  return x;
 }
+
 /**
-  Check and display mode VCC (supply voltage)
+  Get the timer the current mode shows, the chronograph by default
+
+  @return the timer
 */
-void showModeVCC() {
+uint8_t chrSelect() {
+  return mtxMode == MODE_CNTD ? CHR_CNTD : CHR_CHRN;
+}
+
+/**
+  Start a timer, the countdown only if there is time left
+
+  @param t the timer
+*/
+void chrStart(uint8_t t) {
+  if ((chrRun & _BV(t)) or (t == CHR_CNTD and chrRead(t) >= chrPreset))
+    return;
+  if (not chrRun)
+    chrTimer(true);
+  chrRun |= _BV(t);
+  mtxDisplayNow = true;
+}
+
+/**
+  Stop a timer
+
+  @param t the timer
+*/
+void chrStop(uint8_t t) {
+  if (not (chrRun & _BV(t)))
+    return;
+  chrRun &= ~_BV(t);
+  if (not chrRun)
+    chrTimer(false);
+  mtxDisplayNow = true;
+}
+
+/**
+  Start or stop a timer
+
+  @param t the timer
+*/
+void chrToggle(uint8_t t) {
+  if (chrRun & _BV(t)) chrStop(t);
+  else                 chrStart(t);
+}
+
+/**
+  Reset a timer, and the laps of the chronograph
+
+  @param t the timer
+*/
+void chrReset(uint8_t t) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    chrTicks[t] = 0UL;
+  }
+  if (t == CHR_CHRN)
+    chrLapCount = 0;
+  mtxDisplayNow = true;
+}
+
+/**
+  Print a time as MM:SS.hh
+
+  @param x the time, hundredths
+*/
+void chrPrint(uint32_t x) {
+  uint8_t mm = (x / 6000) % 100;
+  uint8_t ss = (x / 100) % 60;
+  uint8_t hh = x % 100;
+  Serial.print(mm / 10); Serial.print(mm % 10); Serial.print(F(":"));
+  Serial.print(ss / 10); Serial.print(ss % 10); Serial.print(F("."));
+  Serial.print(hh / 10); Serial.print(hh % 10);
+}
+
+/**
+  Keep a lap time of the running chronograph
+
+  @return true if the lap was taken
+*/
+bool chrLap() {
+  if (not (chrRun & _BV(CHR_CHRN)))
+    return false;
+  uint32_t x = chrRead(CHR_CHRN);
+  chrLaps[chrLapCount % CHR_LAPS] = x;
+  chrLapCount++;
+  if (not cfgData.scqt) {
+    Serial.print(F("*C L")); Serial.print(chrLapCount); Serial.print(F(": "));
+    chrPrint(x); Serial.println();
+  }
+  return true;
+}
+
+/**
+  The first button in the chronograph modes: lap while running, reset
+  when stopped
+
+  @return true if used, false to change the mode
+*/
+bool chrButton() {
+  uint8_t t = chrSelect();
+  if (chrRun & _BV(t))
+    return chrLap();
+  if (chrRead(t) == 0UL)
+    return false;
+  chrReset(t);
+  return true;
+}
+
+/**
+  Stop the countdown when the time is up, and beep
+*/
+void chrCheck() {
+  if ((chrRun & _BV(CHR_CNTD)) and chrRead(CHR_CNTD) >= chrPreset) {
+    chrStop(CHR_CNTD);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      chrTicks[CHR_CNTD] = chrPreset;
+    }
+    chmPlay(chmChime, 2);
+  }
+}
+
+/**
+  Print the timers, the discipline state and the laps
+*/
+void chrReport() {
+  uint32_t period;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    period = chrPeriod;
+  }
+  Serial.print(F("*C: "));
+  chrPrint(chrRead(CHR_CHRN));              Serial.print(F(" "));
+  Serial.print((chrRun >> CHR_CHRN) & 1);   Serial.print(F(" "));
+  chrPrint(chrPreset - chrRead(CHR_CNTD));  Serial.print(F(" "));
+  Serial.print((chrRun >> CHR_CNTD) & 1);   Serial.print(F(" "));
+  Serial.print(chrDropped);                 Serial.print(F(" "));
+  Serial.print(period);                     Serial.print(F(" "));
+  Serial.println(chrSyncs);
+  // The last laps
+  uint8_t first = chrLapCount > CHR_LAPS ? chrLapCount - CHR_LAPS : 0;
+  for (uint8_t l = first; l < chrLapCount; l++) {
+    Serial.print(F("L")); Serial.print(l + 1); Serial.print(F(": "));
+    chrPrint(chrLaps[l % CHR_LAPS]); Serial.println();
+  }
+}
+
+/**
+  Compute the CRC8 checksum of the alarms
+
+  @return the CRC8 checksum
+*/
+uint8_t almEECRC() {
+  uint8_t crc8 = 0;
+  for (uint8_t i = 0; i < sizeof(almData) - 1; i++)
+    crc8 = CRC8(crc8, ((uint8_t*)&almData)[i]);
+  return crc8;
+}
+
+/**
+  Read the alarms from EEPROM, clear them if the CRC8 does not match
+*/
+void almReadEE() {
+  EEPROM.get(almEEAddress, almData);
+  if (almData.crc8 != almEECRC())
+    memset(&almData, 0, sizeof(almData));
+}
+
+/**
+  Write the alarms to EEPROM, along with CRC8, only the changed bytes
+*/
+void almWriteEE() {
+  almData.crc8 = almEECRC();
+  EEPROM.put(almEEAddress, almData);
+}
+
+/**
+  Find the first alarm after the current time, the snoozed one included,
+  and program it into the RTC Alarm 1, so the RTC interrupt wakes us up
+
+  @return true if an alarm is programmed
+*/
+bool almSchedule() {
+  almNext.days = 0;
+  if (not rtc.rtcOk or not rtc.readTime(true))
+    return false;
+  int16_t now = rtc.H * 60 + rtc.M;
+  int16_t best = 0x7FFF;
+  for (uint8_t a = 0; a <= ALM_COUNT; a++) {
+    almTime_t *alm = (a < ALM_COUNT) ? &almData.alm[a] : &almSnoozed;
+    // Today, in a week at most
+    for (uint8_t dd = 0; dd <= 7; dd++) {
+      uint8_t dow = (rtc.u - 1 + dd) % 7;
+      if (not (alm->days & _BV(dow)))
+        continue;
+      int16_t ahead = dd * 1440 + alm->hh * 60 + alm->mm - now;
+      if (ahead <= 0)
+        continue;
+      if (ahead < best) {
+        best = ahead;
+        almNext.hh = alm->hh;
+        almNext.mm = alm->mm;
+        almNext.days = _BV(dow);
+      }
+      break;
+    }
+  }
+  if (almNext.days == 0) {
+    rtc.clearAlarm1();
+    return false;
+  }
+  // Day of week, 1..7
+  uint8_t dow = 1;
+  while (not (almNext.days & _BV(dow - 1)))
+    dow++;
+  return rtc.setAlarm1(dow, almNext.hh, almNext.mm);
+}
+
+/**
+  The Alarm 1 fired: ring, show the time and program the next alarm
+*/
+void almRing() {
+  almRinging = true;
+  almSnoozed.days = 0;
+  chmStop();
+  chmPlay(chmAlarm, ALM_RINGS);
+  mtxSetMode(MODE_HHMM);
+  ngtWake();
+  almSchedule();
+  if (not cfgData.scqt) {
+    Serial.print(F("*W: ")); Serial.print(almNext.days ? F("ring, next ") : F("ring"));
+    if (almNext.days) {
+      Serial.print(almNext.hh); Serial.print(F(":")); Serial.print(almNext.mm);
+    }
+    Serial.println();
+  }
+}
+
+/**
+  Snooze the ringing alarm
+
+  @return true if an alarm was ringing
+*/
+bool almSnooze() {
+  if (not almRinging)
+    return false;
+  almRinging = false;
+  chmStop();
+  if (rtc.rtcOk and rtc.readTime(true)) {
+    // Default interval, if not configured
+    uint16_t mins = rtc.H * 60 + rtc.M + (cfgData.snoz ? cfgData.snoz : cfgDefault.snoz);
+    almSnoozed.hh   = (mins / 60) % 24;
+    almSnoozed.mm   = mins % 60;
+    almSnoozed.days = _BV((rtc.u - 1 + mins / 1440) % 7);
+  }
+  almSchedule();
+  return true;
+}
+
+/**
+  Dismiss the ringing or the snoozed alarm
+
+  @return true if there was an alarm to dismiss
+*/
+bool almDismiss() {
+  bool result = almRinging or almSnoozed.days;
+  almRinging = false;
+  almSnoozed.days = 0;
+  chmStop();
+  almSchedule();
+  return result;
+}
+
+/**
+  Print the alarms and the next programmed one
+*/
+void almReport() {
+  for (uint8_t a = 0; a < ALM_COUNT; a++) {
+    Serial.print(F("*W")); Serial.print(a); Serial.print(F(": "));
+    Serial.print(almData.alm[a].hh); Serial.print(F(":"));
+    Serial.print(almData.alm[a].mm); Serial.print(F(" "));
+    Serial.println(almData.alm[a].days);
+  }
+  Serial.print(F("*W: ")); Serial.print(almRinging); Serial.print(F(" "));
+  Serial.print(almSnoozed.days ? 1 : 0); Serial.print(F(" "));
+  if (almNext.days) {
+    Serial.print(almNext.hh); Serial.print(F(":")); Serial.print(almNext.mm);
+    Serial.print(F(" ")); Serial.println(almNext.days);
+  }
+  else
+    Serial.println(F("-"));
+}
+
+/**
+  Compute the CRC8 checksum of the drift history
+
+  @return the CRC8 checksum
+*/
+uint8_t drfEECRC() {
+  uint8_t crc8 = 0;
+  for (uint8_t i = 0; i < sizeof(drfData) - 1; i++)
+    crc8 = CRC8(crc8, ((uint8_t*)&drfData)[i]);
+  return crc8;
+}
+
+/**
+  Read the drift history from EEPROM, clear it if the CRC8 does not match
+*/
+void drfReadEE() {
+  EEPROM.get(drfEEAddress, drfData);
+  if (drfData.crc8 != drfEECRC())
+    memset(&drfData, 0, sizeof(drfData));
+}
+
+/**
+  Write the drift history to EEPROM, along with CRC8
+*/
+void drfWriteEE() {
+  drfData.crc8 = drfEECRC();
+  EEPROM.put(drfEEAddress, drfData);
+}
+
+/**
+  Estimate the drift by least squares on the offsets history, in fixed
+  point: the slope, in ms/s, is 1000ppm
+
+  @return true if there are enough points
+*/
+bool drfEstimate() {
+  uint8_t n = drfData.n;
+  drfPpm = 0;
+  drfSe  = 0;
+  if (n < 3)
+    return false;
+  // Means
+  int64_t st = 0, so = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    st += drfData.pts[i].t;
+    so += drfData.pts[i].o;
+  }
+  int32_t mt = st / n;
+  int32_t mo = so / n;
+  // Centered sums
+  int64_t stt = 0, sto = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    int32_t dt = drfData.pts[i].t - mt;
+    int32_t dof = drfData.pts[i].o - mo;
+    stt += (int64_t)dt * dt;
+    sto += (int64_t)dt * dof;
+  }
+  if (stt == 0)
+    return false;
+  // The slope, 1/100 ppm
+  int64_t ppm = sto * 100000 / stt;
+  // The residuals, for the standard error of the slope
+  int64_t srr = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    int32_t dt = drfData.pts[i].t - mt;
+    int32_t res = drfData.pts[i].o - mo - (int32_t)(dt * ppm / 100000);
+    srr += (int64_t)res * res;
+  }
+  float se = 100000.0 * sqrt((float)srr / (n - 2) / (float)stt);
+  drfPpm = ppm > 32000 ? 32000 : (ppm < -32000 ? -32000 : ppm);
+  drfSe  = se > 32000.0 ? 32000 : se;
+  return true;
+}
+
+/**
+  Add an offset to the history, then correct the RTC aging register if
+  the drift estimation is confident: long enough span, at least one
+  aging step, more than twice its standard error, and an offset over
+  the span well past the millisecond resolution of the syncs, or the
+  small drifts would be corrected back and forth.  The history restarts
+  after each correction.
+
+  @param sec host time, seconds since epoch
+  @param ofs the RTC offset, ms
+*/
+void drfRecord(uint32_t sec, int32_t ofs) {
+  // Start over if the host time went back or the history is too old
+  if (drfData.n == 0 or sec < drfData.base + drfData.pts[drfData.n - 1].t or
+      sec - drfData.base > DRF_MAX_AGE) {
+    drfData.base = sec;
+    drfData.n = 0;
+  }
+  // Not a drift, the time has to be set
+  if (ofs > DRF_MAX_OFS or ofs < -DRF_MAX_OFS) {
+    drfData.n = 0;
+    drfWriteEE();
+    return;
+  }
+  // Drop the oldest point
+  if (drfData.n == DRF_POINTS) {
+    memmove(&drfData.pts[0], &drfData.pts[1], (DRF_POINTS - 1) * sizeof(drfPoint_t));
+    drfData.n--;
+  }
+  drfData.pts[drfData.n].t = sec - drfData.base;
+  drfData.pts[drfData.n].o = ofs;
+  drfData.n++;
+  uint32_t span = drfData.pts[drfData.n - 1].t - drfData.pts[0].t;
+  if (drfEstimate() and span >= DRF_SPAN and
+      abs(drfPpm) >= 10 and abs(drfPpm) > 2 * drfSe and
+      (int64_t)abs(drfPpm) * span >= DRF_RES * 100000L) {
+    // About 0.1ppm per aging step, at 25C; positive steps slow the clock
+    int16_t step  = constrain((drfPpm + (drfPpm > 0 ? 5 : -5)) / 10, -127, 127);
+    int8_t  aging;
+    // Never correct from an unknown aging offset, try on the next sync
+    if (rtc.readAging(aging) and
+        rtc.writeAging(constrain(aging + step, -128, 127))) {
+      drfData.corr++;
+      drfData.step = step;
+      // Restart from the last point
+      drfData.base = sec;
+      drfData.pts[0].t = 0;
+      drfData.pts[0].o = ofs;
+      drfData.n = 1;
+    }
+  }
+  drfWriteEE();
+}
+
+/**
+  Clear the drift history, when the RTC time is set without knowing the
+  exact step
+*/
+void drfClear() {
+  drfData.n = 0;
+  drfWriteEE();
+  drfEstimate();
+}
+
+/**
+  The offset of the RTC time, just read, to a host time, saturated past
+  about 23 days
+
+  @param sec host time, seconds since epoch
+  @param ms host time, milliseconds
+  @return the offset, ms, positive if ahead
+*/
+int32_t rtcOffset(uint32_t sec, uint16_t ms) {
+  int32_t secs = constrain((int32_t)(rtc.unixTime() - sec), -2000000L, 2000000L);
+  return secs * 1000L - ms;
+}
+
+/**
+  Measure the RTC offset to the host time, at the next RTC second edge,
+  and add it to the drift history
+
+  @param sec host time, seconds since epoch, local
+  @param ms host time, milliseconds
+  @param rcv millis() when the host time was received
+  @return true if measured
+*/
+bool drfSync(uint32_t sec, uint16_t ms, uint32_t rcv) {
+  uint32_t edge;
+  if (not sqwEdge(edge))
+    return false;
+  // The host time at the edge is the received time plus the wait
+  int32_t ofs = rtcOffset(sec, ms) - (int32_t)(edge - rcv);
+  drfRecord(sec, ofs);
+  Serial.print(F("*Y: ")); Serial.print(ofs); Serial.println(F(" ms"));
+  return true;
+}
+
+/**
+  Move the drift history after the RTC time was stepped by a known
+  amount, so it goes on
+
+  @param step the step, ms
+*/
+void drfShift(int32_t step) {
+  // The history was too far off to be kept
+  if (step > DRF_MAX_OFS or step < -DRF_MAX_OFS)
+    drfData.n = 0;
+  for (uint8_t i = 0; i < drfData.n; i++)
+    drfData.pts[i].o += step;
+  drfWriteEE();
+}
+
+/**
+  Wait for the next RTC second, the falling edge of the 1Hz output on
+  the INT/SQW pin, and read the time
+
+  @param edge millis() at the edge
+  @return true if found, the RTC time and date are read
+*/
+bool sqwEdge(uint32_t &edge) {
+  if (not rtc.rtcOk)
+    return false;
+  wdtFeed();
+  // Switch the pin to the square wave, if not already
+  if (not chrRun and not rtc.setSQW(true))
+    return false;
+  bool found = false;
+  uint32_t start = millis();
+  // Wait for the high level, then the falling edge, feeding the watchdog
+  while (digitalRead(INTSQ_PIN) == LOW and millis() - start < 1100UL)
+    wdtFeed();
+  while (digitalRead(INTSQ_PIN) == HIGH and millis() - start < 2100UL)
+    wdtFeed();
+  if (digitalRead(INTSQ_PIN) == LOW) {
+    edge = millis();
+    found = rtc.readTime(true);
+  }
+  if (not chrRun)
+    rtc.setSQW(false);
+  return found;
+}
+
+/**
+  Get the host time at a millis() value
+
+  @param m the millis() value
+  @param ms the milliseconds
+  @return the seconds since epoch
+*/
+uint32_t tsHost(uint32_t m, uint16_t &ms) {
+  uint32_t x = tsEpochMs + m;
+  ms = x % 1000;
+  return tsEpoch + x / 1000;
+}
+
+/**
+  Measure the RTC offset to the host time, at the next RTC second
+
+  @param ofs the offset, ms, positive if ahead
+  @param sec the host time at the edge, seconds
+  @return true if measured
+*/
+bool tsOffset(int32_t &ofs, uint32_t &sec) {
+  uint32_t edge;
+  uint16_t ms;
+  if (not sqwEdge(edge))
+    return false;
+  sec = tsHost(edge, ms);
+  ofs = rtcOffset(sec, ms);
+  return true;
+}
+
+/**
+  Set the RTC to the host time, on a host second boundary: writing the
+  seconds register resets the RTC countdown chain, so the next second
+  starts 1s later.  The offsets before and after are measured on the
+  RTC square wave and the drift history goes on.
+
+  @return true if the time was set
+*/
+bool tsSync() {
+  int32_t before, after;
+  uint32_t sec;
+  uint16_t ms;
+  if (not tsOffset(before, sec))
+    return false;
+  drfRecord(sec, before);
+  // Wait for the next host second
+  uint32_t w = millis() + 10;
+  tsHost(w, ms);
+  w += 1000 - ms;
+  sec = tsHost(w, ms);
+  while ((int32_t)(millis() - w) < 0)
+    wdtFeed();
+  if (not rtc.writeUnix(sec))
+    return false;
+  // Check the DST, as for AT*T, and the alarms
+  if (rtc.readTime(true)) {
+    cfgData.dst = rtc.dstCheck(rtc.Y, rtc.m, rtc.d, rtc.H);
+    cfgWriteEE();
+  }
+  almSchedule();
+  // The achieved offset
+  if (not tsOffset(after, sec))
+    return false;
+  drfShift(after - before);
+  Serial.print(F("*X: ")); Serial.print(before);
+  Serial.print(F(" "));    Serial.print(after); Serial.println(F(" ms"));
+  return true;
+}
+
+/**
+  Print the drift estimation, its confidence, the aging offset and the
+  history
+*/
+void drfReport() {
+  uint32_t span = drfData.n ? drfData.pts[drfData.n - 1].t - drfData.pts[0].t : 0;
+  Serial.print(F("*Y: "));  Serial.print(drfData.n);
+  Serial.print(F(" "));     Serial.print(span / 3600); Serial.print(F("h "));
+  Serial.print(drfPpm / 100.0, 2); Serial.print(F("+-"));
+  Serial.print(drfSe / 100.0, 2);  Serial.print(F("ppm "));
+  int8_t aging;
+  if (rtc.readAging(aging))
+    Serial.print(aging);
+  else
+    Serial.print(F("?"));
+  Serial.print(F(" "));
+  Serial.print(drfData.corr);      Serial.print(F(" "));
+  Serial.println(drfData.step);
+  for (uint8_t i = 0; i < drfData.n; i++) {
+    Serial.print(drfData.base + drfData.pts[i].t); Serial.print(F(" "));
+    Serial.println(drfData.pts[i].o);
+  }
+}
+
+/**
+  Read and clear the RTC alarm flags: ring on Alarm 1, keep Alarm 2,
+  every minute, for the HHMM mode
+*/
+void rtcCheckAlarms() {
+  rtcInt = false;
+  uint8_t alarms = rtc.checkAlarms();
+  rtcAlarms |= alarms;
+  if (alarms & 0x01)
+    almRing();
+}
+
+/**
+  Check if the value to show in the current mode has changed and keep
+  it, so the rendering, the display and the console are skipped if not
+
+  @param value the packed value to show
+  @return true if changed or the display is forced
+*/
+bool mtxChanged(uint32_t value) {
+  if (mtxDisplayNow or value != mtxMemo) {
+    mtxMemo = value;
+    return true;
+  }
+  return false;
+}
+
+/**
+  Show the time specfied in unpacked BCD (4 bytes)
+
+  @param HHMM 4-bytes array containing hours and minutes in unpacked BCD format
+*/
+void showTimeBCD(uint8_t* HHMM) {
+  // Create a new array, containing the hours (2 digits), the colon symbol and
+  // the minutes (2 digits)
+  uint8_t data[] = {HHMM[0], HHMM[1], 0x0A, HHMM[2], HHMM[3]};
+  // Print on framebuffer
+  mtxPrint(data, sizeof(data) / sizeof(*data));
+  // Print to console
+  if (not cfgData.scqt) {
+    Serial.print(F("*O")); Serial.print(MODE_HHMM); Serial.print(F(": "));
+    Serial.print(data[0], 10); Serial.print(data[1], 10); Serial.print(F(":"));
+    Serial.print(data[3], 10); Serial.print(data[4], 10); Serial.println();
+  }
+}
+
+/**
+  Show the time
+
+  @param hh hours   0..23
+  @param mm minutes 0..59
+*/
+void showTime(uint8_t hh, uint8_t mm) {
+  // Convert hhmm to unpacked BCD, 4 digits
+  uint8_t HHMM[4] = {(uint8_t)(hh / 10), (uint8_t)(hh % 10), (uint8_t)(mm / 10), (uint8_t)(mm % 10)};
+
+  // Display the time in unpacked BCD
+  showTimeBCD(HHMM);
+}
+
+/**
+  Check and display mode HHMM
+*/
+void showModeHHMM() {
+  if (rtc.rtcOk) {
+    // Check the alarms, the Alarm 2 triggers once per minute
+    if ((rtcAlarms & 0x02) or mtxDisplayNow) {
+      rtcAlarms &= ~0x02;
+      // Read the RTC
+      readTimeHourly();
+      // Show the time
+      showTimeBCD(rtc.R);
+    }
+  }
+}
+
+/**
+  Read the time from the RTC, in BCD format, and do the hourly jobs: the
+  DST check and the beep, on the dot
+*/
+void readTimeHourly() {
+  bool newHour = rtc.readTimeBCD();
+  if (newHour) {
+    // Check DST adjustments each new hour and read RTC if adjusted
+    if (checkDST())
+      rtc.readTimeBCD();
+    // Get the hour in binary
+    uint8_t hh = 10 * rtc.R[0] + rtc.R[1];
+    // Check the Speaker mode switch and hours interval
+    if (((cfgData.spkm == 1) and (hh >= cfgData.bfst) and (hh <= cfgData.blst)) or
+        (cfgData.spkm == 2))
+      beep();
+  }
+}
+
+/**
+  Get the value of a region data source, reading the RTC only if it
+  may have changed
+
+  @param src the data source
+  @param memo the value last shown
+  @return the current value
+*/
+uint32_t rgnValue(uint8_t src, uint32_t memo) {
+  if (not rtc.rtcOk)
+    return memo;
+  switch (src) {
+    case SRC_TIME:
+      // The Alarm 2 triggers once per minute
+      if (not (rtcAlarms & 0x02) and not mtxDisplayNow)
+        return memo;
+      rtcAlarms &= ~0x02;
+      readTimeHourly();
+      return ((uint16_t)rtc.R[0] << 12) | (rtc.R[1] << 8) | (rtc.R[2] << 4) | rtc.R[3];
+    case SRC_SECS:
+    case SRC_SBAR:
+      return rtc.readSecondsBCD();
+    case SRC_TEMP: {
+        // Read in Celsius, 0x80 if not read, and convert here, the
+        // Fahrenheit degrees may not fit in a byte
+        int16_t temp = rtc.readTemperature(true);
+        if (temp == -128)
+          return memo;
+        if (not cfgData.tmpu)
+          temp = temp * 9 / 5 + 32;
+        return ((uint32_t)cfgData.tmpu << 16) | (uint16_t)temp;
+      }
+  }
+  return memo;
+}
+
+/**
+  Render a region on the framebuffer
+
+  @param rgn the region
+  @param val the value of its data source
+*/
+void rgnRender(const rgnDef_t &rgn, uint32_t val) {
+  uint8_t data[5];
+  uint8_t len = 0;
+  switch (rgn.src) {
+    case SRC_TIME:
+      data[0] = (val >> 12) & 0x0F;
+      data[1] = (val >> 8) & 0x0F;
+      data[2] = 0x0A;
+      data[3] = (val >> 4) & 0x0F;
+      data[4] = val & 0x0F;
+      len = 5;
+      break;
+    case SRC_SECS:
+      data[0] = 0x0A;
+      data[1] = (val >> 4) & 0x0F;
+      data[2] = val & 0x0F;
+      len = 3;
+      break;
+    case SRC_SBAR: {
+        // A bar growing from the left, full on the last second
+        uint8_t ss  = 10 * (val >> 4) + (val & 0x0F);
+        uint8_t wdt = rgn.hi - rgn.lo + 1;
+        mtx.fbBar(rgn.lo, rgn.hi, rgn.rows, (ss + 1) * wdt / 60);
+        return;
+      }
+    case SRC_TEMP: {
+        // The sign, only if negative, the value, the degree symbol and the units
+        int16_t temp = val & 0xFFFF;
+        uint16_t atemp = abs(temp) % 1000;
+        if (temp < 0)
+          data[len++] = 0x0E;
+        if (atemp >= 100)
+          data[len++] = atemp / 100;
+        data[len++] = (atemp % 100) / 10;
+        data[len++] = atemp % 10;
+        data[len++] = 0x0D;
+        // The sign and three digits leave no room for the units
+        if (len < 5)
+          data[len++] = cfgData.tmpu ? 0x0C : 0x0F;
+        break;
+      }
+  }
+  mtx.loadFont(rgn.font == 0xFF ? cfgData.font : rgn.font);
+  mtx.fbRegion(rgn.lo, rgn.hi, rgn.rows, data, len);
+}
+
+/**
+  Get the split mode layout, the first one if not configured
+
+  @return the layout index
+*/
+uint8_t rgnLayout() {
+  return (cfgData.splt > 0 and cfgData.splt <= RGN_LAYOUTS) ? cfgData.splt - 1 : 0;
+}
+
+/**
+  Display mode SPLT: render the regions of the layout whose source has
+  changed and present the frame; only the changed lines are sent
+*/
+void showModeSplit() {
+  uint32_t now = millis();
+  bool changed = mtxDisplayNow;
+  // Entering the mode, start with a clean framebuffer
+  if (mtxDisplayNow)
+    mtx.fbClear();
+  for (uint8_t r = 0; r < RGN_MAX; r++) {
+    rgnDef_t rgn;
+    memcpy_P(&rgn, &rgnLayouts[rgnLayout()][r], sizeof(rgn));
+    if (rgn.src == SRC_NONE)
+      continue;
+    if (not mtxDisplayNow and (now - rgnLast[r] < rgn.poll))
+      continue;
+    rgnLast[r] = now;
+    uint32_t val = rgnValue(rgn.src, rgnMemo[r]);
+    if (not mtxDisplayNow and val == rgnMemo[r])
+      continue;
+    rgnMemo[r] = val;
+    rgnRender(rgn, val);
+    changed = true;
+  }
+  // The regions are drawn only, present the frame
+  if (changed)
+    mtx.fbPresent();
+}
+
+/**
+  Print the regions of the split mode layout
+*/
+void rgnReport() {
+  Serial.print(F("*K: ")); Serial.println(rgnLayout() + 1);
+  for (uint8_t r = 0; r < RGN_MAX; r++) {
+    rgnDef_t rgn;
+    memcpy_P(&rgn, &rgnLayouts[rgnLayout()][r], sizeof(rgn));
+    if (rgn.src == SRC_NONE)
+      continue;
+    Serial.print(F("*K")); Serial.print(r); Serial.print(F(": "));
+    Serial.print(rgn.hi);   Serial.print(F(".."));  Serial.print(rgn.lo);
+    Serial.print(F(" 0x")); Serial.print(rgn.rows, 16);
+    Serial.print(F(" "));   Serial.print(rgn.src);
+    Serial.print(F(" "));   Serial.print(rgn.font == 0xFF ? cfgData.font : rgn.font);
+    Serial.print(F(" "));   Serial.println(rgn.poll);
+  }
+}
+
+/**
+  Display mode SS
+*/
+void showModeSS() {
+  // Read the seconds from RTC, as BCD
+  if (rtc.rtcOk) {
+    // Read seconds
+    uint8_t bcdSS = rtc.readSecondsBCD();
+    if (not mtxChanged(bcdSS))
+      return;
+    // Convert to unpacked BCD, colon and 2 digits
+    uint8_t data[] = {0xFF, 0xFF, 0x0A, (uint8_t)(bcdSS / 0x10), (uint8_t)(bcdSS % 0x10)};
+    // Print on framebuffer
+    mtxPrint(data, sizeof(data) / sizeof(*data));
+    // Print to console
+    if (not cfgData.scqt) {
+      Serial.print(F("*O")); Serial.print(MODE_SS); Serial.print(F(": "));
+      Serial.print(data[3], 10); Serial.print(data[4], 10); Serial.println();
+    }
+  }
+}
+
+/**
+  Display mode DDMM
+*/
+void showModeDDMM() {
+  // The date changes at midnight, on the minute the Alarm 2 flags
+  if (not rtc.rtcOk or not ((rtcAlarms & 0x02) or mtxDisplayNow))
+    return;
+  rtcAlarms &= ~0x02;
+  // Read the full RTC time and date
+  if (rtc.readTime(true)) {
+    if (not mtxChanged((rtc.d << 8) | rtc.m))
+      return;
+    // Convert to unpacked BCD, day (2 digits), dot, month (2 digits)
+    uint8_t data[] = {(uint8_t)(rtc.d / 10), (uint8_t)(rtc.d % 10), 0x0B, (uint8_t)(rtc.m / 10), (uint8_t)(rtc.m % 10)};
+    // Print on framebuffer
+    mtxPrint(data, sizeof(data) / sizeof(*data));
+    // Print to console
+    if (not cfgData.scqt) {
+      Serial.print(F("*O")); Serial.print(MODE_DDMM); Serial.print(F(": "));
+      Serial.print(data[0], 10); Serial.print(data[1], 10); Serial.print(F("."));
+      Serial.print(data[3], 10); Serial.print(data[4], 10); Serial.println();
+    }
+  }
+}
+
+/**
+  Check and display mode YY
+*/
+void showModeYY() {
+  // The date changes at midnight, on the minute the Alarm 2 flags
+  if (not rtc.rtcOk or not ((rtcAlarms & 0x02) or mtxDisplayNow))
+    return;
+  rtcAlarms &= ~0x02;
+  // Read the full RTC time and date
+  if (rtc.readTime(true)) {
+    if (not mtxChanged(rtc.Y))
+      return;
+    // Convert to unpacked BCD, 4 digits
+    uint8_t data[] = {(uint8_t)(rtc.Y / 1000), (uint8_t)((rtc.Y % 1000) / 100), (uint8_t)((rtc.Y % 100) / 10), (uint8_t)(rtc.Y % 10)};
+    // Print on framebuffer
+    mtxPrint(data, sizeof(data) / sizeof(*data));
+    // Print to console
+    if (not cfgData.scqt) {
+      Serial.print(F("*O")); Serial.print(MODE_YY); Serial.print(F(": "));
+      Serial.println(rtc.Y);
+    }
+  }
+}
+
+/**
+  Display the mode TEMP
+*/
+void showModeTEMP() {
+  // Get the temperature
+  int8_t temp = rtc.readTemperature(cfgData.tmpu);
+  if (not mtxChanged(((uint16_t)cfgData.tmpu << 8) | (uint8_t)temp))
+    return;
+  // Absolute value
+  uint8_t atemp = abs(temp);
+  if (atemp >= 100) {
+    // Create an array with the sign, value (3 digits) the degree symbol and units letter
+    uint8_t data[] = {(uint8_t)(temp < 0 ? 0x0E : 0xFF), (uint8_t)(atemp / 100), (uint8_t)((atemp % 100) / 10), (uint8_t)(atemp % 10), 0x0D, (uint8_t)(cfgData.tmpu ? 0x0C : 0x0F)};
+    // Print on framebuffer
+    mtxPrint(data, sizeof(data) / sizeof(*data));
+  }
+  else {
+    // Create an array with the sign, value (2 digits) the degree symbol and units letter
+    uint8_t data[] = {(uint8_t)(temp < 0 ? 0x0E : 0xFF), (uint8_t)(atemp / 10), (uint8_t)(atemp % 10), 0x0D, (uint8_t)(cfgData.tmpu ? 0x0C : 0x0F)};
+    // Print on framebuffer
+    mtxPrint(data, sizeof(data) / sizeof(*data));
+  }
+  // Print to console
+  if (not cfgData.scqt) {
+    Serial.print(F("*O")); Serial.print(MODE_TEMP); Serial.print(F(": "));
+    Serial.print(temp); Serial.println(cfgData.tmpu ? "C" : "F");
+  }
+}
+/**
+  Check and display mode VCC (supply voltage)
+*/
+void showModeVCC() {
   // Get the Vcc, mV
   int16_t vcc = readVcc(cfgData.kvcc);
+  if (not mtxChanged(vcc))
+    return;
   // Create an array with the value in Volts, with decimal dot
-  uint8_t data[] = {vcc / 1000, 0x0B, (vcc % 1000) / 100, (vcc % 100) / 10, vcc % 10};
+  uint8_t data[] = {(uint8_t)(vcc / 1000), 0x0B, (uint8_t)((vcc % 1000) / 100), (uint8_t)((vcc % 100) / 10), (uint8_t)(vcc % 10)};
   // Print on framebuffer
-  mtx.fbPrint(data, sizeof(data) / sizeof(*data));
+  mtxPrint(data, sizeof(data) / sizeof(*data));
   // Print to console
   if (not cfgData.scqt) {
     Serial.print(F("*O")); Serial.print(MODE_VCC); Serial.print(F(": "));
@@ -645,60 +2292,356 @@ void showModeVCC() {
 }
 
 /**
-  Check and display mode MCU (MCU temperature)
+  Check and display mode MCU (MCU temperature)
+*/
+void showModeMCU() {
+  // Get the MCU temperature
+  int16_t temp = readMCUTemp(cfgData.ktmp);
+  // Convert to Fahrenheit, if required
+  if (not cfgData.tmpu)
+    temp = (int16_t)((float)temp / 100 * 1.8 + 32.0);
+  else
+    // Use integer Celsius degrees
+    temp /= 100;
+  if (not mtxChanged(((uint32_t)cfgData.tmpu << 16) | (uint16_t)temp))
+    return;
+  // Absolute value
+  uint16_t atemp = abs(temp);
+  if (atemp >= 100) {
+    // Create an array with the sign, value (3 digits) the degree symbol and units letter
+    uint8_t data[] = {(uint8_t)(temp < 0 ? 0x0E : 0xFF), (uint8_t)(atemp / 100), (uint8_t)((atemp % 100) / 10), (uint8_t)(atemp % 10), 0x0D, (uint8_t)(cfgData.tmpu ? 0x0C : 0x0F)};
+    // Print on framebuffer
+    mtxPrint(data, sizeof(data) / sizeof(*data));
+  }
+  else {
+    // Create an array with the sign, value (2 digits) the degree symbol and units letter
+    uint8_t data[] = {(uint8_t)(temp < 0 ? 0x0E : 0xFF), (uint8_t)(atemp / 10), (uint8_t)(atemp % 10), 0x0D, (uint8_t)(cfgData.tmpu ? 0x0C : 0x0F)};
+    // Print on framebuffer
+    mtxPrint(data, sizeof(data) / sizeof(*data));
+  }
+  // Print to console
+  if (not cfgData.scqt) {
+    Serial.print(F("*O")); Serial.print(MODE_MCU); Serial.print(F(": "));
+    Serial.print(temp); Serial.println(cfgData.tmpu ? "C" : "F");
+  }
+}
+
+/**
+  Display mode CHRN or CNTD: the chronograph or the time left as
+  MM:SS.hh, using the tiny font to fit
+*/
+void showModeChrono() {
+  uint8_t t = chrSelect();
+  uint32_t x = chrRead(t);
+  if (t == CHR_CNTD)
+    x = x < chrPreset ? chrPreset - x : 0UL;
+  // Entering the mode or the font was changed
+  if (mtxDisplayNow)
+    mtx.loadFont(fontTiny);
+  if (not mtxChanged(x))
+    return;
+  uint8_t mm = (x / 6000) % 100;
+  uint8_t ss = (x / 100) % 60;
+  uint8_t hh = x % 100;
+  uint8_t data[] = {(uint8_t)(mm / 10), (uint8_t)(mm % 10), 0x0A, (uint8_t)(ss / 10), (uint8_t)(ss % 10), 0x0B,
+                    (uint8_t)(hh / 10), (uint8_t)(hh % 10)};
+  // Print on framebuffer, only the changed digits are sent
+  mtxPrint(data, sizeof(data) / sizeof(*data));
+  // Print to console, not while running
+  if (not cfgData.scqt and not (chrRun & _BV(t))) {
+    Serial.print(F("*O")); Serial.print(mtxMode); Serial.print(F(": "));
+    chrPrint(x); Serial.println();
+  }
+}
+
+/**
+  Print the framebuffer as ASCII art, the top row and the leftmost
+  column first, then the SPI traffic: the bytes and the time of the
+  last flush and the total bytes
+*/
+void mtxDump() {
+  for (int8_t row = 7; row >= 0; row--) {
+    for (int8_t col = MATRICES * SCANLIMIT - 1; col >= 0; col--)
+      Serial.write(bitRead(mtx.fbData[col], row) ? '#' : '.');
+    Serial.println();
+  }
+  mtxReport();
+}
+
+/**
+  Print the SPI traffic, the register scrubber traffic, the SPI clock
+  and the devices found by the chain self-test
+*/
+void mtxReport() {
+  Serial.print(F("*Q: ")); Serial.print(mtx.frameBytes);
+  Serial.print(F(" "));    Serial.print(mtx.frameTime);
+  Serial.print(F("us "));  Serial.print(mtx.spiBytes);
+  Serial.print(F(", scrub ")); Serial.print(mtx.scrubBytes);
+  Serial.print(F(", "));   Serial.print(mtx.speed());
+  Serial.print(F("Hz, chain "));
+  if (mtxChain == CHAIN_FAULT)  Serial.println(F("fault"));
+  else                          Serial.println(mtxChain);
+}
+
+/**
+  Print the frame write latency of each chain on the bus: last, average
+  and maximum
+*/
+void arbReport() {
+  for (uint8_t c = 0; c < arb.chains; c++) {
+    Serial.print(F("*QL")); Serial.print(c);
+    Serial.print(F(": "));  Serial.print(arb.stats[c].last);
+    Serial.print(F(" "));   Serial.print(arb.stats[c].avg);
+    Serial.print(F(" "));   Serial.print(arb.stats[c].max);
+    Serial.print(F("us, ")); Serial.print(arb.stats[c].cnt);
+    Serial.println(F(" writes"));
+  }
+}
+
+#ifdef MTX2_CS_PIN
+/**
+  Display the temperature on the second chain, at its own pace, with
+  the brightness and the night state of the main chain
+*/
+void showChain2(uint32_t now) {
+  if (now - mtx2DisplayLast < mtx2DisplayWait)
+    return;
+  mtx2DisplayLast = now;
+  mtx2.intensity(mtx.level());
+  mtx2.shutdown(ngtState == NGT_OFF);
+  if (not rtc.rtcOk)
+    return;
+  // The sign, value (2 digits) the degree symbol and units letter, as in TEMP mode
+  int8_t temp = rtc.readTemperature(cfgData.tmpu);
+  uint8_t atemp = abs(temp) % 100;
+  uint8_t data[] = {(uint8_t)(temp < 0 ? 0x0E : 0xFF), (uint8_t)(atemp / 10), (uint8_t)(atemp % 10), 0x0D, (uint8_t)(cfgData.tmpu ? 0x0C : 0x0F)};
+  mtx2.fbPrint(data, sizeof(data) / sizeof(*data));
+}
+#endif
+
+/**
+  Set the framebuffer streaming mode
+
+  @param mode off, mirror or ingest
+*/
+void mirSetMode(uint8_t mode) {
+  mirMode     = mode;
+  mirKeyLeft  = 0;
+  mirState    = MIR_SYNC;
+  mirRcvLast  = millis();
+  mirPlus     = 0;
+  mirCount    = 0;
+  mirCountLast = 0;
+  // Ingested frames start from a clean framebuffer, the modes draw again after
+  if (mode == MIR_INGEST)
+    mtx.fbClear();
+  else
+    mtxDisplayNow = true;
+}
+
+/**
+  Mirror the last presented frame, if there is room in the serial
+  transmit buffer; a skipped frame is covered by the next delta
+*/
+void mirSend() {
+  const uint8_t* fb = mtx.fbFront();
+  const uint8_t n = MATRICES * SCANLIMIT;
+  if (Serial.availableForWrite() < MIR_MAX)
+    return;
+  bool key = (mirKeyLeft == 0);
+  uint8_t pkt[MIR_MAX];
+  uint8_t len = 3;
+  uint8_t end = 3;
+  for (uint8_t i = 0; i < n;) {
+    uint8_t j = i;
+    if ((fb[i] ^ (key ? 0 : mirPrev[i])) == 0) {
+      // Unchanged bytes
+      while (j < n and j - i < 128 and (fb[j] ^ (key ? 0 : mirPrev[j])) == 0)
+        j++;
+      pkt[len++] = 0x80 | (j - i - 1);
+    }
+    else {
+      // Changed bytes, XOR
+      uint8_t ctl = len++;
+      while (j < n and j - i < 128 and (fb[j] ^ (key ? 0 : mirPrev[j])) != 0) {
+        pkt[len++] = fb[j] ^ (key ? 0 : mirPrev[j]);
+        j++;
+      }
+      pkt[ctl] = j - i - 1;
+      // The trailing unchanged bytes are not sent
+      end = len;
+    }
+    i = j;
+  }
+  mirFrames = mtx.frames;
+  // Nothing changed
+  if (end == 3 and not key)
+    return;
+  pkt[0] = MIR_SYNC_BYTE;
+  pkt[1] = key ? MIR_KEY : MIR_DELTA;
+  pkt[2] = end - 3;
+  uint8_t crc = 0;
+  for (uint8_t i = 1; i < end; i++)
+    crc = CRC8(crc, pkt[i]);
+  pkt[end++] = crc;
+  Serial.write(pkt, end);
+  memcpy(mirPrev, fb, n);
+  mirKeyLeft = key ? MIR_KEYS : mirKeyLeft - 1;
+  mirCount++;
+}
+
+/**
+  Decode one byte of the ingested stream, straight into the framebuffer.
+  The frame is presented if the packet is valid, else dropped.
+
+  @param b the byte received
+*/
+void mirIngest(uint8_t b) {
+  uint32_t now = millis();
+  bool gap = (now - mirRcvLast >= mirGuard);
+  mirRcvLast = now;
+  // The escape sequence, "+++" after the guard time
+  if (b == '+' and (mirPlus ? mirPlus < 3 : gap))
+    mirPlus++;
+  else
+    mirPlus = 0;
+  // A packet is never paused that long, drop it and wait for the next
+  if (gap and mirState != MIR_SYNC) {
+    mtx.fbRevert();
+    mirErrors++;
+    mirState = MIR_SYNC;
+  }
+  switch (mirState) {
+    case MIR_SYNC:
+      if (b == MIR_SYNC_BYTE)
+        mirState = MIR_TYPE;
+      break;
+    case MIR_TYPE:
+      mirType  = b;
+      mirCrc   = CRC8(0, b);
+      mirBad   = (b > MIR_END);
+      mirState = MIR_LEN;
+      break;
+    case MIR_LEN:
+      mirLeft  = b;
+      mirCrc   = CRC8(mirCrc, b);
+      mirPos   = 0;
+      if (mirType == MIR_KEY)
+        mtx.fbClear();
+      mirState = mirLeft ? MIR_CTL : MIR_CRC;
+      break;
+    case MIR_CTL:
+      mirCrc = CRC8(mirCrc, b);
+      mirLeft--;
+      if (b & 0x80) {
+        mirPos  += (b & 0x7F) + 1;
+        mirState = mirLeft ? MIR_CTL : MIR_CRC;
+      }
+      else if (mirLeft) {
+        mirRun   = b + 1;
+        mirState = MIR_LIT;
+      }
+      else {
+        mirBad   = true;
+        mirState = MIR_CRC;
+      }
+      break;
+    case MIR_LIT:
+      mirCrc = CRC8(mirCrc, b);
+      mirLeft--;
+      if (mirPos < MATRICES * SCANLIMIT)
+        mtx.fbData[mirPos] ^= b;
+      else
+        mirBad = true;
+      mirPos++;
+      if (--mirRun == 0)
+        mirState = mirLeft ? MIR_CTL : MIR_CRC;
+      else if (mirLeft == 0) {
+        mirBad   = true;
+        mirState = MIR_CRC;
+      }
+      break;
+    case MIR_CRC:
+      mirState = MIR_SYNC;
+      if (mirBad or b != mirCrc) {
+        mtx.fbRevert();
+        mirErrors++;
+      }
+      else if (mirType == MIR_END)
+        mirSetMode(MIR_OFF);
+      else {
+        ledLimit();
+        mtx.fbPresent();
+        mirCount++;
+      }
+      break;
+  }
+}
+
+/**
+  Stream the frames and keep the frame rate
+
+  @param now the current millis()
 */
-void showModeMCU() {
-  // Get the MCU temperature
-  int16_t temp = readMCUTemp(cfgData.ktmp);
-  // Convert to Fahrenheit, if required
-  if (not cfgData.tmpu)
-    temp = (int16_t)((float)temp / 100 * 1.8 + 32.0);
-  else
-    // Use integer Celsius degrees
-    temp /= 100;
-  // Absolute value
-  uint16_t atemp = abs(temp);
-  if (atemp >= 100) {
-    // Create an array with the sign, value (3 digits) the degree symbol and units letter
-    uint8_t data[] = {temp < 0 ? 0x0E : 0xFF, atemp / 100, (atemp % 100) / 10, atemp % 10, 0x0D, cfgData.tmpu ? 0x0C : 0x0F};
-    // Print on framebuffer
-    mtx.fbPrint(data, sizeof(data) / sizeof(*data));
+void mirTick(uint32_t now) {
+  if (mirMode == MIR_MIRROR and mtx.frames != mirFrames)
+    mirSend();
+  else if (mirMode == MIR_INGEST and (now - mirRcvLast >= mirRcvWait))
+    // The host is gone
+    mirSetMode(MIR_OFF);
+  else if (mirMode == MIR_INGEST and mirPlus == 3 and (now - mirRcvLast >= mirGuard)) {
+    // Escaped, back to the console
+    mirSetMode(MIR_OFF);
+    Serial.println(F("OK"));
   }
-  else {
-    // Create an array with the sign, value (2 digits) the degree symbol and units letter
-    uint8_t data[] = {temp < 0 ? 0x0E : 0xFF, atemp / 10,  atemp % 10, 0x0D, cfgData.tmpu ? 0x0C : 0x0F};
-    // Print on framebuffer
-    mtx.fbPrint(data, sizeof(data) / sizeof(*data));
-  }
-  // Print to console
-  if (not cfgData.scqt) {
-    Serial.print(F("*O")); Serial.print(MODE_MCU); Serial.print(F(": "));
-    Serial.print(temp); Serial.println(cfgData.tmpu ? "C" : "F");
+  if (now - mirSecLast >= 1000UL) {
+    mirSecLast   = now;
+    mirFps       = mirCount - mirCountLast;
+    mirCountLast = mirCount;
   }
 }
 
+/**
+  Print the streaming mode, the frame rate, the frames streamed and
+  the bad packets ingested
+*/
+void mirReport() {
+  Serial.print(F("*J: "));    Serial.print(mirMode);
+  Serial.print(F(", "));      Serial.print(mirFps);
+  Serial.print(F("fps, "));   Serial.print(mirCount);
+  Serial.print(F(" frames, ")); Serial.print(mirErrors);
+  Serial.println(F(" errors"));
+}
+
+/**
+  Self-test the matrices chain through the loopback of the last DOUT to
+  MISO, then use the fastest SPI clock the chain passes the test at.
+  Without the loopback nothing is found and the default clock is kept;
+  a broken module is reported as a fault.
+
+  @return true if the chain has the configured devices
+*/
+bool mtxTune() {
+  mtxChain = mtx.chainTest(SPI_SPEED);
+  if (mtxChain == MATRICES)
+    mtx.tune();
+#ifdef MTX2_CS_PIN
+  // The second chain has no loopback, it runs at the clock of the main one
+  mtx2.speed(mtx.speed());
+#endif
+  return mtxChain == MATRICES;
+}
+
 /**
   Display Version
 */
 void showModeVers() {
   // Local buffer
-  uint8_t data[16] = "";
+  char text[16] = "";
   // Get the data from PROGMEM
-  strncpy_P(data, VERSION, 16);
-  // Convert the characters
-  uint8_t i;
-  for (i = 0; i < 16; i++) {
-    if (data[i] == 0)
-      break;
-    else if (data[i] == '.')
-      data[i] = 0x0B;
-    else if (isdigit(data[i]))
-      data[i] -= '0';
-    else
-      data[i] = 0xFF;
-  }
+  strncpy_P(text, VERSION, sizeof(text) - 1);
   // Print on framebuffer, right-aligned
-  mtx.fbPrint(data, i, mtx.RIGHT);
+  mtxPrint(text, DotMatrix::RIGHT);
 }
 
 /**
@@ -707,10 +2650,15 @@ void showModeVers() {
   @param mode the chosen mode
 */
 void mtxSetMode(uint8_t mode) {
+  uint8_t last = mtxMode;
   if (mode == 0xFF) mode = MODE_ALL - 1;
   mtxMode = mode % MODE_ALL;
-  if (mtxMode <= MODE_SS) mtxModeUntil =  0UL;                    // Never expire for HHMM and SS
-  else                    mtxModeUntil =  millis() + mtxModeWait; // Expire after a while
+  // Never expire for HHMM, SS, timers and split, expire after a while for the others
+  mtxModeExp  = mtxMode >= MODE_DDMM and mtxMode <= MODE_MCU;
+  mtxModeLast = millis();
+  // Leaving the split mode or the timers, restore the font
+  if (last >= MODE_CHRN and last <= MODE_SPLT and mtxMode <= MODE_MCU)
+    mtx.loadFont(cfgData.font);
   // Force display
   mtxDisplayNow = true;
 }
@@ -731,43 +2679,56 @@ void mtxPrevMode() {
 
 /**
   AT-Hayes style command processing
+
+  The line is always null terminated and the bytes after the terminator
+  are always null, so the parsers can not read stale characters.  A line
+  longer than the buffer is discarded up to the EOL and answered with
+  ERROR, other control characters are dropped.
 */
 void handleHayes() {
-  char c;
-  // Read from serial only if there is room in buffer
-  if (len < 64) {
-    c = Serial.read();
-    // Check if we have a valid character
-    if (c >= 0) {
-      // Uppercase
-      c = toupper(c);
-      // Local terminal command mode echo
-      if (cfgData.echo)
-        Serial.write(c);
-      // Check the character
-      if (c == '\b' and len > 0)
-        // Backspace
-        len--;
-      else
-        // Append to buffer
-        buf[len++] = c;
-      // Check for EOL
-      if (c == '\r' or c == '\n') {
-        // Flush the rest
-        Serial.flush();
-        // Send the newline
-        Serial.println(F("\r\n"));
-        // Make sure the last char is null
-        buf[--len] = '\0';
-        // Check the line length before processing
-        if (len > 0)
-          // Parse the line
-          doCommand();
-        // Reset the buffer length
-        len = 0;
-      }
-    }
+  // Read as integer, the bytes over 0x7F are not negative
+  int16_t c = Serial.read();
+  // Check if we have a valid character
+  if (c < 0)
+    return;
+  // Uppercase
+  c = toupper(c);
+  // Local terminal command mode echo
+  if (cfgData.echo)
+    Serial.write(c);
+  // Check for EOL
+  if (c == '\r' or c == '\n') {
+    // Keep the time
+    hayesRcv = millis();
+    // Flush the rest
+    Serial.flush();
+    // Send the newline
+    Serial.println(F("\r\n"));
+    if (hayesOvf)
+      // The line has been truncated, do not run any part of it
+      Serial.println(F("ERROR"));
+    else if (len > 0)
+      // Parse the line
+      doCommand();
+    // Clear the buffer and reset the buffer length
+    memset(buf, 0, sizeof(buf));
+    len = 0;
+    hayesOvf = false;
   }
+  else if (c == '\b' or c == 0x7F) {
+    // Backspace or delete
+    if (len > 0)
+      buf[--len] = '\0';
+  }
+  else if (c < ' ')
+    // Drop the other control characters, a null would cut the line
+    return;
+  else if (len < (int8_t)sizeof(buf) - 1)
+    // Append to buffer, keeping room for the terminator
+    buf[len++] = c;
+  else
+    // No room, discard the line
+    hayesOvf = true;
 }
 
 void doCommand() {
@@ -778,9 +2739,8 @@ void doCommand() {
 
   // Jump over those two chars from the start
   idx = pch - buf + 2;
-  // New line, just "AT"
-  if (len <= 2)
-    result = true;
+  // Each command fails unless parsed; new line, just "AT"
+  result = len <= 2;
 
   // Check the first character, could be a symbol or a letter
   switch (buf[idx++]) { // idx++ -> 1
@@ -831,6 +2791,39 @@ void doCommand() {
           }
           break;
 
+        // Chronograph and countdown
+        case 'C':
+          if (len == idx or buf[idx] == '?') {
+            chrReport();
+            result = true;
+          }
+          else if (buf[idx] == '=') {
+            // Countdown preset, seconds
+            int16_t secs = getValidInteger(buf, idx, 1, 5999, HAYES_NUM_ERROR);
+            if (secs != HAYES_NUM_ERROR) {
+              chrStop(CHR_CNTD);
+              chrPreset = secs * 100UL;
+              chrReset(CHR_CNTD);
+              mtxSetMode(MODE_CNTD);
+              result = true;
+            }
+          }
+          else if (buf[idx] == '1') {
+            chrStart(chrSelect());
+            result = true;
+          }
+          else if (buf[idx] == '0') {
+            chrStop(chrSelect());
+            result = true;
+          }
+          else if (buf[idx] == 'L')
+            result = chrLap();
+          else if (buf[idx] == 'R') {
+            chrReset(chrSelect());
+            result = true;
+          }
+          break;
+
         // DST switch
         case 'D':
           if (buf[idx] == '?') {
@@ -979,6 +2972,248 @@ void doCommand() {
           }
           break;
 
+        // Data logger interval and dump
+        case 'G':
+          if (buf[idx] == '?') {
+            // Get the interval
+            Serial.print(F("*G: ")); Serial.println(cfgData.lgiv);
+            result = true;
+          }
+          else if (buf[idx] == 'D') {
+            // Dump the records
+            logDump();
+            result = eep.eepOk;
+          }
+          else {
+            // Get the integer value
+            value = getValidInteger(buf, idx, 0, 60, HAYES_NUM_ERROR);
+            if (value != HAYES_NUM_ERROR) {
+              // Set the interval
+              cfgData.lgiv = value;
+              result = true;
+            }
+          }
+          break;
+
+        // Host time synchronization: the receive and transmit times, then
+        // the host time at millis() 0, to set the RTC with
+        case 'X':
+          if (len == idx) {
+            Serial.print(F("*X: ")); Serial.print(hayesRcv);
+            Serial.print(F(" "));    Serial.println(millis());
+            result = true;
+          }
+          else if (buf[idx] == '=') {
+            uint8_t i = idx + 1;
+            tsEpoch   = getLong(buf, i);
+            tsEpochMs = getLong(buf, i) % 1000;
+            result = tsEpoch > 0 and tsSync();
+          }
+          break;
+
+        // RTC drift: sync to the host time, report, clear
+        case 'Y':
+          if (len == idx or buf[idx] == '?') {
+            drfReport();
+            result = true;
+          }
+          else if (buf[idx] == '0') {
+            drfClear();
+            result = true;
+          }
+          else if (buf[idx] == '=') {
+            // Host local time, seconds since epoch and milliseconds
+            uint8_t  i   = idx + 1;
+            uint32_t sec = getLong(buf, i);
+            uint16_t ms  = getLong(buf, i) % 1000;
+            result = sec > 0 and drfSync(sec, ms, hayesRcv);
+          }
+          break;
+
+        // Frame dump and SPI traffic, clear the counter
+        case 'Q':
+          if (len == idx or buf[idx] == '?') {
+            mtxDump();
+            result = true;
+          }
+          else if (buf[idx] == '0') {
+            mtx.spiBytes   = 0;
+            mtx.scrubBytes = 0;
+            arb.reset();
+            result = true;
+          }
+          else if (buf[idx] == 'L') {
+            arbReport();
+            result = true;
+          }
+          else if (buf[idx] == 'T') {
+            // Run the chain self-test and tune the SPI clock
+            result = mtxTune();
+            mtxReport();
+          }
+          break;
+
+        // LED current budget, clear the statistics
+        case 'I':
+          if (len == idx or buf[idx] == '?') {
+            ledReport();
+            result = true;
+          }
+          else if (buf[idx] == 'R') {
+            ledPeak = 0;
+            ledAvg  = (uint32_t)ledMa << 4;
+            result = true;
+          }
+          else if (isdigit(buf[idx])) {
+            int16_t ma = getValidInteger(buf, idx, 0, 2550, -1);
+            if (ma >= 0) {
+              cfgData.ibdg = (ma + 5) / 10;
+              ledTrim = 0;
+              result = true;
+            }
+          }
+          break;
+
+        // Night mode and window
+        case 'N':
+          if (len == idx or buf[idx] == '?') {
+            ngtReport();
+            result = true;
+          }
+          else {
+            value = getValidDigit(buf, idx, 0, 2, HAYES_NUM_ERROR);
+            if (value != HAYES_NUM_ERROR) {
+              if (buf[idx + 1] == '=') {
+                // The window, first and last hour
+                uint8_t i = idx + 2;
+                uint32_t fst = getLong(buf, i);
+                uint32_t lst = getLong(buf, i);
+                if (fst > 23 or lst > 23)
+                  break;
+                cfgData.nfst = fst;
+                cfgData.nlst = lst;
+              }
+              cfgData.nmod = value;
+              ngtCheck();
+              result = true;
+            }
+          }
+          break;
+
+        // Split mode layout
+        case 'K':
+          if (len == idx or buf[idx] == '?') {
+            rgnReport();
+            result = true;
+          }
+          else {
+            value = getValidDigit(buf, idx, 1, RGN_LAYOUTS, HAYES_NUM_ERROR);
+            if (value != HAYES_NUM_ERROR) {
+              cfgData.splt = value;
+              mtxSetMode(MODE_SPLT);
+              result = true;
+            }
+          }
+          break;
+
+        // Framebuffer streaming: off, mirror, ingest, key frame
+        case 'J':
+          if (len == idx or buf[idx] == '?') {
+            mirReport();
+            result = true;
+          }
+          else if (buf[idx] == 'K') {
+            mirKeyLeft = 0;
+            result = true;
+          }
+          else {
+            value = getValidDigit(buf, idx, MIR_OFF, MIR_INGEST, HAYES_NUM_ERROR);
+            if (value != HAYES_NUM_ERROR) {
+              mirSetMode(value);
+              result = true;
+            }
+          }
+          break;
+
+        // Alarms
+        case 'W':
+          if (len == idx or buf[idx] == '?') {
+            almReport();
+            result = true;
+          }
+          else {
+            // Alarm number, then hour, minute and days of week mask
+            value = getValidDigit(buf, idx, 0, ALM_COUNT - 1, HAYES_NUM_ERROR);
+            if (value != HAYES_NUM_ERROR and buf[idx + 1] == '=') {
+              int16_t hh    = getValidInteger(buf, idx + 2, 0, 23, HAYES_NUM_ERROR);
+              int16_t mm    = getValidInteger(buf, -1, 0, 59, HAYES_NUM_ERROR);
+              int16_t days  = getValidInteger(buf, -1, 0, 127, HAYES_NUM_ERROR);
+              if (hh != HAYES_NUM_ERROR and mm != HAYES_NUM_ERROR and days != HAYES_NUM_ERROR) {
+                almData.alm[value].hh   = hh;
+                almData.alm[value].mm   = mm;
+                almData.alm[value].days = days;
+                almWriteEE();
+                almSchedule();
+                result = true;
+              }
+            }
+          }
+          break;
+
+        // Snooze, dismiss and the snooze interval
+        case 'Z':
+          if (buf[idx] == '?') {
+            Serial.print(F("*Z: ")); Serial.println(cfgData.snoz);
+            result = true;
+          }
+          else if (len == idx)
+            result = almSnooze();
+          else if (buf[idx] == 'D')
+            result = almDismiss();
+          else {
+            // Get the integer value
+            value = getValidInteger(buf, idx, 1, 30, HAYES_NUM_ERROR);
+            if (value != HAYES_NUM_ERROR) {
+              // Set the snooze interval
+              cfgData.snoz = value;
+              result = true;
+            }
+          }
+          break;
+
+#ifdef PROFILING
+        // Profiling report and reset
+        case 'P':
+          if (len == idx or buf[idx] == '?') {
+            profReport();
+            result = true;
+          }
+          else if (buf[idx] == '0') {
+            prof.reset();
+            result = true;
+          }
+          break;
+#endif
+
+        // RTC health and I2C errors
+        case 'R':
+          if (len == idx or buf[idx] == '?') {
+            Serial.print(F("*R: ")); Serial.print(rtc.rtcOk);
+            Serial.print(F(" ")); Serial.println(rtc.busClears);
+            // Only the registers with errors
+            for (uint8_t r = 0; r < RTC_REGS; r++)
+              if (rtc.errors[r]) {
+                Serial.print(r, 16); Serial.print(F(": "));
+                Serial.println(rtc.errors[r]);
+              }
+            result = true;
+          }
+          else if (buf[idx] == '0') {
+            rtc.clearErrors();
+            result = true;
+          }
+          break;
+
         // First hour to beep
         case 'S':
           if (buf[idx] == '?') {
@@ -999,8 +3234,9 @@ void doCommand() {
 
         // Time and date setting and query
         case 'T':
-          //  Usage: AT*T="YYYY/MM/DD HH:MM:SS" or, using date(1),
-          //  ( sleep 2 && date "+AT\*T=\"%Y/%m/%d %H:%M:%S\"" ) > /dev/ttyUSB0
+          //  Usage: AT*T="YYYY/MM/DD HH:MM:SS", to the second; to set the
+          //  clock from the host, to the millisecond, see AT*X and
+          //  tools/timesync.py /dev/ttyUSB0
           if (buf[idx] == '?') {
             // Get time and date
             rtc.readTime(true);
@@ -1023,14 +3259,18 @@ void doCommand() {
             if (year >= 1900  and year < 2100   and
                 month >= 1    and month <= 12   and
                 day >= 1      and day <= 31     and
-                hour >= 0     and hour <= 23    and
-                minute >= 0   and minute <= 59  and
-                second >= 0   and second <= 59 ) {
+                hour <= 23    and
+                minute <= 59  and
+                second <= 59 ) {
               // The date is quite valid, set the clock to 00:00:00 if not
               // specified
               rtc.writeDateTime(second, minute, hour, day, month, year);
               // Check if DST and set the flag
               cfgData.dst = rtc.dstCheck(year, month, day, hour);
+              // The next alarm depends on the time
+              almSchedule();
+              // The step is not known, restart the drift history
+              drfClear();
               // Store the configuration
               cfgWriteEE();
               result = true;
@@ -1100,6 +3340,7 @@ void doCommand() {
           Serial.print(F("*L: "));  Serial.print(cfgData.mnbr); Serial.print(F("; "));
           Serial.print(F("*H: "));  Serial.print(cfgData.mxbr); Serial.println(F("; "));
           Serial.print(F("*F: "));  Serial.print(cfgData.font); Serial.print(F("; "));
+          Serial.print(F("*G: "));  Serial.print(cfgData.lgiv); Serial.print(F("; "));
           Serial.print(F("*D: "));  Serial.print(cfgData.dst);  Serial.print(F("; "));
           Serial.print(F("*O: "));  Serial.print(mtxMode);      Serial.print(F("; "));
           Serial.print(F("*U: "));  Serial.print(cfgData.tmpu ? "C" : "F"); Serial.println(F("; "));
@@ -1110,7 +3351,12 @@ void doCommand() {
           Serial.print(F("E: "));   Serial.print(cfgData.echo); Serial.print(F("; "));
           Serial.print(F("L: "));   Serial.print(cfgData.spkl); Serial.print(F("; "));
           Serial.print(F("M: "));   Serial.print(cfgData.spkm); Serial.print(F("; "));
-          Serial.print(F("Q: "));   Serial.print(cfgData.scqt); Serial.println(F("; "));
+          Serial.print(F("Q: "));   Serial.print(cfgData.scqt); Serial.print(F("; "));
+          Serial.print(F("*Z: "));  Serial.print(cfgData.snoz); Serial.print(F("; "));
+          Serial.print(F("*I: "));  Serial.print(cfgData.ibdg * 10); Serial.print(F("; "));
+          Serial.print(F("*N: "));  Serial.print(cfgData.nmod); Serial.print(F(" "));
+          Serial.print(cfgData.nfst); Serial.print(F("..")); Serial.print(cfgData.nlst); Serial.print(F("; "));
+          Serial.print(F("*K: "));  Serial.print(cfgData.splt); Serial.println(F("; "));
           result = true;
           break;
 
@@ -1171,6 +3417,8 @@ void doCommand() {
           if (rqInfo & 0x01) print_P(AUTHOR,  true);  rqInfo = rqInfo >> 1;
           if (rqInfo & 0x01) print_P(DATE,    true);  rqInfo = rqInfo >> 1;
           if (rqInfo & 0x01) Serial.println(cfgData.crc8, 16);  rqInfo = rqInfo >> 1;
+          if (rqInfo & 0x01) wdtReport();                       rqInfo = rqInfo >> 1;
+          if (rqInfo & 0x01) memReport();                       rqInfo = rqInfo >> 1;
         }
       }
       break;
@@ -1262,17 +3510,32 @@ void doCommand() {
 
       Serial.println(F("Auto brightness             *An   0..1"));
       Serial.println(F("Brightness level            *Bn   0..15"));
+      Serial.println(F("Chronograph, countdown      *Cn   0..1,L,R    stop/start, lap, reset; =s preset"));
       Serial.println(F("DST switch                  *Dn   0..1"));
       Serial.println(F("Latest hour to beep         *En   0..23"));
       Serial.println(F("Display font                *Fn   0..15"));
+      Serial.println(F("Data logger interval        *Gn   0..60       minutes, D to dump"));
       Serial.println(F("Maximum auto brightness     *Hn   0..15"));
+      Serial.println(F("LED current budget, reset   *In   0..2550 R   mA, 0 for none"));
+      Serial.println(F("Frame streaming, key frame  *Jn   0..2 K      off, mirror, ingest (escape +++); tools/fbstream.py"));
+      Serial.println(F("Split mode layout           *Kn   1..3        HH:MM+bar, HH:MM+temp, HH:MM :SS"));
       Serial.println(F("Lowest auto brightness      *Ln   0..15"));
       Serial.println(F("MCU temperature correction  *Mn   -127..127   T+273.15-ADC"));
-      Serial.println(F("Display mode selection      *On   0..15       HHMM,SS,DDMM,YY,TMP,VCC,MCU"));
+      Serial.println(F("Night mode, window          *Nn=f,l   0..2    none, off, dim; first, last hour"));
+      Serial.println(F("Display mode selection      *On   0..9        HHMM,SS,DDMM,YY,TMP,VCC,MCU,CHR,CNT,SPL"));
+#ifdef PROFILING
+      Serial.println(F("Profiling report, reset     *P    0           count min/mean/max | histogram"));
+#endif
+      Serial.println(F("Frame dump, clear, SPI test *Q    0,T,L       ASCII art; last bytes, us; total; scrub; clock; chain; latency"));
+      Serial.println(F("RTC health, clear errors    *R    0           ok bus-clears, errors by register"));
       Serial.println(F("First hour to beep          *Sn   0..23"));
       Serial.println(F("Time and date setting       *T=\"YYYY/MM/DD HH:MM:SS\""));
       Serial.println(F("Temperature units           *Uc   C/F"));
       Serial.println(F("Supply voltage correction   *Vn   -127..127   V*ADC/1.1/1024-1000"));
+      Serial.println(F("Alarms                      *Wn=h,m,d 0..3    d: days mask, bit 0 Monday"));
+      Serial.println(F("Host time sync              *X=s,ms           tools/timesync.py"));
+      Serial.println(F("RTC drift sync, clear       *Y=s,ms   0       host local time since epoch"));
+      Serial.println(F("Snooze, dismiss, interval   *Zn   D,1..30     minutes"));
       result = true;
       break;
 
@@ -1303,11 +3566,35 @@ bool checkDST() {
     cfgData.dst ^= 1;
     // Save the config
     cfgWriteEE();
+    // The next alarm depends on the time
+    almSchedule();
     return true;
   }
   return false;
 }
 
+/**
+  Keep the active stage before entering a nested one
+*/
+void stgPush() {
+  if (stgDepth < STG_DEPTH)
+    stgStack[stgDepth] = wdtStage;
+  stgDepth++;
+}
+
+/**
+  Restore the enclosing stage when leaving one; past the stack depth,
+  the stage left is kept as active
+
+  @param stage the stage left
+*/
+void stgPop(uint8_t stage) {
+  if (stgDepth == 0)
+    return;
+  stgDepth--;
+  wdtStage = (stgDepth < STG_DEPTH) ? stgStack[stgDepth] : stage;
+}
+
 /**
   Print the banner to serial console
 */
@@ -1317,6 +3604,111 @@ void showBanner() {
   print_P(VERSION, true);
 }
 
+/**
+  Watchdog interrupt: keep the stage that stalled the loop, the
+  watchdog will reset the MCU on the next timeout
+*/
+ISR(WDT_vect) {
+  wdtInfo.stage = wdtStage;
+  wdtInfo.count++;
+}
+
+/**
+  Check the watchdog stall record, which is not initialized at reset,
+  and clear it if not valid (power on)
+*/
+void wdtCheck() {
+  if (wdtInfo.magic != WDT_MAGIC or wdtInfo.check != (uint8_t)~WDT_MAGIC) {
+    wdtInfo.magic = WDT_MAGIC;
+    wdtInfo.check = (uint8_t)~WDT_MAGIC;
+    wdtInfo.stage = STG_SETUP;
+    wdtInfo.count = 0;
+  }
+}
+
+/**
+  Print the watchdog stall record
+*/
+void wdtReport() {
+  Serial.print(F("WDT: ")); Serial.print(wdtInfo.count);
+  if (wdtInfo.count) {
+    Serial.print(F(" "));
+    for (uint8_t c = 0; c < 4; c++)
+      Serial.write(pgm_read_byte(&stgNames[wdtInfo.stage * 4 + c]));
+  }
+  Serial.println();
+}
+
+/**
+  Paint the RAM between the static data and the stack, before the
+  constructors and setup() run.  It is naked and placed in .init3,
+  after the zero register and the stack pointer have been set up.
+*/
+void memPaint() {
+  uint8_t *p = (uint8_t*)&__heap_start;
+  while (p < (uint8_t*)SP)
+    *p++ = MEM_PAINT;
+}
+
+/**
+  Get the bytes the stack has never reached, counting the intact paint
+  down from the stack towards the heap
+
+  @return the unused bytes, zero if the stack has met the heap
+*/
+uint16_t memUnused() {
+  uint8_t *p = (uint8_t*)(__brkval ? __brkval : &__heap_start);
+  uint16_t n = 0;
+  while (p < (uint8_t*)SP and *p == MEM_PAINT) {
+    p++;
+    n++;
+  }
+  return n;
+}
+
+/**
+  Print the static section sizes, the heap, the current gap between
+  the heap and the stack, and the stack high-water margin
+*/
+void memReport() {
+  char *heap = __brkval ? __brkval : &__heap_start;
+  Serial.print(F("MEM: data "));  Serial.print(&__data_end   - &__data_start);
+  Serial.print(F(" bss "));       Serial.print(&__bss_end    - &__bss_start);
+  Serial.print(F(" noinit "));    Serial.print(&__noinit_end - &__noinit_start);
+  Serial.print(F(" heap "));      Serial.print(heap          - &__heap_start);
+  Serial.print(F(" free "));      Serial.print((char*)SP     - heap);
+  Serial.print(F(" unused "));    Serial.println(memUnused());
+}
+
+/**
+  Turn the watchdog off, before the constructors and setup() run.  After
+  a watchdog reset it stays on, at its shortest timeout, unless the
+  bootloader turns it off, and would reset the MCU again in the delays
+  of setup(); it is armed again at the end of setup().  It is naked and
+  placed in .init3, as memPaint().
+*/
+void wdtOff() {
+  MCUSR &= ~_BV(WDRF);
+  wdt_disable();
+}
+
+/**
+  Arm the watchdog in interrupt and reset mode
+*/
+void wdtArm() {
+  wdt_enable(WDTO_4S);
+  WDTCSR |= _BV(WDIE);
+}
+
+/**
+  Feed the watchdog and re-enable its interrupt, which the hardware
+  clears when it fires
+*/
+void wdtFeed() {
+  wdt_reset();
+  WDTCSR |= _BV(WDIE);
+}
+
 /**
   Software reset the MCU
   (c) Mircea Diaconescu http://web-engineering.info/node/29
@@ -1341,6 +3733,13 @@ void setup() {
   // Init the serial com and print the banner
   Serial.begin(9600);
   showBanner();
+  // The buzzer, driven by the chime sequencer
+  chmInit();
+  // Report the last watchdog stall, if any
+  wdtStage = STG_SETUP;
+  wdtCheck();
+  if (wdtInfo.count)
+    wdtReport();
   // Make us heard with a beep
   beep();
 
@@ -1356,8 +3755,21 @@ void setup() {
   // Start with a dummy analog read
   analogRead(A0);
 
-  // Init all led matrices
-  mtx.init(CS_PIN, MATRICES, SCANLIMIT);
+  // Init all led matrices, on the shared bus
+  arb.begin();
+#if defined(MTX_HT16K33) or defined(MTX_APA102)
+  mtx.backend(&mtxDrv);
+#endif
+  mtx.init(CS_PIN);
+  arb.attach(&mtx);
+  // Self-test the chain, if looped back, and tune the SPI clock
+  pinMode(MISO_PIN, INPUT_PULLUP);
+  if (not mtxTune() and mtxChain != CHAIN_NONE) {
+    Serial.print(F("ERROR"));
+    Serial.print(F(" Matrix chain "));
+    if (mtxChain == CHAIN_FAULT)  Serial.println(F("fault"));
+    else                          Serial.println(mtxChain);
+  }
   // Do a display test for a second
   mtx.displaytest(true);
   delay(1000);
@@ -1368,7 +3780,7 @@ void setup() {
   mtx.clear();
   // Set the brightness
   mtx.intensity(brightness());
-  brgtCheckUntil = millis();
+  brgtCheckLast = millis();
   // Power on the matrices
   mtx.shutdown(false);
 
@@ -1377,6 +3789,19 @@ void setup() {
 
   // Show version
   showModeVers();
+  arb.service();
+
+#ifdef MTX2_CS_PIN
+  // Init the second chain, at the clock of the main one
+  mtx2.init(MTX2_CS_PIN);
+  mtx2.speed(mtx.speed());
+  arb.attach(&mtx2);
+  mtx2.decodemode(0);
+  mtx2.clear();
+  mtx2.intensity(mtx.level());
+  mtx2.shutdown(false);
+  mtx2.loadFont(cfgData.font);
+#endif
 
   // Init and configure RTC
   if (! rtc.init()) {
@@ -1396,23 +3821,54 @@ void setup() {
     checkDST();
   }
 
+  // Read the alarms and program the next one, then listen to the RTC
+  // INT/SQW pin and clear any old alarm flag
+  almReadEE();
+  almSchedule();
+  // Read the drift history
+  drfReadEE();
+  drfEstimate();
+  PCMSK1 |= _BV(PCINT11);
+  PCICR  |= _BV(PCIE1);
+  rtcInt  = true;
+
+  // Start in the night mode, if in the window
+  ngtCheck();
+
+  // Find the data logger ring buffer head
+  if (eep.init())
+    logInit();
+
   // Start reading the remote
   if (!iRed.begin(IRED_PIN))
     Serial.println(F("You did not choose a valid IR pin."));
 
   // Wait a second while displaying the verion
   delay(1000);
+
+  // Supervise the main loop
+  wdtArm();
 }
 
 /**
   Main Arduino loop
 */
 void loop() {
+  // Feed the watchdog
+  wdtFeed();
+  // The loop is the outermost stage
+  stgDepth = 0;
+  wdtStage = STG_LOOP;
+  STAGE_START(STG_LOOP);
   // Check if new IR data is available
   if (iRed.available()) {
+    STAGE_START(STG_IR);
     // Get the new data from the remote
     auto data = iRed.read();
-    if (data.address == 0x728D) // Akai CD
+    if (data.address != 0xFFFF and ngtWake()) {
+      // At night, with the display off, a key only wakes it up
+    }
+    else if (data.address == 0x728D) // Akai CD
       switch (data.command) {
         case 0:
         case 1:
@@ -1427,25 +3883,25 @@ void loop() {
           mtxSetMode(data.command);
           break;
         case 0x1D:  // Next
-          if (++cfgData.font > fontCount)
+          if (++cfgData.font >= fontCount)
             cfgData.font = 0;
           mtx.loadFont(cfgData.font);
           mtxDisplayNow = true;
           break;
         case 0x1E:  // Prev
           if (cfgData.font-- == 0)
-            cfgData.font = fontCount;
+            cfgData.font = fontCount - 1;
           mtx.loadFont(cfgData.font);
           mtxDisplayNow = true;
           break;
         case 0x16:  // Prg up
-          if (cfgData.brgt <= 0x0F)
+          if (cfgData.brgt < 0x0F)
             cfgData.brgt++;
           cfgData.aubr = false;
           mtx.intensity(brightness());
           break;
         case 0x17:  // Prg dn
-          if (cfgData.brgt >= 0x00)
+          if (cfgData.brgt > 0x00)
             cfgData.brgt--;
           cfgData.aubr = false;
           mtx.intensity(brightness());
@@ -1477,25 +3933,25 @@ void loop() {
           mtxDisplayNow = true;
           break;
         case 0x00:  // Prg up
-          if (++cfgData.font > fontCount)
+          if (++cfgData.font >= fontCount)
             cfgData.font = 0;
           mtx.loadFont(cfgData.font);
           mtxDisplayNow = true;
           break;
         case 0x01:  // Prg dn
           if (cfgData.font-- == 0)
-            cfgData.font = fontCount;
+            cfgData.font = fontCount - 1;
           mtx.loadFont(cfgData.font);
           mtxDisplayNow = true;
           break;
         case 0x02:  // Vol up
-          if (cfgData.brgt <= 0x0F)
+          if (cfgData.brgt < 0x0F)
             cfgData.brgt++;
           cfgData.aubr = false;
           mtx.intensity(brightness());
           break;
         case 0x03:  // Vol dn
-          if (cfgData.brgt >= 0x00)
+          if (cfgData.brgt > 0x00)
             cfgData.brgt--;
           cfgData.aubr = false;
           mtx.intensity(brightness());
@@ -1505,7 +3961,12 @@ void loop() {
           mtx.intensity(brightness());
           break;
         case 0x44:  // OK
-          beep();
+          if (almRinging)
+            almDismiss();
+          else if (mtxMode >= MODE_CHRN and mtxMode <= MODE_CNTD)
+            chrToggle(chrSelect());
+          else
+            beep();
           break;
       }
     if (data.address != 0xFFFF) {
@@ -1516,30 +3977,100 @@ void loop() {
       Serial.println(data.command, HEX);
       Serial.println();
     }
+    STAGE_STOP(STG_IR);
   }
 
-  // Check any command on serial port
-  if (Serial.available())
-    handleHayes();
+  // Check any command on serial port, or the ingested frames
+  if (Serial.available()) {
+    STAGE_START(STG_AT);
+    if (mirMode == MIR_INGEST)
+      while (Serial.available())
+        mirIngest(Serial.read());
+    else
+      handleHayes();
+    STAGE_STOP(STG_AT);
+  }
 
   // Keep the millis
   uint32_t now = millis();
 
   // Automatic brightness check and adjustment
-  if (cfgData.aubr and (now > brgtCheckUntil)) {
-    brgtCheckUntil = now + brgtCheckWait;
+  if (cfgData.aubr and (now - brgtCheckLast >= brgtCheckWait)) {
+    brgtCheckLast = now;
+    STAGE_START(STG_BRGT);
     mtx.intensity(brightness());
+    STAGE_STOP(STG_BRGT);
+  }
+
+  // Correct the LED current cap from the supply voltage
+  if (cfgData.ibdg and (now - ledCheckLast >= ledCheckWait)) {
+    ledCheckLast = now;
+    ledCheckVcc();
+  }
+
+  // Try to recover the RTC, if down
+  if (not rtc.rtcOk and (now - rtcCheckLast >= rtcCheckWait)) {
+    rtcCheckLast = now;
+    if (rtc.probe()) {
+      // Configure it again and show the time
+      rtc.init(I2C_RTC, false);
+      almSchedule();
+      mtxDisplayNow = true;
+    }
+  }
+
+  // RTC alarms, on the INT pin interrupt, or polled while the pin outputs
+  // the square wave
+  if (rtc.rtcOk) {
+    if (chrRun ? (now - rtcPollLast >= 1000UL) : (rtcInt or digitalRead(INTSQ_PIN) == LOW)) {
+      rtcPollLast = now;
+      rtcCheckAlarms();
+    }
   }
+  // The chime ended by itself
+  if (almRinging and not chmBusy())
+    almRinging = false;
 
-  // Check the buttons and change the display mode
+  // Check the buttons: while ringing, the first one snoozes and the second
+  // one dismisses; in the timer modes, the second one starts and stops and
+  // the first one takes laps or resets, else changes the display mode
   if (btn1.pressed()) {
-    // Display the next mode
-    mtxNextMode();
+    if (almRinging)
+      almSnooze();
+    else if (not ngtWake() and (mtxMode < MODE_CHRN or mtxMode > MODE_CNTD or not chrButton()))
+      // Display the next mode
+      mtxNextMode();
+  }
+  if (btn2.pressed()) {
+    if (almRinging)
+      almDismiss();
+    else if (not ngtWake() and mtxMode >= MODE_CHRN and mtxMode <= MODE_CNTD)
+      chrToggle(chrSelect());
   }
 
-  // Display, check once in a while or force
-  if ((now > mtxDisplayUntil) or mtxDisplayNow) {
-    mtxDisplayUntil = now + mtxDisplayWait;
+  // Time is up for the countdown
+  chrCheck();
+
+  // Night mode
+  ngtTick(now);
+
+  // Display, check once in a while or force, less often at night; not
+  // while the frames are ingested
+  uint16_t poll = pgm_read_word(&mtxModePoll[mtxMode]);
+  if (ngtState != NGT_DAY and (mtxMode < MODE_CHRN or mtxMode > MODE_CNTD) and poll < NGT_POLL)
+    poll = NGT_POLL;
+  if (mirMode != MIR_INGEST and ((now - mtxDisplayLast >= poll) or mtxDisplayNow)) {
+    if (mtxMode >= MODE_CHRN and mtxMode <= MODE_CNTD and (chrRun & _BV(chrSelect())) and not mtxDisplayNow) {
+      // Keep the frame rate of the running timers, counting the missed frames
+      uint32_t frames = (now - mtxDisplayLast) / poll;
+      chrDropped += frames - 1;
+      mtxDisplayLast += frames * poll;
+    }
+    else
+      mtxDisplayLast = now;
+    STAGE_START(STG_MODE);
+    // Compose the frame, it is presented complete at the end of the stage
+    mtx.fbSync(true);
     switch (mtxMode) {
       case MODE_SS:   // Seconds
         showModeSS();
@@ -1559,15 +4090,48 @@ void loop() {
       case MODE_MCU:  // MCU temperature
         showModeMCU();
         break;
+      case MODE_CHRN: // Chronograph
+      case MODE_CNTD: // Countdown
+        showModeChrono();
+        break;
+      case MODE_SPLT: // Split
+        showModeSplit();
+        break;
       default:        // Hours and minutes
         showModeHHMM();
     }
+    // Fit the frame in the current budget, then present it
+    ledLimit();
+    mtx.fbSync(false);
+    STAGE_STOP(STG_MODE);
     // Reset the display now flag
     mtxDisplayNow = false;
   }
 
+  // Framebuffer streaming
+  mirTick(now);
+
+#ifdef MTX2_CS_PIN
+  // The second chain
+  showChain2(now);
+#endif
+
+  // Write the frames of all chains, in batches, and scrub them
+  arb.service();
+
+  // Data logger
+  if (cfgData.lgiv and eep.eepOk and
+      (logLast == 0UL or now - logLast >= cfgData.lgiv * 60000UL)) {
+    STAGE_START(STG_LOG);
+    logWrite(now);
+    STAGE_STOP(STG_LOG);
+  }
+
   // Check if the display mode expired
-  if (mtxModeUntil > 0 and now > mtxModeUntil)
+  if (mtxModeExp and (now - mtxModeLast >= mtxModeWait))
     // Return to default mode, never expiring
     mtxSetMode(MODE_HHMM);
+
+  STAGE_STOP(STG_LOOP);
+  PROF_LOOP();
 }
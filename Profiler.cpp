@@ -0,0 +1,103 @@
+/**
+  Profiler.cpp - Lightweight execution time profiler
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <Arduino.h>
+#include "Profiler.h"
+
+Profiler::Profiler() {
+  reset();
+}
+
+/**
+  Mark the start of a stage
+
+  @param stage the stage id
+*/
+void Profiler::start(uint8_t stage) {
+  if (stage < PRF_STAGES)
+    _start[stage] = micros();
+}
+
+/**
+  Mark the end of a stage and account its duration
+
+  @param stage the stage id
+*/
+void Profiler::stop(uint8_t stage) {
+  if (stage >= PRF_STAGES)
+    return;
+  uint32_t dur = micros() - _start[stage];
+  prfStage_t *s = &stages[stage];
+  // Saturate to 16 bits
+  uint16_t us = dur > 0xFFFF ? 0xFFFF : dur;
+  if (us < s->min) s->min = us;
+  if (us > s->max) s->max = us;
+  // Halve the accumulators before overflowing, keeping the mean and
+  // the shape of the histogram
+  if (s->cnt == 0xFFFF) {
+    s->cnt >>= 1;
+    s->sum >>= 1;
+    for (uint8_t b = 0; b < PRF_BUCKETS; b++)
+      s->hist[b] >>= 1;
+  }
+  s->cnt++;
+  s->sum += us;
+  // Find the histogram bucket
+  uint8_t b = 0;
+  us >>= 6;
+  while (us and b < PRF_BUCKETS - 1) {
+    us >>= 1;
+    b++;
+  }
+  s->hist[b]++;
+}
+
+/**
+  Count the main loop iterations per second
+*/
+void Profiler::loop() {
+  _loops++;
+  uint32_t now = millis();
+  if (now - _second >= 1000UL) {
+    lps = _loops;
+    _loops = 0;
+    _second = now;
+  }
+}
+
+/**
+  Clear all the statistics
+*/
+void Profiler::reset() {
+  memset(stages, 0, sizeof(stages));
+  for (uint8_t i = 0; i < PRF_STAGES; i++)
+    stages[i].min = 0xFFFF;
+}
+
+/**
+  Get the mean duration of a stage
+
+  @param stage the stage id
+  @return the mean duration, us
+*/
+uint16_t Profiler::mean(uint8_t stage) {
+  if (stage >= PRF_STAGES or stages[stage].cnt == 0)
+    return 0;
+  return stages[stage].sum / stages[stage].cnt;
+}
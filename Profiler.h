@@ -0,0 +1,56 @@
+/**
+  Profiler.h - Lightweight execution time profiler
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+#define PRF_STAGES  7     // Number of profiled stages
+#define PRF_BUCKETS 8     // Histogram buckets, powers of two starting at 64us
+
+// Per stage statistics type
+struct prfStage_t {
+  uint16_t  min;                  // Minimum duration, us
+  uint16_t  max;                  // Maximum duration, us
+  uint16_t  cnt;                  // Number of samples
+  uint32_t  sum;                  // Sum of durations, us
+  uint16_t  hist[PRF_BUCKETS];    // Histogram: <64, <128, ... <4096, more
+};
+
+
+class Profiler {
+  public:
+    Profiler();
+    void      start(uint8_t stage);
+    void      stop(uint8_t stage);
+    void      loop();
+    void      reset();
+    uint16_t  mean(uint8_t stage);
+
+    prfStage_t  stages[PRF_STAGES];
+    uint16_t    lps = 0;          // Loops per second
+
+  private:
+    uint32_t    _start[PRF_STAGES];
+    uint16_t    _loops = 0;
+    uint32_t    _second = 0;
+};
+
+#endif /* PROFILER_H */
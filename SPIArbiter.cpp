@@ -0,0 +1,108 @@
+/**
+  SPIArbiter.cpp - Shared SPI bus for several matrices chains
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "SPIArbiter.h"
+#include "DotMatrix.h"
+
+SPIArbiter::SPIArbiter() {
+  reset();
+}
+
+/**
+  Start the SPI bus, once for all chains
+*/
+void SPIArbiter::begin() {
+  pinMode(MOSI, OUTPUT);
+  pinMode(SCK, OUTPUT);
+  SPI.begin();
+}
+
+/**
+  Attach a chain, its frames are written by service() from now on
+
+  @param chain the matrices chain
+  @return the chain id, ARB_CHAINS if there is no room
+*/
+uint8_t SPIArbiter::attach(DotMatrixBase* chain) {
+  if (chains >= ARB_CHAINS)
+    return ARB_CHAINS;
+  _chains[chains] = chain;
+  chain->arbiter(this, chains);
+  return chains++;
+}
+
+/**
+  Queue a frame of a chain, keeping the time of the first one not written
+
+  @param id the chain id
+*/
+void SPIArbiter::request(uint8_t id) {
+  if (not (_queued & _BV(id))) {
+    _queued |= _BV(id);
+    _since[id] = micros();
+  }
+}
+
+/**
+  Write the queued lines of all chains and account the latencies.  The
+  chains are scrubbed on their own timer, see DotMatrixBase::scrub(),
+  even with no frame queued; the scrubbing alone is not accounted.
+
+  @return the number of lines written
+*/
+uint8_t SPIArbiter::service() {
+  uint8_t lines = 0;
+  uint8_t due = 0;
+  for (uint8_t id = 0; id < chains; id++)
+    if (_chains[id]->scrub())
+      due |= _BV(id);
+  if (not (_queued | due))
+    return 0;
+  for (uint8_t k = 0; k < chains; k++) {
+    uint8_t id = (_next + k) % chains;
+    if (not ((_queued | due) & _BV(id)))
+      continue;
+    lines += _chains[id]->fbWrite();
+    if (not (_queued & _BV(id)))
+      continue;
+    uint32_t lat = micros() - _since[id];
+    arbStats_t* st = &stats[id];
+    st->last = lat > 0xFFFF ? 0xFFFF : lat;
+    if (st->last > st->max)
+      st->max = st->last;
+    // Moving average, 1/8 of the new sample
+    st->avg = st->cnt ? st->avg - (st->avg >> 3) + (st->last >> 3) : st->last;
+    st->cnt++;
+  }
+  _queued = 0;
+  // Another chain goes first next time
+  if (++_next >= chains)
+    _next = 0;
+  return lines;
+}
+
+/**
+  Reset the latency statistics
+*/
+void SPIArbiter::reset() {
+  memset(stats, 0, sizeof(stats));
+}
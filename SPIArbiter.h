@@ -0,0 +1,63 @@
+/**
+  SPIArbiter.h - Shared SPI bus for several matrices chains
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPIARBITER_H
+#define SPIARBITER_H
+
+#include <Arduino.h>
+
+#define ARB_CHAINS  2     // Maximum number of chains on the bus
+
+// Per chain latency type, from the first queued frame to the end of its write
+struct arbStats_t {
+  uint16_t  last;                 // Latency of the last write, us
+  uint16_t  max;                  // Maximum latency, us
+  uint16_t  avg;                  // Average latency, us, moving
+  uint16_t  cnt;                  // Number of writes
+};
+
+class DotMatrixBase;
+
+/*
+  The chains attached to the arbiter do not write their frames when
+  flushed, they only queue the changed lines.  Each call of service()
+  writes the queued lines of all chains, those of a chain back-to-back
+  in a single SPI transaction, the chains in round-robin order, and
+  scrubs their control registers when due.
+*/
+class SPIArbiter {
+  public:
+    SPIArbiter();
+    void      begin();
+    uint8_t   attach(DotMatrixBase* chain);
+    void      request(uint8_t id);
+    uint8_t   service();
+    void      reset();
+
+    arbStats_t  stats[ARB_CHAINS];
+    uint8_t     chains = 0;       // Chains attached
+
+  private:
+    DotMatrixBase*  _chains[ARB_CHAINS];
+    uint32_t        _since[ARB_CHAINS];   // Time of the first queued frame
+    uint8_t         _queued = 0;          // Chains with queued lines, bitmask
+    uint8_t         _next = 0;            // Chain to write first
+};
+
+#endif /* SPIARBITER_H */
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""
+  fbstream.py - Mirror or feed the MatrixChronograph framebuffer
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: fbstream.py PORT view
+         fbstream.py PORT send FILE [FPS]
+
+  The view command turns the mirror on (AT*J1) and prints each frame as
+  ASCII art.  The send command turns the ingest on (AT*J2) and sends the
+  frames in FILE: 8 lines of 32 characters each, '#' for a lit pixel,
+  the frames separated by empty lines.  The frames are sent in a loop,
+  until interrupted.
+
+  Packet: 0xFE, type (0 key, 1 delta, 2 end), payload length, payload,
+  CRC8 (poly 0x07) of type, length and payload.  The payload is the XOR
+  delta against the previous frame, as runs: a control byte 0x80 + n - 1
+  skips n bytes, n - 1 is followed by n XOR bytes.
+"""
+
+import sys
+import time
+
+import serial
+
+BAUD = 9600
+MATRICES = 4
+SCANLIMIT = 8
+FBSIZE = MATRICES * SCANLIMIT
+SYNC = 0xFE
+KEY, DELTA, END = 0, 1, 2
+
+
+def crc8(data, crc=0):
+    """CRC8, polynomial 0x07, as on the clock"""
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def encode(frame, prev):
+    """Encode the frame as the delta against prev, None for a key frame"""
+    key = prev is None
+    delta = [f ^ (0 if key else p) for f, p in zip(frame, prev or frame)]
+    payload = []
+    end = 0
+    i = 0
+    while i < FBSIZE:
+        j = i
+        if delta[i] == 0:
+            while j < FBSIZE and j - i < 128 and delta[j] == 0:
+                j += 1
+            payload.append(0x80 | (j - i - 1))
+        else:
+            while j < FBSIZE and j - i < 128 and delta[j] != 0:
+                j += 1
+            payload.append(j - i - 1)
+            payload.extend(delta[i:j])
+            end = len(payload)
+        i = j
+    payload = payload[:end]
+    head = [KEY if key else DELTA, len(payload)]
+    return bytes([SYNC] + head + payload + [crc8(head + payload)])
+
+
+def decode(packets, frame):
+    """Apply the packets read from the port on frame, yield the frames"""
+    state = None
+    for byte in packets:
+        if state is None:
+            if byte == SYNC:
+                state = []
+            continue
+        state.append(byte)
+        if len(state) < 2 or len(state) < state[1] + 3:
+            continue
+        pkt, state = state, None
+        if crc8(pkt[:-1]) != pkt[-1]:
+            continue
+        if pkt[0] == KEY:
+            frame = [0] * FBSIZE
+        payload, pos, i = pkt[2:-1], 0, 0
+        while i < len(payload):
+            ctl = payload[i]
+            i += 1
+            if ctl & 0x80:
+                pos += (ctl & 0x7F) + 1
+            else:
+                for b in payload[i:i + ctl + 1]:
+                    if pos < FBSIZE:
+                        frame[pos] ^= b
+                    pos += 1
+                i += ctl + 1
+        yield list(frame)
+
+
+def draw(frame):
+    """Return the frame as ASCII art; byte 0 is the rightmost column"""
+    lines = []
+    for row in range(8):
+        bit = 7 - row
+        lines.append("".join("#" if frame[m * SCANLIMIT + i] >> bit & 1 else "."
+                             for m in reversed(range(MATRICES))
+                             for i in reversed(range(SCANLIMIT))))
+    return "\n".join(lines)
+
+
+def parse(text):
+    """Parse the ASCII art frames"""
+    frames = []
+    for block in text.strip().split("\n\n"):
+        frame = [0] * FBSIZE
+        for row, line in enumerate(block.splitlines()[:8]):
+            for col, char in enumerate(line[:FBSIZE]):
+                if char == "#":
+                    frame[FBSIZE - 1 - col] |= 1 << (7 - row)
+        frames.append(frame)
+    return frames
+
+
+def command(port, line):
+    """Send a command, wait for the result"""
+    port.write((line + "\r").encode("ascii"))
+    while True:
+        reply = port.readline()
+        if not reply:
+            return False
+        reply = reply.decode("ascii", "replace").strip()
+        if reply in ("OK", "ERROR"):
+            return reply == "OK"
+
+
+def view(port):
+    command(port, "AT*J1")
+    frame = [0] * FBSIZE
+
+    def stream():
+        while True:
+            yield from port.read(max(1, port.in_waiting))
+
+    for frame in decode(stream(), frame):
+        print(draw(frame) + "\n")
+
+
+def send(port, frames, fps):
+    command(port, "AT*J2")
+    prev = None
+    count = 0
+    try:
+        while True:
+            for frame in frames:
+                # A key frame now and then, in case a packet is lost
+                port.write(encode(frame, None if count % 32 == 0 else prev))
+                prev = frame
+                count += 1
+                time.sleep(1.0 / fps)
+    except KeyboardInterrupt:
+        head = [END, 0]
+        port.write(bytes([SYNC] + head + [crc8(head)]))
+
+
+def main():
+    if len(sys.argv) < 3 or sys.argv[2] not in ("view", "send"):
+        print("Usage: fbstream.py PORT view")
+        print("       fbstream.py PORT send FILE [FPS]")
+        sys.exit(1)
+    port = serial.Serial(sys.argv[1], BAUD, timeout=6)
+    # The board resets when the port is opened
+    time.sleep(2)
+    port.reset_input_buffer()
+    # No local echo and no display lines in the stream
+    command(port, "ATE0")
+    command(port, "ATQ1")
+    try:
+        if sys.argv[2] == "view":
+            view(port)
+        else:
+            with open(sys.argv[3]) as f:
+                frames = parse(f.read())
+            send(port, frames, float(sys.argv[4]) if len(sys.argv) > 4 else 10)
+    except KeyboardInterrupt:
+        pass
+    command(port, "AT*J0")
+    command(port, "ATQ0")
+    command(port, "ATE1")
+
+
+if __name__ == "__main__":
+    main()
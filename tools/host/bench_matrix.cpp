@@ -0,0 +1,98 @@
+/**
+  bench_matrix.cpp - The runtime sized matrices against the fixed ones
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: bench_matrix [FRAMES]
+
+  The same chain, driven by DotMatrix, sized and looped at runtime, and
+  by DotMatrixFixed, sized and looped for the chain at compile time,
+  shows a clock counting seconds, then presents the same frame again and
+  again.  The RAM of each, as sized on the host, the bytes, the bus time
+  and the host time of a changed frame, and the host time of an
+  unchanged one, the compare only, are printed.  The code size of the
+  hooks each class uses is printed by "make bench", from the symbols.
+*/
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "harness.h"
+#include "DotMatrix.h"
+
+/**
+  The host time, ns
+
+  @return the monotonic clock, ns
+*/
+static uint64_t bchNs() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/**
+  Run the frames on a chain and print the figures
+
+  @param name the class
+  @param mtx the matrices, initialized
+  @param ram the size of the object, bytes
+  @param frames the frames to run
+*/
+static void bchRun(const char* name, DotMatrixBase &mtx, size_t ram, uint32_t frames) {
+  char text[8];
+  mtx.decodemode(0);
+  mtx.clear();
+  mtx.intensity(4);
+  mtx.shutdown(false);
+  mtx.loadFont(0);
+  // A clock counting seconds, each frame changed
+  uint32_t sent = mtx.spiBytes;
+  uint64_t start = halNow, t0 = bchNs();
+  for (uint32_t f = 0; f < frames; f++) {
+    snprintf(text, sizeof(text), "%02u:%02u", (unsigned)(f / 60 % 60), (unsigned)(f % 60));
+    mtx.fbClear();
+    mtx.fbPrint(text);
+    mtx.fbPresent();
+  }
+  uint64_t changed = bchNs() - t0, bus = halNow - start;
+  uint32_t bytes = mtx.spiBytes - sent;
+  // The same frame again, nothing sent
+  t0 = bchNs();
+  for (uint32_t f = 0; f < frames; f++)
+    mtx.fbPresent();
+  uint64_t still = bchNs() - t0;
+  CHECK(mtx.spiBytes - sent == bytes, "%s: an unchanged frame was sent", name);
+  printf("bench: %-14s %4zu bytes RAM, %5.1f bytes, %6.1f us on the bus, %5.0f ns on the host a changed frame, "
+         "%4.0f ns an unchanged one\n", name, ram, (double)bytes / frames, (double)bus / frames,
+         (double)changed / frames, (double)still / frames);
+}
+
+int main(int argc, char** argv) {
+  uint32_t frames = argc > 1 ? strtoul(argv[1], nullptr, 0) : 20000;
+  halPowerOn();
+  halChainAttach(0, HRN_CS, HRN_DEVICES);
+  DotMatrix dyn;
+  dyn.init(HRN_CS, HRN_DEVICES, 8);
+  bchRun("DotMatrix", dyn, sizeof(dyn), frames);
+
+  halPowerOn();
+  halChainAttach(0, HRN_CS, HRN_DEVICES);
+  DotMatrixFixed<HRN_DEVICES, 8> fix;
+  fix.init(HRN_CS);
+  bchRun("DotMatrixFixed", fix, sizeof(fix), frames);
+  return hrnDone("bench");
+}
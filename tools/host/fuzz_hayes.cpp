@@ -0,0 +1,305 @@
+/**
+  fuzz_hayes.cpp - Fuzz the Hayes console on the emulated board
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: fuzz_hayes [-n RUNS] [-s SEED] [-o DIR] CORPUS...
+         fuzz_hayes CORPUS... -max_len=256       (libFuzzer)
+
+  Each input is sent to the serial port, at the line speed, and read by
+  the real loop() and handleHayes() path, with the address and the
+  undefined behaviour sanitizers on.  Then the console must still answer
+  ATI1: an input must not crash the sketch, nor wedge the console.  A
+  watchdog reset is allowed only if the input asks for it, with ATZ;
+  the board is booted again, the watchdog still on, and must not be
+  reset again in setup().  First, a few malformed commands, each
+  after a valid one, must be answered ERROR.
+
+  Built with clang and -fsanitize=fuzzer, this is a libFuzzer target,
+  see "make fuzz".  Otherwise the driver runs the corpus files, then
+  RUNS inputs mutated from them; an input that fails is saved in DIR.
+*/
+
+#include <dirent.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "harness.h"
+
+// The sketch
+extern uint8_t mirMode;
+#define MIR_INGEST  2
+
+// The longest time to read an input or to answer, us
+#define FZZ_TIMEOUT 20000000ULL
+
+static jmp_buf      fzzReset;
+static const uint8_t* fzzData = nullptr;      // The input being run
+static size_t       fzzSize = 0;
+static const char*  fzzDir = ".";             // Where the failing inputs are saved
+static bool         fzzBooting = false;       // In setup()
+
+// Malformed commands: unknown, cut short, out of range, bad arguments
+static const char* const fzzMalformed[] = {
+  "ATX", "AT*", "AT&", "AT*O99", "AT*B16", "AT*Uk", "AT&Q", "ATE7",
+  "AT*T=1", "AT*W9=1,2,3", "AT*K0", "AT*Jx",
+};
+
+/**
+  A check failed, the input is saved when aborting
+
+  @param why the failure
+*/
+static void fzzFail(const char* why) {
+  fprintf(stderr, "%s\n", why);
+  abort();
+}
+
+/**
+  The input has been read
+*/
+static bool fzzRead() {
+  return halSerialPending() == 0;
+}
+
+/**
+  The console has answered ATI1
+*/
+static bool fzzAnswered() {
+  return halSerialOut.find("MatrixChronograph") != std::string::npos;
+}
+
+/**
+  Power on the board, or boot it again after a watchdog reset
+*/
+static void fzzBoot() {
+  hrnStep = 1000;
+  fzzBooting = true;
+  hrnBoot(2019, 12, 31, 23, 59, 0);
+  fzzBooting = false;
+  hrnRun(1000000);
+}
+
+/**
+  Check each malformed command is answered ERROR, not OK, after a valid
+  command
+*/
+static void fzzErrors() {
+  for (const char* cmd : fzzMalformed) {
+    hrnCommand("ATI1");
+    std::string reply = hrnCommand(cmd);
+    if (reply.find("ERROR") == std::string::npos or reply.find("OK") != std::string::npos) {
+      fprintf(stderr, "%s: answered '%s'\n", cmd, reply.c_str());
+      fzzFail("Malformed command not answered ERROR");
+    }
+  }
+}
+
+/**
+  Check if the input asks for a reset, the line does not matter
+
+  @return true if it does
+*/
+static bool fzzAsksReset(const uint8_t* data, size_t size) {
+  for (size_t i = 0; i < size; i++)
+    if (data[i] == 'Z' or data[i] == 'z')
+      return true;
+  return false;
+}
+
+/**
+  Run an input on the board, then check the console still answers
+
+  @param data the bytes
+  @param size the number of bytes
+  @return 0, as libFuzzer expects; a failure aborts
+*/
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static bool booted = false;
+  if (not booted) {
+    halResetJmp = &fzzReset;
+    fzzBoot();
+    fzzErrors();
+    booted = true;
+  }
+  fzzData = data;
+  fzzSize = size;
+  // The watchdog reset jumps here, while reading or answering
+  if (setjmp(fzzReset)) {
+    if (fzzBooting)
+      fzzFail("Watchdog reset in setup(), the watchdog was left on");
+    if (not fzzAsksReset(data, size))
+      fzzFail("Watchdog reset, the console is wedged");
+    fzzBoot();
+    return 0;
+  }
+  halSerialIn((const char*)data, size);
+  if (not hrnRunUntil(fzzRead, FZZ_TIMEOUT))
+    fzzFail("Input not read");
+  // End the line left, then let the ingest mode end, it leaves when idle
+  halSerialIn("\r", 1);
+  hrnRun(100000);
+  if (mirMode == MIR_INGEST)
+    hrnRun(11000000);
+  // Then ask
+  halSerialOut.clear();
+  halSerialIn("ATI1\r", 5);
+  if (not hrnRunUntil(fzzAnswered, FZZ_TIMEOUT))
+    fzzFail("No answer to ATI1");
+  halSerialOut.clear();
+  return 0;
+}
+
+#ifndef HRN_LIBFUZZER
+/*
+  The sanitizers abort on the first error, so the input is saved
+*/
+extern "C" const char* __asan_default_options() {
+  return "abort_on_error=1";
+}
+
+extern "C" const char* __ubsan_default_options() {
+  return "abort_on_error=1";
+}
+
+/**
+  Save the input being run, on abort
+*/
+static void fzzSave(int sig) {
+  char name[256];
+  signal(sig, SIG_DFL);
+  snprintf(name, sizeof(name), "%s/crash-hayes-%08x", fzzDir, (unsigned)halNow);
+  FILE* f = fzzData ? fopen(name, "wb") : nullptr;
+  if (f) {
+    fwrite(fzzData, 1, fzzSize, f);
+    fclose(f);
+    fprintf(stderr, "Input saved in %s\n", name);
+  }
+  raise(sig);
+}
+
+/**
+  Read a file
+
+  @param name the file name
+  @param data the bytes read
+  @return true if read
+*/
+static bool fzzLoad(const char* name, std::string &data) {
+  FILE* f = fopen(name, "rb");
+  if (f == nullptr)
+    return false;
+  char buf[256];
+  size_t n;
+  data.clear();
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    data.append(buf, n);
+  fclose(f);
+  return true;
+}
+
+/**
+  Mutate an input: flip, insert, delete or repeat bytes, or splice in
+  another input, keeping it short
+
+  @param in the input, changed
+  @param other another input, for splicing
+*/
+static void fzzMutate(std::string &in, const std::string &other) {
+  static const char special[] = "\r\n\b\x7F\0=?,*&+\xFF ATZ0123456789-";
+  uint8_t count = 1 + rand() % 4;
+  while (count--) {
+    size_t pos = in.empty() ? 0 : rand() % (in.size() + 1);
+    switch (rand() % 6) {
+      case 0:
+        if (pos < in.size())
+          in[pos] ^= 1 << (rand() % 8);
+        break;
+      case 1:
+        in.insert(pos, 1, special[rand() % (sizeof(special) - 1)]);
+        break;
+      case 2:
+        in.insert(pos, 1, (char)(rand() % 256));
+        break;
+      case 3:
+        if (pos < in.size())
+          in.erase(pos, 1 + rand() % 8);
+        break;
+      case 4:
+        // A long run, past the line buffer
+        in.insert(pos, 1 + rand() % 80, in.empty() ? 'A' : in[rand() % in.size()]);
+        break;
+      case 5:
+        if (not other.empty()) {
+          size_t from = rand() % other.size();
+          in.insert(pos, other, from, 1 + rand() % 16);
+        }
+        break;
+    }
+  }
+  if (in.size() > 256)
+    in.resize(256);
+}
+
+int main(int argc, char** argv) {
+  uint32_t runs = 1000;
+  unsigned seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:o:")) != -1)
+    switch (opt) {
+      case 'n': runs = strtoul(optarg, nullptr, 0); break;
+      case 's': seed = strtoul(optarg, nullptr, 0); break;
+      case 'o': fzzDir = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-n RUNS] [-s SEED] [-o DIR] CORPUS...\n", argv[0]);
+        return 2;
+    }
+  // The corpus: files or directories of files
+  std::vector<std::string> corpus;
+  for (int i = optind; i < argc; i++) {
+    std::string data;
+    DIR* dir = opendir(argv[i]);
+    if (dir == nullptr) {
+      if (fzzLoad(argv[i], data))
+        corpus.push_back(data);
+      continue;
+    }
+    struct dirent* e;
+    while ((e = readdir(dir)) != nullptr)
+      if (e->d_name[0] != '.' and fzzLoad((std::string(argv[i]) + "/" + e->d_name).c_str(), data))
+        corpus.push_back(data);
+    closedir(dir);
+  }
+  if (corpus.empty()) {
+    fprintf(stderr, "No corpus\n");
+    return 2;
+  }
+  signal(SIGABRT, fzzSave);
+  for (const std::string &in : corpus)
+    LLVMFuzzerTestOneInput((const uint8_t*)in.data(), in.size());
+  srand(seed);
+  for (uint32_t r = 0; r < runs; r++) {
+    std::string in = corpus[rand() % corpus.size()];
+    fzzMutate(in, corpus[rand() % corpus.size()]);
+    LLVMFuzzerTestOneInput((const uint8_t*)in.data(), in.size());
+  }
+  printf("fuzz: %zu corpus inputs, %u mutated, seed %u\n", corpus.size(), runs, seed);
+  return 0;
+}
+#endif
@@ -0,0 +1,1298 @@
+/**
+  hal.cpp - Emulated ATmega328P board for the host harnesses
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <Wire.h>
+#include <EEPROM.h>
+#include <IRLremote.h>
+#include <avr/wdt.h>
+#include <stdio.h>
+#include <ucontext.h>
+#include <deque>
+
+#include "hal.h"
+#include "DS3231.h"
+#include "AT24C32.h"
+
+// The interrupt handlers of the sketch
+extern "C" void isrTimer1CompA(void);
+extern "C" void isrTimer2CompA(void);
+extern "C" void isrPCInt1(void);
+extern "C" void isrWdt(void);
+
+// The sketch pins the harness knows about
+#define HAL_INTSQ_PIN A3
+
+// Registers
+volatile uint8_t  SREG, MCUSR, WDTCSR, GPIOR0;
+volatile uint8_t  TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint8_t  TCCR2A, TCCR2B, TIMSK2, TIFR2, TCNT2, OCR2A, OCR2B;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t  PCICR, PCMSK1, PCIFR, EICRA, EIMSK;
+volatile uint8_t  ADMUX, ACSR;
+volatile uint16_t ADCW;
+halAdcsra         ADCSRA;
+halStackPtr       SP;
+
+HardwareSerial    Serial;
+SPIClass          SPI;
+TwoWire           Wire;
+EEPROMClass       EEPROM;
+
+uint64_t    halNow        = 0;
+uint32_t    halMillis0    = 0;
+uint8_t     halCallCost   = 2;
+halChain_t  halChains[HAL_CHAINS];
+halRtc_t    halRtc;
+halHt_t     halHts[HAL_PANELS];
+halLeds_t   halLeds;
+halI2c_t    halI2c;
+uint32_t    halSpiStray   = 0;
+uint32_t    halSpiClash   = 0;
+uint32_t    halWdtIrqs    = 0;
+uint32_t    halWdtResets  = 0;
+uint64_t    halWdtMaxGap  = 0;
+jmp_buf*    halResetJmp   = nullptr;
+std::string halSerialOut;
+
+// The RAM, laid out as the linker would: data, bss, noinit, then the
+// heap growing up and the stack growing down from the end
+char        halRam[HAL_RAM + HAL_STACK];
+bool        halStack      = false;
+char*       __brkval = nullptr;
+asm(".globl halDataStart\n\t.set halDataStart, halRam + 0\n\t"
+    ".globl halDataEnd\n\t.set halDataEnd, halRam + 320\n\t"
+    ".globl halBssStart\n\t.set halBssStart, halRam + 320\n\t"
+    ".globl halBssEnd\n\t.set halBssEnd, halRam + 1472\n\t"
+    ".globl halNoinitStart\n\t.set halNoinitStart, halRam + 1472\n\t"
+    ".globl halNoinitEnd\n\t.set halNoinitEnd, halRam + 1480\n\t"
+    ".globl halHeapStart\n\t.set halHeapStart, halRam + 1480\n\t");
+// The sketch context on its stack, the harness one and the function run,
+// not under the sanitizers
+#ifndef __SANITIZE_ADDRESS__
+static ucontext_t ctxSketch, ctxHost;
+static void     (*ctxFn)();
+#endif
+
+// Pins
+static uint8_t  pinIn[NUM_PINS];          // Input levels, set by the harness
+static uint8_t  pinOut[NUM_PINS];         // Output latches
+static uint8_t  pinDir[NUM_PINS];         // Pin modes
+static uint8_t  pinSqw;                   // Last level of the RTC INT/SQW pin
+// The ADC inputs
+static uint16_t adcIn[8];
+static uint16_t adcVcc;                   // Supply, mV
+static int16_t  adcTemp;                  // MCU temperature, hundredths of degree
+// Timers: the counts of timer 1 and microseconds of timer 2
+static uint32_t t1Counts;
+static uint32_t t2Us;
+// The watchdog
+static bool     wdtOn;
+static bool     wdtFired;                   // The last reset was the watchdog's
+static uint32_t wdtTimeout;
+static uint64_t wdtLast;
+// Serial input: the bytes and their arrival times
+static std::deque<uint8_t>  serIn;
+static std::deque<uint64_t> serAt;
+static uint64_t serTxFree;                // End of the transmission in progress
+// IR frames
+static std::deque<IRData>   irIn;
+// In an interrupt handler, the time does not advance
+static bool     inIsr;
+
+// Bytes on the serial line, 9600 baud, 10 bits each
+#define SER_BYTE_US 1042
+// The transmit buffer of the serial port
+#define SER_TX_BUF  64
+// Bytes on the I2C bus, 100kHz, 9 bits each
+#define I2C_BYTE_US 90
+// AT24C32 write cycle
+#define EEP_WRITE_US 5000
+
+
+/**
+  Convert to and from packed BCD
+*/
+static uint8_t bcd2bin(uint8_t v) { return v - 6 * (v >> 4); }
+static uint8_t bin2bcd(uint8_t v) { return v + 6 * (v / 10); }
+
+/**
+  Power on the board: clear the registers, the RAM and the memories,
+  release the buttons and start the RTC on its backup battery.  After a
+  watchdog reset, the watchdog is still on, at its shortest timeout, and
+  WDRF set, until the sketch turns it off.
+
+  @param millis0 the millis() value at power on
+*/
+void halPowerOn(uint32_t millis0) {
+  halNow = 0;
+  halMillis0 = millis0;
+  SREG = MCUSR = WDTCSR = GPIOR0 = 0;
+  TCCR1A = TCCR1B = TIMSK1 = TIFR1 = 0;
+  TCCR2A = TCCR2B = TIMSK2 = TIFR2 = TCNT2 = OCR2A = OCR2B = 0;
+  TCNT1 = OCR1A = OCR1B = ICR1 = 0;
+  PCICR = PCMSK1 = PCIFR = EICRA = EIMSK = 0;
+  ADMUX = ACSR = 0;
+  ADCW = 0;
+  ADCSRA.v = 0;
+  memset(halRam, 0, sizeof(halRam));
+  memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+  EEPROM.writes = 0;
+  for (uint8_t p = 0; p < NUM_PINS; p++) {
+    pinIn[p] = HIGH;
+    pinOut[p] = LOW;
+    pinDir[p] = INPUT;
+  }
+  memset(adcIn, 0, sizeof(adcIn));
+  adcIn[0] = 512;
+  adcVcc = 5000;
+  adcTemp = 2500;
+  t1Counts = 0;
+  t2Us = 0;
+  wdtOn = wdtFired;
+  wdtTimeout = 16000UL;
+  wdtLast = 0;
+  if (wdtFired)
+    MCUSR |= _BV(WDRF);
+  wdtFired = false;
+  serIn.clear();
+  serAt.clear();
+  serTxFree = 0;
+  irIn.clear();
+  inIsr = false;
+  halSerialOut.clear();
+  // Growing it deep in the C library would be charged to the sketch stack
+  if (halStack)
+    halSerialOut.reserve(HAL_SER_OUT);
+  halSpiStray = halSpiClash = 0;
+  halWdtIrqs = halWdtResets = 0;
+  halWdtMaxGap = 0;
+  memset(halChains, 0, sizeof(halChains));
+  memset(halHts, 0, sizeof(halHts));
+  memset(&halLeds, 0, sizeof(halLeds));
+  memset(&halI2c, 0, sizeof(halI2c));
+  // The RTC keeps time on its battery, the oscillator has been stopped
+  memset(&halRtc, 0, sizeof(halRtc));
+  halRtc.present = true;
+  halRtc.eepPresent = true;
+  halRtc.regs[RTC_DAY] = 1;
+  halRtc.regs[RTC_DATE] = 1;
+  halRtc.regs[RTC_MONTH] = 1;
+  halRtc.regs[RTC_CONTROL] = 0x1C;
+  halRtc.regs[RTC_STATUS] = 0x88;
+  halRtcTemp(25 * 4);
+  memset(halRtc.eep, 0xFF, sizeof(halRtc.eep));
+  pinSqw = halRtcPin();
+}
+
+/**
+  Check if running on the stack in the emulated RAM
+
+  @return true if so
+*/
+static bool halOnStack() {
+  char* sp = (char*)__builtin_frame_address(0);
+  return sp >= halRam and sp < halRam + sizeof(halRam);
+}
+
+#ifndef __SANITIZE_ADDRESS__
+static void halTrampoline() {
+  ctxFn();
+}
+#endif
+
+/**
+  Run a sketch function, setup(), loop() or an interrupt handler, on the
+  stack at the end of the emulated RAM if halStack is set and not already
+  there, as the MCU would.  Under the sanitizers, always on the host
+  stack.
+
+  @param fn the function
+*/
+void halCall(void (*fn)()) {
+#ifndef __SANITIZE_ADDRESS__
+  if (halStack and not halOnStack()) {
+    ctxFn = fn;
+    getcontext(&ctxSketch);
+    ctxSketch.uc_stack.ss_sp   = &__heap_start;
+    ctxSketch.uc_stack.ss_size = halRam + sizeof(halRam) - &__heap_start;
+    ctxSketch.uc_link = &ctxHost;
+    makecontext(&ctxSketch, halTrampoline, 0);
+    swapcontext(&ctxHost, &ctxSketch);
+    return;
+  }
+#endif
+  fn();
+}
+
+/**
+  Call an interrupt handler, the time does not advance inside it
+
+  @param isr the handler
+*/
+static void halIsr(void (*isr)(void)) {
+  inIsr = true;
+  halCall(isr);
+  inIsr = false;
+}
+
+/*
+  The DS3231
+*/
+
+/**
+  The number of days in a month, the DS3231 way: the leap years are
+  the ones divisible by 4
+
+  @param m the month, BCD
+  @param y the year, BCD
+  @return the days
+*/
+static uint8_t rtcMonthDays(uint8_t m, uint8_t y) {
+  static const uint8_t days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  uint8_t mm = bcd2bin(m & 0x1F);
+  if (mm < 1 or mm > 12)
+    return 31;
+  if (mm == 2 and bcd2bin(y) % 4 == 0)
+    return 29;
+  return days[mm - 1];
+}
+
+/**
+  Check the alarms at the start of a second and set their flags
+*/
+static void rtcAlarms() {
+  uint8_t* r = halRtc.regs;
+  // Alarm 1: seconds, minutes, hours, day or date, each masked by bit 7
+  bool a1 = ((r[AL1_SECONDS] & 0x80) or (r[AL1_SECONDS] & 0x7F) == r[RTC_SECONDS]) and
+            ((r[AL1_MINUTES] & 0x80) or (r[AL1_MINUTES] & 0x7F) == r[RTC_MINUTES]) and
+            ((r[AL1_HOURS]   & 0x80) or (r[AL1_HOURS]   & 0x3F) == (r[RTC_HOURS] & 0x3F)) and
+            ((r[AL1_DAYDATE] & 0x80) or
+             ((r[AL1_DAYDATE] & 0x40) ? (r[AL1_DAYDATE] & 0x0F) == r[RTC_DAY] :
+                                        (r[AL1_DAYDATE] & 0x3F) == r[RTC_DATE]));
+  if (a1)
+    r[RTC_STATUS] |= 0x01;
+  // Alarm 2: at second 00, minutes, hours, day or date
+  bool a2 = r[RTC_SECONDS] == 0 and
+            ((r[AL2_MINUTES] & 0x80) or (r[AL2_MINUTES] & 0x7F) == r[RTC_MINUTES]) and
+            ((r[AL2_HOURS]   & 0x80) or (r[AL2_HOURS]   & 0x3F) == (r[RTC_HOURS] & 0x3F)) and
+            ((r[AL2_DAYDATE] & 0x80) or
+             ((r[AL2_DAYDATE] & 0x40) ? (r[AL2_DAYDATE] & 0x0F) == r[RTC_DAY] :
+                                        (r[AL2_DAYDATE] & 0x3F) == r[RTC_DATE]));
+  if (a2)
+    r[RTC_STATUS] |= 0x02;
+}
+
+/**
+  Count one second in the time registers, as the DS3231 does, in the
+  24 hours mode
+*/
+static void rtcSecond() {
+  uint8_t* r = halRtc.regs;
+  uint8_t  s = bcd2bin(r[RTC_SECONDS] & 0x7F) + 1;
+  if (s < 60) {
+    r[RTC_SECONDS] = bin2bcd(s);
+    rtcAlarms();
+    return;
+  }
+  r[RTC_SECONDS] = 0;
+  uint8_t mi = bcd2bin(r[RTC_MINUTES] & 0x7F) + 1;
+  if (mi < 60) {
+    r[RTC_MINUTES] = bin2bcd(mi);
+    rtcAlarms();
+    return;
+  }
+  r[RTC_MINUTES] = 0;
+  uint8_t h = bcd2bin(r[RTC_HOURS] & 0x3F) + 1;
+  if (h < 24) {
+    r[RTC_HOURS] = bin2bcd(h);
+    rtcAlarms();
+    return;
+  }
+  r[RTC_HOURS] = 0;
+  r[RTC_DAY] = r[RTC_DAY] >= 7 ? 1 : r[RTC_DAY] + 1;
+  uint8_t d = bcd2bin(r[RTC_DATE] & 0x3F) + 1;
+  if (d <= rtcMonthDays(r[RTC_MONTH], r[RTC_YEAR])) {
+    r[RTC_DATE] = bin2bcd(d);
+    rtcAlarms();
+    return;
+  }
+  r[RTC_DATE] = 1;
+  uint8_t m = bcd2bin(r[RTC_MONTH] & 0x1F) + 1;
+  if (m <= 12) {
+    r[RTC_MONTH] = (r[RTC_MONTH] & 0x80) | bin2bcd(m);
+    rtcAlarms();
+    return;
+  }
+  // New year, the century bit toggles after 99
+  uint8_t y = bcd2bin(r[RTC_YEAR]) + 1;
+  r[RTC_MONTH] = (r[RTC_MONTH] & 0x80) | 0x01;
+  if (y > 99) {
+    y = 0;
+    r[RTC_MONTH] ^= 0x80;
+  }
+  r[RTC_YEAR] = bin2bcd(y);
+  rtcAlarms();
+}
+
+/**
+  The level of the RTC INT/SQW pin: the 1Hz square wave, falling when
+  the seconds count, or the alarm interrupt, active low
+
+  @return the pin level
+*/
+uint8_t halRtcPin() {
+  uint8_t* r = halRtc.regs;
+  if (r[RTC_CONTROL] & 0x04)
+    return (r[RTC_STATUS] & r[RTC_CONTROL] & 0x03) ? LOW : HIGH;
+  return halRtc.us < 500000 ? LOW : HIGH;
+}
+
+/**
+  Set the RTC date and time and clear the oscillator stop flag
+*/
+void halRtcSet(uint16_t Y, uint8_t m, uint8_t d, uint8_t H, uint8_t M, uint8_t S) {
+  uint8_t* r = halRtc.regs;
+  // Day of the week, Monday is 1
+  static const uint8_t t[] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+  uint16_t y = Y - (m < 3);
+  uint8_t  u = (y + y / 4 - y / 100 + y / 400 + t[m - 1] + d) % 7;
+  r[RTC_SECONDS] = bin2bcd(S);
+  r[RTC_MINUTES] = bin2bcd(M);
+  r[RTC_HOURS]   = bin2bcd(H);
+  r[RTC_DAY]     = u ? u : 7;
+  r[RTC_DATE]    = bin2bcd(d);
+  r[RTC_MONTH]   = bin2bcd(m) | (Y >= 2000 ? 0x80 : 0x00);
+  r[RTC_YEAR]    = bin2bcd(Y % 100);
+  r[RTC_STATUS] &= 0x7F;
+  halRtc.us = 0;
+  halRtc.drift = 0;
+}
+
+/**
+  Set the RTC temperature
+
+  @param quarters the temperature, quarters of degree
+*/
+void halRtcTemp(int16_t quarters) {
+  halRtc.regs[RTC_TMP_MSB] = (uint8_t)(quarters >> 2);
+  halRtc.regs[RTC_TMP_LSB] = (uint8_t)((quarters & 0x03) << 6);
+}
+
+/**
+  Run the RTC for some time, counting the seconds
+
+  @param us the microseconds
+*/
+static void rtcRun(uint32_t us) {
+  // The drift, with the aging offset, about 0.1ppm per step, slower
+  int32_t ppm100 = halRtc.ppm - (int8_t)halRtc.regs[RTC_AGING] * 10;
+  // The fractions of a microsecond are carried, the steps are short
+  halRtc.drift += (int64_t)us * ppm100;
+  int64_t drift = halRtc.drift / 100000000;
+  halRtc.drift -= drift * 100000000;
+  uint64_t t = halRtc.us + us + drift;
+  while (t >= 1000000) {
+    t -= 1000000;
+    rtcSecond();
+  }
+  halRtc.us = t;
+}
+
+/**
+  An I2C write to the RTC: the register pointer, then the registers
+
+  @param data the bytes
+  @param len the number of bytes
+*/
+static void rtcWrite(const uint8_t* data, uint8_t len) {
+  if (len == 0)
+    return;
+  halRtc.ptr = data[0];
+  for (uint8_t i = 1; i < len; i++) {
+    uint8_t reg = halRtc.ptr;
+    if (reg < RTC_TMP_MSB) {
+      // The alarm flags and OSF can only be cleared
+      if (reg == RTC_STATUS)
+        halRtc.regs[reg] = (halRtc.regs[reg] & data[i] & 0x83) | (data[i] & 0x08);
+      else
+        halRtc.regs[reg] = data[i];
+      // Writing the seconds restarts the countdown chain
+      if (reg == RTC_SECONDS)
+        halRtc.us = 0;
+      // A temperature conversion ends at once
+      if (reg == RTC_CONTROL)
+        halRtc.regs[reg] &= ~0x20;
+    }
+    halRtc.ptr = (reg + 1) % RTC_REGS;
+  }
+}
+
+/**
+  An I2C write to the AT24C32: the address, then the bytes, wrapping
+  in the page; the write cycle starts at the STOP
+
+  @param data the bytes
+  @param len the number of bytes
+*/
+static void eepWrite(const uint8_t* data, uint8_t len) {
+  if (len < 2)
+    return;
+  halRtc.eepPtr = ((data[0] << 8) | data[1]) & (sizeof(halRtc.eep) - 1);
+  uint16_t page = halRtc.eepPtr / EEP_PAGE;
+  uint8_t  start = halRtc.eepPtr % EEP_PAGE;
+  for (uint8_t i = 2; i < len; i++) {
+    if (start + i - 2 >= EEP_PAGE)
+      halRtc.eepWrapped++;
+    halRtc.eep[halRtc.eepPtr] = data[i];
+    halRtc.eepPtr = (halRtc.eepPtr & ~(EEP_PAGE - 1)) | ((halRtc.eepPtr + 1) & (EEP_PAGE - 1));
+  }
+  if (len > 2) {
+    halRtc.eepBusy = halNow + EEP_WRITE_US;
+    halRtc.eepCycles++;
+    halRtc.eepWear[page]++;
+  }
+}
+
+/*
+  Virtual time
+*/
+
+/**
+  The time to the next emulated event, no more than the limit
+
+  @param limit the limit, us
+  @return the time, us, at least 1
+*/
+static uint64_t halNextEvent(uint64_t limit) {
+  uint64_t next = limit;
+  // Timer 1, CTC mode, prescaler 8: two counts each us
+  if ((TCCR1B & 0x07) and (TIMSK1 & _BV(OCIE1A))) {
+    uint32_t top = (uint32_t)OCR1A + 1;
+    uint32_t left = t1Counts < top ? top - t1Counts : 1;
+    next = min(next, (uint64_t)((left + 1) / 2));
+  }
+  // Timer 2, CTC mode, prescaler 1024
+  if (TIMSK2 & _BV(OCIE2A)) {
+    uint32_t period = ((uint32_t)OCR2A + 1) * 1024 / 16;
+    next = min(next, (uint64_t)(t2Us < period ? period - t2Us : 1));
+  }
+  // The RTC half seconds
+  next = min(next, (uint64_t)(500000 - halRtc.us % 500000));
+  // The watchdog
+  if (wdtOn) {
+    uint64_t due = wdtLast + wdtTimeout;
+    next = min(next, due > halNow ? due - halNow : 1);
+  }
+  return next ? next : 1;
+}
+
+/**
+  Advance the virtual time, running the timers, the RTC and the
+  watchdog, and calling their interrupt handlers
+
+  @param us the microseconds
+*/
+void halAdvance(uint64_t us) {
+  while (us > 0) {
+    uint64_t dt = halNextEvent(us);
+    us -= dt;
+    halNow += dt;
+    // Timer 1
+    if (TCCR1B & 0x07) {
+      t1Counts += dt * 2;
+      uint32_t top = (uint32_t)OCR1A + 1;
+      while (t1Counts >= top) {
+        t1Counts -= top;
+        TIFR1 |= _BV(OCF1A);
+        if (TIMSK1 & _BV(OCIE1A)) {
+          TIFR1 &= ~_BV(OCF1A);
+          halIsr(isrTimer1CompA);
+        }
+        top = (uint32_t)OCR1A + 1;
+      }
+      TCNT1 = t1Counts;
+    }
+    // Timer 2
+    if (TIMSK2 & _BV(OCIE2A)) {
+      uint32_t period = ((uint32_t)OCR2A + 1) * 1024 / 16;
+      t2Us += dt;
+      while (t2Us >= period and (TIMSK2 & _BV(OCIE2A))) {
+        t2Us -= period;
+        halIsr(isrTimer2CompA);
+      }
+    }
+    else
+      t2Us = 0;
+    // The RTC and its INT/SQW pin, on pin change interrupt
+    rtcRun(dt);
+    uint8_t sqw = halRtcPin();
+    if (sqw != pinSqw) {
+      pinSqw = sqw;
+      if ((PCICR & _BV(PCIE1)) and (PCMSK1 & _BV(PCINT11)))
+        halIsr(isrPCInt1);
+    }
+    // The watchdog: the interrupt first, if enabled, then the reset
+    if (wdtOn and halNow - wdtLast >= wdtTimeout) {
+      if (WDTCSR & _BV(WDIE)) {
+        WDTCSR &= ~_BV(WDIE);
+        halWdtIrqs++;
+        halIsr(isrWdt);
+        wdtLast = halNow;
+      }
+      else {
+        halWdtResets++;
+        wdtOn = false;
+        wdtFired = true;
+        MCUSR |= _BV(WDRF);
+        if (halResetJmp == nullptr) {
+          fprintf(stderr, "Watchdog reset at %.3fs\n", halNow / 1e6);
+          abort();
+        }
+        longjmp(*halResetJmp, 1);
+      }
+    }
+  }
+}
+
+/**
+  Charge the time of a core call, not inside an interrupt handler
+
+  @param us the microseconds
+*/
+void halCharge(uint32_t us) {
+  if (not inIsr)
+    halAdvance(us);
+}
+
+uint32_t millis() {
+  halCharge(halCallCost);
+  return (uint32_t)(halMillis0 + halNow / 1000);
+}
+
+uint32_t micros() {
+  halCharge(halCallCost);
+  return (uint32_t)(halMillis0 * 1000ULL + halNow);
+}
+
+void delay(unsigned long ms) {
+  halCharge(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  halCharge(us);
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+/*
+  Pins
+*/
+
+/**
+  Set a pin mode; SCL released after being driven low is a clock for
+  the device holding SDA
+*/
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= NUM_PINS)
+    return;
+  if (pin == SCL and pinDir[pin] == OUTPUT and pinOut[pin] == LOW and mode != OUTPUT) {
+    halI2c.clocks++;
+    if (halI2c.stuck and halI2c.stuck != 0xFF)
+      halI2c.stuck--;
+  }
+  pinDir[pin] = mode;
+}
+
+/**
+  Write a pin; the CS pins select the chains, the rising edge latches
+  the shift registers of the devices
+*/
+void digitalWrite(uint8_t pin, uint8_t val) {
+  halCharge(halCallCost);
+  if (pin >= NUM_PINS)
+    return;
+  pinOut[pin] = val ? HIGH : LOW;
+  for (uint8_t c = 0; c < HAL_CHAINS; c++) {
+    halChain_t &ch = halChains[c];
+    if (ch.cs != pin or ch.cs == 0)
+      continue;
+    if (val == LOW)
+      ch.sel = true;
+    else if (ch.sel) {
+      ch.sel = false;
+      ch.latches++;
+      for (uint8_t d = 0; d < ch.devices; d++) {
+        uint8_t reg = ch.shift[2 * d + 1] & 0x0F;
+        if (reg != 0x00)
+          ch.regs[d][reg] = ch.shift[2 * d];
+      }
+    }
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  halCharge(halCallCost);
+  if (pin == HAL_INTSQ_PIN)
+    return halRtcPin();
+  if (pin == SDA and halI2c.stuck)
+    return LOW;
+  if (pin >= NUM_PINS)
+    return LOW;
+  if (pinDir[pin] == OUTPUT)
+    return pinOut[pin];
+  return pinIn[pin];
+}
+
+/**
+  Set the level of an input pin
+
+  @param pin the pin
+  @param level the level
+*/
+void halPin(uint8_t pin, uint8_t level) {
+  if (pin < NUM_PINS)
+    pinIn[pin] = level;
+}
+
+void tone(uint8_t pin, unsigned int freq, unsigned long duration) {
+  (void)pin; (void)freq; (void)duration;
+}
+
+void noTone(uint8_t pin) {
+  (void)pin;
+}
+
+void attachInterrupt(uint8_t irq, void (*isr)(void), int mode) {
+  (void)irq; (void)isr; (void)mode;
+}
+
+void detachInterrupt(uint8_t irq) {
+  (void)irq;
+}
+
+/*
+  The ADC
+*/
+
+void halAnalog(uint8_t channel, uint16_t value) {
+  if (channel >= A0)
+    channel -= A0;
+  if (channel < 8)
+    adcIn[channel] = value > 1023 ? 1023 : value;
+}
+
+void halVcc(uint16_t mv) {
+  adcVcc = mv;
+}
+
+void halMcuTemp(int16_t centi) {
+  adcTemp = centi;
+}
+
+/**
+  Convert the input selected by ADMUX: the pins and the bandgap against
+  AVcc, the temperature sensor against the internal reference
+*/
+static uint16_t adcConvert() {
+  halCharge(104);
+  uint8_t ch = ADMUX & 0x0F;
+  if (ch < 8)
+    return adcIn[ch];
+  if (ch == 8)
+    return (uint16_t)((adcTemp + 27315L) / 100);
+  if (ch == 14)
+    return (uint16_t)(1.1 * 1024.0 * 1000.0 / adcVcc + 0.5);
+  return 0;
+}
+
+halAdcsra& halAdcsra::operator =(uint8_t x) {
+  v = x;
+  if (v & _BV(ADSC)) {
+    ADCW = adcConvert();
+    v &= ~_BV(ADSC);
+  }
+  return *this;
+}
+
+int analogRead(uint8_t pin) {
+  if (pin >= A0)
+    pin -= A0;
+  ADMUX = _BV(REFS0) | (pin & 0x07);
+  return adcConvert();
+}
+
+/*
+  The stack pointer: the end of the RAM, or the current frame if on the
+  stack in the emulated RAM
+*/
+halStackPtr::operator uint8_t*() const {
+  return (uint8_t*)(char*)*this;
+}
+
+halStackPtr::operator char*() const {
+  if (halOnStack())
+    return (char*)__builtin_frame_address(0);
+  return halRam + sizeof(halRam);
+}
+
+/*
+  The watchdog
+*/
+
+void wdt_enable(uint8_t timeout) {
+  wdtOn = true;
+  wdtTimeout = 16000UL << (timeout > 9 ? 9 : timeout);
+  wdtLast = halNow;
+}
+
+void wdt_disable() {
+  wdtOn = false;
+}
+
+void wdt_reset() {
+  if (wdtOn and halNow - wdtLast > halWdtMaxGap)
+    halWdtMaxGap = halNow - wdtLast;
+  wdtLast = halNow;
+}
+
+/*
+  The serial port
+*/
+
+size_t Print::write(const uint8_t* data, size_t size) {
+  size_t n = 0;
+  while (size--)
+    n += write(*data++);
+  return n;
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+  char str[8 * sizeof(long) + 1];
+  char *p = &str[sizeof(str) - 1];
+  *p = '\0';
+  if (base < 2)
+    base = 10;
+  do {
+    uint8_t d = n % base;
+    n /= base;
+    *--p = d < 10 ? '0' + d : 'A' + d - 10;
+  } while (n);
+  return write(p);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == DEC and n < 0) {
+    size_t t = print('-');
+    return t + printNumber(-(unsigned long)n, DEC);
+  }
+  return printNumber((unsigned long)n, base);
+}
+
+/*
+  As the Arduino core prints, rounded and digit by digit, no printf on
+  the sketch stack
+*/
+size_t Print::print(double n, int digits) {
+  size_t t = 0;
+  if (n < 0.0) {
+    t += print('-');
+    n = -n;
+  }
+  double rounding = 0.5;
+  for (int i = 0; i < digits; i++)
+    rounding /= 10.0;
+  n += rounding;
+  unsigned long whole = (unsigned long)n;
+  double rest = n - (double)whole;
+  t += printNumber(whole, DEC);
+  if (digits > 0)
+    t += print('.');
+  while (digits-- > 0) {
+    rest *= 10.0;
+    uint8_t d = (uint8_t)rest;
+    t += print((char)('0' + d));
+    rest -= d;
+  }
+  return t;
+}
+
+/**
+  Send a byte: it waits while the transmit buffer is full
+*/
+size_t HardwareSerial::write(uint8_t c) {
+  halCharge(halCallCost);
+  if (serTxFree < halNow)
+    serTxFree = halNow;
+  serTxFree += SER_BYTE_US;
+  if (serTxFree - halNow > SER_TX_BUF * SER_BYTE_US)
+    halCharge(serTxFree - halNow - SER_TX_BUF * SER_BYTE_US);
+  halSerialOut += (char)c;
+  return 1;
+}
+
+int HardwareSerial::available() {
+  halCharge(halCallCost);
+  int n = 0;
+  for (size_t i = 0; i < serAt.size() and serAt[i] <= halNow; i++)
+    n++;
+  return n;
+}
+
+int HardwareSerial::peek() {
+  if (serIn.empty() or serAt.front() > halNow)
+    return -1;
+  return serIn.front();
+}
+
+int HardwareSerial::read() {
+  halCharge(halCallCost);
+  if (serIn.empty() or serAt.front() > halNow)
+    return -1;
+  uint8_t c = serIn.front();
+  serIn.pop_front();
+  serAt.pop_front();
+  return c;
+}
+
+/**
+  Send bytes to the serial port, they arrive one by one at the line
+  speed, after the ones already sent
+
+  @param data the bytes
+  @param len the number of bytes
+*/
+void halSerialIn(const char* data, size_t len) {
+  uint64_t at = serAt.empty() ? halNow : max(serAt.back(), halNow);
+  for (size_t i = 0; i < len; i++) {
+    at += SER_BYTE_US;
+    serIn.push_back((uint8_t)data[i]);
+    serAt.push_back(at);
+  }
+}
+
+/**
+  The bytes sent to the serial port and not read yet
+
+  @return the number of bytes
+*/
+size_t halSerialPending() {
+  return serIn.size();
+}
+
+/*
+  The IR receiver
+*/
+
+void halIR(uint16_t address, uint8_t command) {
+  IRData d = {address, command};
+  irIn.push_back(d);
+}
+
+bool CNec::available() {
+  return not irIn.empty();
+}
+
+IRData CNec::read() {
+  IRData d = {0xFFFF, 0x00};
+  if (not irIn.empty()) {
+    d = irIn.front();
+    irIn.pop_front();
+  }
+  return d;
+}
+
+/*
+  The SPI bus, the MAX7219 chains and the APA102 LEDs
+*/
+
+/**
+  Attach a chain to a CS pin, its DOUT looped back to MISO, no faults
+
+  @param chain the chain index
+  @param cs the CS pin
+  @param devices the devices in the chain
+*/
+void halChainAttach(uint8_t chain, uint8_t cs, uint8_t devices) {
+  halChain_t &ch = halChains[chain];
+  memset(&ch, 0, sizeof(ch));
+  ch.cs = cs;
+  ch.devices = devices > HAL_DEVICES ? HAL_DEVICES : devices;
+  ch.loop = true;
+  ch.errEvery = 1;
+}
+
+/**
+  The pixels the chain shows: the columns, the rightmost first, the top
+  row in bit 7.  Dark when shut down, all lit in the display test, the
+  lines above the scan limit and the decoded digits are not shown.
+
+  @param chain the chain index
+  @param cols the columns, 8 for each device
+*/
+void halChainPixels(uint8_t chain, uint8_t* cols) {
+  halChain_t &ch = halChains[chain];
+  for (uint8_t d = 0; d < ch.devices; d++)
+    for (uint8_t i = 0; i < 8; i++) {
+      const uint8_t* r = ch.regs[d];
+      uint8_t v = r[i + 1];
+      if (r[0x0F] & 0x01)
+        v = 0xFF;
+      else if (not (r[0x0C] & 0x01) or i > (r[0x0B] & 0x07) or (r[0x09] & (1 << i)))
+        v = 0x00;
+      cols[d * 8 + i] = v;
+    }
+}
+
+/**
+  Attach the APA102 LEDs, behind a bus buffer
+
+  @param en the enable pin of the buffer, active low
+  @param panels the 8x8 panels
+*/
+void halLedsAttach(uint8_t en, uint8_t panels) {
+  memset(&halLeds, 0, sizeof(halLeds));
+  halLeds.en = en;
+  halLeds.count = (panels > HAL_PANELS ? HAL_PANELS : panels) * 64;
+  halLeds.next = halLeds.count;
+}
+
+/**
+  The pixels the LEDs show, as the columns of halChainPixels(): the
+  columns a panel after another, zig-zag, the even ones downwards.  A
+  pixel is lit if its LED has any color and brightness.
+
+  @param cols the columns, 8 for each panel
+*/
+void halLedsPixels(uint8_t* cols) {
+  for (uint16_t c = 0; c < halLeds.count / 8; c++) {
+    cols[c] = 0;
+    for (uint8_t r = 0; r < 8; r++) {
+      const uint8_t* l = halLeds.led[c * 8 + r];
+      if (l[0] and (l[1] | l[2] | l[3]))
+        cols[c] |= 1 << ((c & 1) ? r : 7 - r);
+    }
+  }
+}
+
+static uint32_t spiClock = 4000000;
+
+void SPIClass::begin() {
+}
+
+void SPIClass::beginTransaction(SPISettings settings) {
+  spiClock = settings.clock ? settings.clock : 4000000;
+}
+
+/**
+  Clock a byte into the LEDs: the frames of 32 bits, the zero ones
+  starting the stream, each LED latching the first LED frame it gets
+  and passing the rest along
+
+  @param data the byte
+*/
+static void ledsShift(uint8_t data) {
+  halLeds.bytes++;
+  if (halLeds.pos == 0) {
+    // Between the LED frames, the start and the end frames
+    if (data == 0x00) {
+      halLeds.zeros++;
+      return;
+    }
+    if ((data & 0xE0) != 0xE0)
+      return;
+    if (halLeds.zeros >= 4) {
+      halLeds.next = 0;
+      halLeds.starts++;
+    }
+    halLeds.zeros = 0;
+  }
+  halLeds.frame[halLeds.pos++] = data;
+  if (halLeds.pos < 4)
+    return;
+  halLeds.pos = 0;
+  if (halLeds.next < halLeds.count) {
+    halLeds.led[halLeds.next][0] = halLeds.frame[0] & 0x1F;
+    memcpy(&halLeds.led[halLeds.next][1], &halLeds.frame[1], 3);
+    halLeds.next++;
+  }
+}
+
+/**
+  Clock a byte into the selected chain, or into the LEDs if their bus
+  buffer is enabled; it returns the byte shifted out of the last device,
+  looped back to MISO, or the idle level
+*/
+uint8_t SPIClass::transfer(uint8_t data) {
+  halCharge((8000000UL / spiClock + 999) / 1000 + 1);
+  bool leds = halLeds.en and pinOut[halLeds.en] == LOW;
+  if (leds)
+    ledsShift(data);
+  halChain_t* sel = nullptr;
+  for (uint8_t c = 0; c < HAL_CHAINS; c++)
+    if (halChains[c].cs and halChains[c].sel) {
+      if (sel)
+        halSpiClash++;
+      sel = &halChains[c];
+    }
+  if (sel and leds)
+    halSpiClash++;
+  if (sel == nullptr) {
+    if (not leds)
+      halSpiStray++;
+    return 0xFF;
+  }
+  // Too fast for the wiring, some bits arrive flipped
+  if (sel->errClock and spiClock > sel->errClock and sel->bytes % sel->errEvery == 0) {
+    data ^= 1 << (sel->errors % 8);
+    sel->errors++;
+  }
+  uint8_t n = 2 * sel->devices;
+  uint8_t out = sel->shift[n - 1];
+  memmove(sel->shift + 1, sel->shift, n - 1);
+  sel->shift[0] = data;
+  sel->bytes++;
+  // Past a broken device, the stream is lost
+  if (sel->broken and sel->broken <= sel->devices) {
+    memset(sel->shift + 2 * sel->broken, 0x00, n - 2 * sel->broken);
+    out = 0x00;
+  }
+  // MISO pulled up, if not looped back
+  return sel->loop ? out : 0xFF;
+}
+
+uint16_t SPIClass::transfer16(uint16_t data) {
+  uint16_t hi = transfer(data >> 8);
+  return (hi << 8) | transfer(data & 0xFF);
+}
+
+void SPIClass::transfer(void* buf, size_t count) {
+  uint8_t* p = (uint8_t*)buf;
+  while (count--) {
+    *p = transfer(*p);
+    p++;
+  }
+}
+
+/*
+  The I2C bus
+*/
+
+/**
+  Attach HT16K33 backpacks, at consecutive addresses from HAL_HT_ADDR;
+  they start in standby, the oscillator off
+
+  @param devices the number of backpacks
+*/
+void halHtAttach(uint8_t devices) {
+  memset(halHts, 0, sizeof(halHts));
+  for (uint8_t d = 0; d < devices and d < HAL_PANELS; d++)
+    halHts[d].present = true;
+}
+
+/**
+  The pixels the backpacks show, as the columns of halChainPixels(): each
+  row output drives a column, from the low byte of its display RAM row.
+  Dark in standby, with the display off or the row outputs not set.
+
+  @param cols the columns, 8 for each backpack
+*/
+void halHtPixels(uint8_t* cols) {
+  for (uint8_t d = 0; d < HAL_PANELS and halHts[d].present; d++) {
+    const halHt_t &ht = halHts[d];
+    bool on = ht.osc and ht.rowOut and (ht.disp & 0x01);
+    for (uint8_t i = 0; i < 8; i++)
+      cols[d * 8 + i] = on ? ht.ram[i * 2] : 0x00;
+  }
+}
+
+/**
+  An I2C write to an HT16K33: a command, or the display RAM address and
+  the data, the address incrementing and wrapping
+
+  @param ht the backpack
+  @param data the bytes
+  @param len the number of bytes
+*/
+static void htWrite(halHt_t &ht, const uint8_t* data, uint8_t len) {
+  ht.bytes += len + 1;
+  if (len == 0)
+    return;
+  uint8_t cmd = data[0];
+  switch (cmd & 0xF0) {
+    case 0x00:
+      ht.ptr = cmd & 0x0F;
+      for (uint8_t i = 1; i < len; i++) {
+        ht.ram[ht.ptr] = data[i];
+        ht.ptr = (ht.ptr + 1) & 0x0F;
+      }
+      break;
+    case 0x20:
+      ht.osc = cmd & 0x01;
+      break;
+    case 0x80:
+      ht.disp = cmd & 0x07;
+      break;
+    case 0xA0:
+      ht.rowOut = not (cmd & 0x01);
+      break;
+    case 0xE0:
+      ht.dim = cmd & 0x0F;
+      break;
+  }
+}
+
+/**
+  The HT16K33 at an address, if attached
+
+  @param addr the I2C address
+  @return the backpack, nullptr if none
+*/
+static halHt_t* htAt(uint8_t addr) {
+  if (addr < HAL_HT_ADDR or addr >= HAL_HT_ADDR + HAL_PANELS)
+    return nullptr;
+  halHt_t* ht = &halHts[addr - HAL_HT_ADDR];
+  return ht->present ? ht : nullptr;
+}
+
+void TwoWire::begin() {
+  _txLen = _rxLen = _rxIdx = 0;
+}
+
+void TwoWire::end() {
+}
+
+void TwoWire::beginTransmission(uint8_t addr) {
+  _addr = addr;
+  _txLen = 0;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  if (_txLen >= BUFFER_LENGTH)
+    return 0;
+  _tx[_txLen++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t count) {
+  size_t n = 0;
+  while (count--)
+    n += write(*data++);
+  return n;
+}
+
+/**
+  With SDA held low, a transaction waits for the bus until the timeout
+
+  @return true if timed out
+*/
+bool TwoWire::timeout() {
+  if (not halI2c.stuck)
+    return false;
+  halCharge(_timeout);
+  _timedOut = true;
+  halI2c.timeouts++;
+  return true;
+}
+
+/**
+  Send the buffered bytes to the device
+
+  @return 0 if acknowledged, 2 for no device, a busy one or a NACK, 5
+          for a timeout
+*/
+uint8_t TwoWire::endTransmission(bool stop) {
+  (void)stop;
+  if (timeout())
+    return 5;
+  if (halI2c.nacks and (halI2c.nackAddr == 0 or halI2c.nackAddr == _addr)) {
+    halI2c.nacks--;
+    halI2c.nacked++;
+    halCharge(I2C_BYTE_US);
+    return 2;
+  }
+  halCharge((_txLen + 1) * I2C_BYTE_US);
+  if (_addr == I2C_RTC and halRtc.present) {
+    rtcWrite(_tx, _txLen);
+    return 0;
+  }
+  if (_addr == I2C_EEP and halRtc.eepPresent and halNow >= halRtc.eepBusy) {
+    eepWrite(_tx, _txLen);
+    return 0;
+  }
+  if (halHt_t* ht = htAt(_addr)) {
+    htWrite(*ht, _tx, _txLen);
+    return 0;
+  }
+  return 2;
+}
+
+/**
+  Read bytes from the device, from its current pointer
+
+  @return the bytes read, 0 for no device, a busy one, a NACK or a
+          timeout
+*/
+uint8_t TwoWire::requestFrom(uint8_t addr, uint8_t count, uint8_t stop) {
+  (void)stop;
+  if (count > BUFFER_LENGTH)
+    count = BUFFER_LENGTH;
+  _rxLen = _rxIdx = 0;
+  if (timeout())
+    return 0;
+  if (halI2c.nacks and (halI2c.nackAddr == 0 or halI2c.nackAddr == addr)) {
+    halI2c.nacks--;
+    halI2c.nacked++;
+    halCharge(I2C_BYTE_US);
+    return 0;
+  }
+  halCharge((count + 1) * I2C_BYTE_US);
+  if (addr == I2C_RTC and halRtc.present) {
+    for (uint8_t i = 0; i < count; i++) {
+      _rx[_rxLen++] = halRtc.regs[halRtc.ptr];
+      halRtc.ptr = (halRtc.ptr + 1) % RTC_REGS;
+    }
+  }
+  else if (addr == I2C_EEP and halRtc.eepPresent and halNow >= halRtc.eepBusy) {
+    for (uint8_t i = 0; i < count; i++) {
+      _rx[_rxLen++] = halRtc.eep[halRtc.eepPtr];
+      halRtc.eepPtr = (halRtc.eepPtr + 1) & (sizeof(halRtc.eep) - 1);
+    }
+  }
+  else if (halHt_t* ht = htAt(addr)) {
+    for (uint8_t i = 0; i < count; i++) {
+      _rx[_rxLen++] = ht->ram[ht->ptr];
+      ht->ptr = (ht->ptr + 1) & 0x0F;
+    }
+  }
+  return _rxLen;
+}
+
+int TwoWire::available() {
+  return _rxLen - _rxIdx;
+}
+
+int TwoWire::read() {
+  if (_rxIdx >= _rxLen)
+    return -1;
+  return _rx[_rxIdx++];
+}
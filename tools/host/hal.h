@@ -0,0 +1,165 @@
+/**
+  hal.h - Emulated ATmega328P board for the host harnesses
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  The sketch runs on virtual time, in microseconds since power on.  The
+  harness advances it between the loops, the core calls charge their
+  own time, so the busy waits end.  The interrupts run from the emulated
+  timers and pins while the time advances, never from inside an
+  interrupt.  The sketch may run on a stack at the end of the emulated
+  RAM, so the stack painting measures the host frames.  Emulated: the
+  MAX7219 chains and the APA102 LEDs on the SPI bus, the DS3231 RTC,
+  its AT24C32 EEPROM and the HT16K33 backpacks on I2C, the internal
+  EEPROM, the watchdog, the ADC inputs, the buttons, the IR receiver
+  and the serial port.
+*/
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <Arduino.h>
+#include <setjmp.h>
+#include <string>
+
+#define HAL_CHAINS    2         // MAX7219 chains
+#define HAL_DEVICES   8         // Devices in a chain, at most
+#define HAL_PANELS    8         // HT16K33 backpacks or APA102 panels, at most
+#define HAL_HT_ADDR   0x70      // I2C address of the first HT16K33 backpack
+#define HAL_RAM       2048      // Emulated RAM size, bytes
+#define HAL_STACK     16384     // Room past it for the host stack frames, see halCall()
+#define HAL_SER_OUT   (1UL << 20) // Serial output kept, on the sketch stack, bytes
+
+// One emulated MAX7219 chain
+struct halChain_t {
+  uint8_t   cs;                           // CS pin, 0 for none
+  uint8_t   devices;                      // Devices in the chain
+  uint8_t   regs[HAL_DEVICES][16];        // Latched registers of each device
+  uint8_t   shift[2 * HAL_DEVICES];       // The shift registers, the nearest device first
+  bool      sel;                          // CS low
+  uint32_t  bytes;                        // Bytes clocked in
+  uint32_t  latches;                      // CS rising edges
+  bool      loop;                         // DOUT of the last device looped back to MISO
+  uint8_t   broken;                       // The broken device, its DOUT stuck low, 1 the nearest, 0 for none
+  uint32_t  errClock;                     // Bit errors above this SPI clock, 0 for none
+  uint8_t   errEvery;                     // A bit flipped every so many bytes, then
+  uint32_t  errors;                       // Bits flipped
+};
+
+// One emulated HT16K33 backpack
+struct halHt_t {
+  bool      present;                      // Answers on the bus
+  uint8_t   ram[16];                      // Display RAM, two bytes for each row output
+  uint8_t   ptr;                          // Display RAM address pointer
+  bool      osc;                          // Oscillator on
+  bool      rowOut;                       // ROW/INT pin as row output
+  uint8_t   disp;                         // Display setup: bit 0 on, then the blinking
+  uint8_t   dim;                          // Dimming, 0..15
+  uint32_t  bytes;                        // Bytes received, with the address
+};
+
+// The emulated APA102 LEDs, a bus buffer on their clock and data lines
+struct halLeds_t {
+  uint8_t   en;                           // Enable pin of the bus buffer, active low, 0 for none
+  uint16_t  count;                        // LEDs, 64 for each panel
+  uint8_t   led[HAL_PANELS * 64][4];      // Each LED: brightness, blue, green, red
+  uint8_t   frame[4];                     // The LED frame being shifted in
+  uint8_t   pos;                          // Its byte
+  uint16_t  next;                         // The LED the next frame goes to
+  uint8_t   zeros;                        // Zero bytes in a row, between the LED frames
+  uint32_t  bytes;                        // Bytes clocked in
+  uint32_t  starts;                       // Start frames
+};
+
+// The emulated DS3231 and its EEPROM
+struct halRtc_t {
+  bool      present;                      // Answers on the bus
+  uint8_t   regs[0x13];                   // The registers
+  uint8_t   ptr;                          // Register pointer
+  uint32_t  us;                           // Microseconds into the current second
+  int16_t   ppm;                          // Drift, 1/100 ppm, positive is fast
+  int64_t   drift;                        // The drift not counted yet, 1/10^8 us
+  bool      eepPresent;                   // The AT24C32 answers on the bus
+  uint8_t   eep[4096];                    // The AT24C32 memory
+  uint16_t  eepPtr;                       // Its address pointer
+  uint64_t  eepBusy;                      // End of its write cycle
+  uint32_t  eepCycles;                    // Write cycles
+  uint32_t  eepWrapped;                   // Bytes written past the end of the page, at its start
+  uint16_t  eepWear[128];                 // Write cycles of each page
+};
+
+// Faults on the I2C bus
+struct halI2c_t {
+  uint8_t   nacks;                        // Transactions to NACK, the address not acknowledged
+  uint8_t   nackAddr;                     // The address to NACK, 0 for any
+  uint8_t   stuck;                        // SDA held low, released after so many SCL clocks, 0xFF never
+  uint32_t  nacked;                       // Transactions NACKed
+  uint32_t  timeouts;                     // Transactions timed out
+  uint32_t  clocks;                       // SCL clocks driven by hand
+};
+
+// Virtual time, us since power on
+extern uint64_t   halNow;
+// The millis() value at power on
+extern uint32_t   halMillis0;
+// Time charged by each core call, us
+extern uint8_t    halCallCost;
+
+extern halChain_t halChains[HAL_CHAINS];
+extern halRtc_t   halRtc;
+extern halHt_t    halHts[HAL_PANELS];
+extern halLeds_t  halLeds;
+extern halI2c_t   halI2c;
+
+// Bus errors: SPI bytes with no chain, or several chains, selected
+extern uint32_t   halSpiStray;
+extern uint32_t   halSpiClash;
+// Watchdog interrupts and resets
+extern uint32_t   halWdtIrqs;
+extern uint32_t   halWdtResets;
+// The longest time between two watchdog feeds, us
+extern uint64_t   halWdtMaxGap;
+// Where a watchdog reset jumps to, abort() if not set
+extern jmp_buf*   halResetJmp;
+// The serial output, not yet read by the harness
+extern std::string halSerialOut;
+// The emulated RAM, the stack at its end
+extern char       halRam[HAL_RAM + HAL_STACK];
+// Run the sketch on the stack in the emulated RAM, see halCall()
+extern bool       halStack;
+
+void      halPowerOn(uint32_t millis0 = 0);
+void      halAdvance(uint64_t us);
+void      halCharge(uint32_t us);
+void      halCall(void (*fn)());
+void      halChainAttach(uint8_t chain, uint8_t cs, uint8_t devices);
+void      halChainPixels(uint8_t chain, uint8_t* cols);
+void      halHtAttach(uint8_t devices);
+void      halHtPixels(uint8_t* cols);
+void      halLedsAttach(uint8_t en, uint8_t panels);
+void      halLedsPixels(uint8_t* cols);
+void      halSerialIn(const char* data, size_t len);
+size_t    halSerialPending();
+void      halIR(uint16_t address, uint8_t command);
+void      halPin(uint8_t pin, uint8_t level);
+void      halAnalog(uint8_t channel, uint16_t value);
+void      halVcc(uint16_t mv);
+void      halMcuTemp(int16_t centi);
+void      halRtcSet(uint16_t Y, uint8_t m, uint8_t d, uint8_t H, uint8_t M, uint8_t S);
+void      halRtcTemp(int16_t quarters);
+uint8_t   halRtcPin();
+
+#endif /* HAL_H */
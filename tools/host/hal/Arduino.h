@@ -0,0 +1,261 @@
+/**
+  Arduino.h - Host stand-in for the Arduino core of the ATmega328P
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Only what the sketch and its libraries use.  The program memory is
+  plain memory, the interrupts are called by the emulated hardware in
+  hal.cpp, on virtual time.
+*/
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "binary.h"
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define F_CPU 16000000UL
+
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+#define CHANGE        1
+#define FALLING       2
+#define RISING        3
+#define DEC           10
+#define HEX           16
+#define LSBFIRST      0
+#define MSBFIRST      1
+
+// Pins
+static const uint8_t SS = 10, MOSI = 11, MISO = 12, SCK = 13;
+static const uint8_t A0 = 14, A1 = 15, A2 = 16, A3 = 17;
+static const uint8_t A4 = 18, A5 = 19, A6 = 20, A7 = 21;
+static const uint8_t SDA = 18, SCL = 19;
+#define NUM_PINS  22
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+
+#define _BV(b)                  (1 << (b))
+#define bit_is_set(r, b)        ((r) & _BV(b))
+#define bit_is_clear(r, b)      (not ((r) & _BV(b)))
+#define bitRead(v, b)           (((v) >> (b)) & 0x01)
+#define bitSet(v, b)            ((v) |= (1UL << (b)))
+#define bitClear(v, b)          ((v) &= ~(1UL << (b)))
+#define bitWrite(v, b, x)       ((x) ? bitSet(v, b) : bitClear(v, b))
+#define sq(x)                   ((x) * (x))
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+
+template<class T, class U> inline T min(T a, U b) { return a < (T)b ? a : (T)b; }
+template<class T, class U> inline T max(T a, U b) { return a > (T)b ? a : (T)b; }
+template<class T, class U, class V> inline T constrain(T x, U l, V h) {
+  return x < (T)l ? (T)l : (x > (T)h ? (T)h : x);
+}
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+// Program memory is plain memory
+#define PROGMEM
+#define PSTR(s)             (s)
+#define pgm_read_byte(p)    (*(const uint8_t*)(p))
+#define pgm_read_word(p)    (*(const uint16_t*)(p))
+#define pgm_read_dword(p)   (*(const uint32_t*)(p))
+#define pgm_read_ptr(p)     (*(void* const*)(p))
+#define memcpy_P            memcpy
+#define strcmp_P            strcmp
+#define strncmp_P           strncmp
+#define strncpy_P           strncpy
+#define strstr_P            strstr
+#define strlen_P            strlen
+class __FlashStringHelper;
+#define F(s)                (reinterpret_cast<const __FlashStringHelper*>(s))
+
+// Interrupts are called from the emulated hardware, never nested
+#define ISR(vect)           extern "C" void vect(void)
+#define ISR_NAKED
+#define TIMER1_COMPA_vect   isrTimer1CompA
+#define TIMER2_COMPA_vect   isrTimer2CompA
+#define PCINT1_vect         isrPCInt1
+#define WDT_vect            isrWdt
+#define cli()
+#define sei()
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// The startup code sections and naked functions mean nothing here
+#define naked
+
+// Registers the sketch reads and writes directly
+extern volatile uint8_t  SREG, MCUSR, WDTCSR, GPIOR0;
+extern volatile uint8_t  TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint8_t  TCCR2A, TCCR2B, TIMSK2, TIFR2, TCNT2, OCR2A, OCR2B;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+extern volatile uint8_t  PCICR, PCMSK1, PCIFR, EICRA, EIMSK;
+extern volatile uint8_t  ADMUX, ACSR;
+extern volatile uint16_t ADCW;
+
+/**
+  The ADC control register: starting a conversion converts right away,
+  from the emulated input selected by ADMUX
+*/
+struct halAdcsra {
+  uint8_t v = 0;
+  operator uint8_t() const { return v; }
+  halAdcsra& operator =(uint8_t x);
+  halAdcsra& operator |=(uint8_t x) { return *this = v | x; }
+  halAdcsra& operator &=(uint8_t x) { return *this = v & x; }
+};
+extern halAdcsra ADCSRA;
+
+/**
+  The stack pointer, at the top of the emulated RAM
+*/
+struct halStackPtr {
+  operator uint8_t*() const;
+  operator char*() const;
+};
+extern halStackPtr SP;
+
+#define RAMSTART  0x100
+#define RAMEND    0x8FF
+#define E2END     0x3FF
+
+#define ADPS0   0
+#define ADPS1   1
+#define ADPS2   2
+#define ADIE    3
+#define ADIF    4
+#define ADATE   5
+#define ADSC    6
+#define ADEN    7
+#define MUX0    0
+#define MUX1    1
+#define MUX2    2
+#define MUX3    3
+#define ADLAR   5
+#define REFS0   6
+#define REFS1   7
+#define WGM10   0
+#define WGM11   1
+#define WGM12   3
+#define WGM13   4
+#define CS10    0
+#define CS11    1
+#define CS12    2
+#define OCIE1A  1
+#define OCIE1B  2
+#define OCF1A   1
+#define WGM20   0
+#define WGM21   1
+#define CS20    0
+#define CS21    1
+#define CS22    2
+#define OCIE2A  1
+#define OCF2A   1
+#define COM2B0  4
+#define COM2A0  6
+#define PCIE0   0
+#define PCIE1   1
+#define PCIE2   2
+#define PCIF1   1
+#define PCINT8  0
+#define PCINT9  1
+#define PCINT10 2
+#define PCINT11 3
+#define PORF    0
+#define EXTRF   1
+#define BORF    2
+#define WDRF    3
+#define WDE     3
+#define WDCE    4
+#define WDIE    6
+#define WDIF    7
+
+// Pins and time
+void          pinMode(uint8_t pin, uint8_t mode);
+void          digitalWrite(uint8_t pin, uint8_t val);
+int           digitalRead(uint8_t pin);
+int           analogRead(uint8_t pin);
+// The AVR long is 32 bits wide, the time wraps as on the board
+uint32_t      millis();
+uint32_t      micros();
+void          delay(unsigned long ms);
+void          delayMicroseconds(unsigned int us);
+void          tone(uint8_t pin, unsigned int freq, unsigned long duration = 0);
+void          noTone(uint8_t pin);
+void          attachInterrupt(uint8_t irq, void (*isr)(void), int mode);
+void          detachInterrupt(uint8_t irq);
+
+// Serial output
+class Print {
+  public:
+    virtual size_t write(uint8_t c) = 0;
+    size_t  write(const uint8_t* data, size_t size);
+    size_t  write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+    size_t  print(const __FlashStringHelper* str) { return write((const char*)str); }
+    size_t  print(const char* str) { return write(str); }
+    size_t  print(char c) { return write((uint8_t)c); }
+    size_t  print(unsigned char n, int base = DEC) { return printNumber(n, base); }
+    size_t  print(int n, int base = DEC) { return print((long)n, base); }
+    size_t  print(unsigned int n, int base = DEC) { return printNumber(n, base); }
+    size_t  print(long n, int base = DEC);
+    size_t  print(unsigned long n, int base = DEC) { return printNumber(n, base); }
+    size_t  print(double n, int digits = 2);
+    size_t  println() { return write("\r\n"); }
+    template<class T> size_t println(T x) { size_t n = print(x); return n + println(); }
+    template<class T> size_t println(T x, int f) { size_t n = print(x, f); return n + println(); }
+  private:
+    size_t  printNumber(unsigned long n, uint8_t base);
+};
+
+class HardwareSerial : public Print {
+  public:
+    void    begin(unsigned long baud) { (void)baud; }
+    int     available();
+    int     availableForWrite() { return 63; }
+    int     peek();
+    int     read();
+    void    flush() {}
+    size_t  write(uint8_t c);
+    using   Print::write;
+    operator bool() { return true; }
+};
+extern HardwareSerial Serial;
+
+// Linker symbols of the RAM sections, in the emulated RAM; renamed, the
+// host C library has its own
+#define __data_start    halDataStart
+#define __data_end      halDataEnd
+#define __bss_start     halBssStart
+#define __bss_end       halBssEnd
+#define __noinit_start  halNoinitStart
+#define __noinit_end    halNoinitEnd
+#define __heap_start    halHeapStart
+#define __brkval        halBrkval
+extern char __data_start, __data_end, __bss_start, __bss_end;
+extern char __noinit_start, __noinit_end, __heap_start;
+extern char *__brkval;
+
+#endif /* ARDUINO_H */
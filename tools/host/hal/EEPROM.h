@@ -0,0 +1,36 @@
+/**
+  EEPROM.h - Host stand-in for the Arduino EEPROM library, erased at
+  power on
+*/
+
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <Arduino.h>
+
+#define EEPROM_SIZE (E2END + 1)
+
+struct EEPROMClass {
+  uint8_t   read(int addr) { return data[addr & E2END]; }
+  void      write(int addr, uint8_t val) { data[addr & E2END] = val; writes++; }
+  void      update(int addr, uint8_t val) { if (read(addr) != val) write(addr, val); }
+  uint16_t  length() { return EEPROM_SIZE; }
+  uint8_t   operator[](int addr) const { return data[addr & E2END]; }
+  template<class T> T& get(int addr, T& t) {
+    uint8_t* p = (uint8_t*)&t;
+    for (size_t i = 0; i < sizeof(T); i++)
+      p[i] = read(addr + i);
+    return t;
+  }
+  template<class T> const T& put(int addr, const T& t) {
+    const uint8_t* p = (const uint8_t*)&t;
+    for (size_t i = 0; i < sizeof(T); i++)
+      update(addr + i, p[i]);
+    return t;
+  }
+  uint8_t   data[EEPROM_SIZE];
+  uint32_t  writes = 0;
+};
+extern EEPROMClass EEPROM;
+
+#endif /* EEPROM_H */
@@ -0,0 +1,24 @@
+/**
+  IRLremote.h - Host stand-in for the IRLremote NEC receiver, the
+  frames come from the harness
+*/
+
+#ifndef IRLREMOTE_H
+#define IRLREMOTE_H
+
+#include <Arduino.h>
+
+struct IRData {
+  uint16_t  address;
+  uint8_t   command;
+};
+
+class CNec {
+  public:
+    bool    begin(uint8_t pin) { (void)pin; return true; }
+    bool    end() { return true; }
+    bool    available();
+    IRData  read();
+};
+
+#endif /* IRLREMOTE_H */
@@ -0,0 +1,41 @@
+/**
+  SPI.h - Host stand-in for the Arduino SPI library
+
+  The bytes go to the emulated devices selected by their CS pins, the
+  bus time advances the virtual time.
+*/
+
+#ifndef SPI_H
+#define SPI_H
+
+#include <Arduino.h>
+
+#define SPI_MODE0       0x00
+#define SPI_MODE1       0x04
+#define SPI_MODE2       0x08
+#define SPI_MODE3       0x0C
+#define SPI_CLOCK_DIV2  0x04
+
+class SPISettings {
+  public:
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode): clock(clock) { (void)bitOrder; (void)dataMode; }
+    SPISettings(): clock(4000000) {}
+    uint32_t clock;
+};
+
+class SPIClass {
+  public:
+    static void     begin();
+    static void     end() {}
+    static void     beginTransaction(SPISettings settings);
+    static void     endTransaction() {}
+    static uint8_t  transfer(uint8_t data);
+    static uint16_t transfer16(uint16_t data);
+    static void     transfer(void* buf, size_t count);
+    static void     setBitOrder(uint8_t order) { (void)order; }
+    static void     setDataMode(uint8_t mode) { (void)mode; }
+    static void     setClockDivider(uint8_t div) { (void)div; }
+};
+extern SPIClass SPI;
+
+#endif /* SPI_H */
@@ -0,0 +1,46 @@
+/**
+  Wire.h - Host stand-in for the Arduino Wire library
+
+  The transactions go to the emulated I2C devices: the DS3231 RTC, the
+  AT24C32 EEPROM on its module and the HT16K33 backpacks.  With SDA
+  held low, see halI2c, a transaction ends at the timeout and sets the
+  timeout flag.
+*/
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <Arduino.h>
+
+#define BUFFER_LENGTH     32
+#define WIRE_HAS_TIMEOUT
+
+class TwoWire {
+  public:
+    void    begin();
+    void    end();
+    void    setClock(uint32_t clock) { (void)clock; }
+    void    setWireTimeout(uint32_t timeout = 25000, bool reset = false) { _timeout = timeout; (void)reset; }
+    bool    getWireTimeoutFlag() { return _timedOut; }
+    void    clearWireTimeoutFlag() { _timedOut = false; }
+    void    beginTransmission(uint8_t addr);
+    uint8_t endTransmission(bool stop = true);
+    uint8_t requestFrom(uint8_t addr, uint8_t count, uint8_t stop = true);
+    size_t  write(uint8_t data);
+    size_t  write(const uint8_t* data, size_t count);
+    int     available();
+    int     read();
+  private:
+    bool    timeout();
+    uint32_t _timeout = 0;
+    bool    _timedOut = false;
+    uint8_t _addr = 0;
+    uint8_t _tx[BUFFER_LENGTH];
+    uint8_t _txLen = 0;
+    uint8_t _rx[BUFFER_LENGTH];
+    uint8_t _rxLen = 0;
+    uint8_t _rxIdx = 0;
+};
+extern TwoWire Wire;
+
+#endif /* WIRE_H */
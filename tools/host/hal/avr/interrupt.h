@@ -0,0 +1,5 @@
+/**
+  avr/interrupt.h - Host stand-in, all in Arduino.h
+*/
+
+#include <Arduino.h>
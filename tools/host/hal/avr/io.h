@@ -0,0 +1,5 @@
+/**
+  avr/io.h - Host stand-in, all in Arduino.h
+*/
+
+#include <Arduino.h>
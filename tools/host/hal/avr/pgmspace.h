@@ -0,0 +1,5 @@
+/**
+  avr/pgmspace.h - Host stand-in, all in Arduino.h
+*/
+
+#include <Arduino.h>
@@ -0,0 +1,18 @@
+/**
+  avr/sleep.h - Host stand-in, sleeping does not wait
+*/
+
+#ifndef AVR_SLEEP_H
+#define AVR_SLEEP_H
+
+#define SLEEP_MODE_IDLE     0
+#define SLEEP_MODE_ADC      1
+#define SLEEP_MODE_PWR_DOWN 2
+
+inline void set_sleep_mode(uint8_t mode) { (void)mode; }
+inline void sleep_enable() {}
+inline void sleep_disable() {}
+inline void sleep_cpu() {}
+inline void sleep_mode() {}
+
+#endif /* AVR_SLEEP_H */
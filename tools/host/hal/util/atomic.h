@@ -0,0 +1,12 @@
+/**
+  util/atomic.h - Host stand-in, the interrupts never preempt the sketch
+*/
+
+#ifndef UTIL_ATOMIC_H
+#define UTIL_ATOMIC_H
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON      1
+#define ATOMIC_BLOCK(type)  for (uint8_t _atomic = 1; _atomic; _atomic = 0)
+
+#endif /* UTIL_ATOMIC_H */
@@ -0,0 +1,200 @@
+/**
+  harness.cpp - Run the sketch on the emulated board, for the host tests
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "harness.h"
+#include "DS3231.h"
+
+uint32_t  hrnChecks = 0;
+uint32_t  hrnFailed = 0;
+uint32_t  hrnStep   = 1000;
+void    (*hrnHook)() = nullptr;
+void    (*hrnWire)() = nullptr;
+
+// The serial output already taken
+static size_t serTaken = 0;
+
+// The sketch RAM, its data and bss sections, see the Makefile
+extern char __start_sketch_data[], __stop_sketch_data[];
+extern char __start_sketch_bss[],  __stop_sketch_bss[];
+// Their content at the first boot, the globals constructed
+static std::string ramData, ramBss;
+
+/**
+  Keep the sketch RAM at the first boot, bring it back at the next ones.
+  The redzones of the sanitizers between the globals are copied too.
+
+  @param keep keep the RAM or bring it back
+  @param from the section start
+  @param to the section end
+  @param copy the content kept
+*/
+__attribute__((no_sanitize_address))
+static void hrnRam(bool keep, char* from, char* to, std::string &copy) {
+  if (keep)
+    copy.resize(to - from);
+  for (char* p = from; p < to; p++)
+    if (keep)
+      copy[p - from] = *p;
+    else
+      *p = copy[p - from];
+}
+
+/**
+  Power the board on, or bring it out of a watchdog reset, with the
+  matrices chains on their CS pins and the RTC set, initialize and paint
+  the RAM and turn the watchdog off as the startup code does and run
+  setup()
+
+  @param millis0 the millis() value at power on, to test its rollover
+*/
+void hrnBoot(uint16_t Y, uint8_t m, uint8_t d, uint8_t H, uint8_t M, uint8_t S, uint32_t millis0) {
+  halPowerOn(millis0);
+  halChainAttach(0, HRN_CS, HRN_DEVICES);
+#ifdef MTX2_CS_PIN
+  halChainAttach(1, MTX2_CS_PIN, HRN_DEVICES);
+#endif
+  halRtcSet(Y, m, d, H, M, S);
+  if (hrnWire)
+    hrnWire();
+  serTaken = 0;
+  static bool first = true;
+  hrnRam(first, __start_sketch_data, __stop_sketch_data, ramData);
+  hrnRam(first, __start_sketch_bss, __stop_sketch_bss, ramBss);
+  first = false;
+  memPaint();
+  wdtOff();
+  halCall(setup);
+}
+
+/**
+  Run the loop for some virtual time
+
+  @param us the microseconds
+*/
+void hrnRun(uint64_t us) {
+  uint64_t end = halNow + us;
+  while (halNow < end) {
+    halCall(loop);
+    if (hrnHook)
+      hrnHook();
+    if (halNow < end)
+      halAdvance(min((uint64_t)hrnStep, end - halNow));
+  }
+}
+
+/**
+  Run the loop until a condition is met
+
+  @param done the condition
+  @param timeout the longest virtual time to run, us
+  @return true if met
+*/
+bool hrnRunUntil(bool (*done)(), uint64_t timeout) {
+  uint64_t end = halNow + timeout;
+  while (halNow < end) {
+    halCall(loop);
+    if (hrnHook)
+      hrnHook();
+    if (done())
+      return true;
+    halAdvance(hrnStep);
+  }
+  return false;
+}
+
+/**
+  Take the serial output printed since the last call
+
+  @return the output
+*/
+std::string hrnSerial() {
+  std::string out = halSerialOut.substr(serTaken);
+  serTaken = halSerialOut.size();
+  return out;
+}
+
+/**
+  Check if the reply to a command has ended, with OK or ERROR
+*/
+static bool hrnReplied() {
+  const std::string &out = halSerialOut;
+  size_t from = serTaken;
+  return out.find("OK\r\n", from) != std::string::npos or
+         out.find("ERROR\r\n", from) != std::string::npos;
+}
+
+/**
+  Send an AT command and run until it is answered
+
+  @param cmd the command, without the line end
+  @param timeout the longest virtual time to wait, us
+  @return the output, from the echo to the result code
+*/
+std::string hrnCommand(const char* cmd, uint64_t timeout) {
+  // The hook would take the reply
+  void (*hook)() = hrnHook;
+  hrnHook = nullptr;
+  hrnSerial();
+  std::string line = std::string(cmd) + "\r";
+  halSerialIn(line.data(), line.size());
+  hrnRunUntil(hrnReplied, timeout);
+  hrnHook = hook;
+  return hrnSerial();
+}
+
+/**
+  The pixels a chain shows, as hex, a device after another
+
+  @param chain the chain index
+  @return the columns, two hex digits each
+*/
+std::string hrnFrame(uint8_t chain) {
+  uint8_t cols[HAL_DEVICES * 8];
+  char hex[3];
+  std::string s;
+  halChainPixels(chain, cols);
+  for (uint8_t c = 0; c < halChains[chain].devices * 8; c++) {
+    snprintf(hex, sizeof(hex), "%02x", cols[c]);
+    s += hex;
+  }
+  return s;
+}
+
+/**
+  The time of the emulated RTC, as the sketch prints it
+
+  @return the time, HH:MM
+*/
+std::string hrnRtcTime() {
+  char s[6];
+  snprintf(s, sizeof(s), "%02x:%02x", halRtc.regs[RTC_HOURS] & 0x3F, halRtc.regs[RTC_MINUTES]);
+  return s;
+}
+
+/**
+  Print the result of the checks
+
+  @param name the test name
+  @return the exit code, 0 if all passed
+*/
+int hrnDone(const char* name) {
+  printf("%s: %u checks, %u failed, %.1f days virtual\n",
+         name, hrnChecks, hrnFailed, halNow / 86400e6);
+  return hrnFailed ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+/**
+  harness.h - Run the sketch on the emulated board, for the host tests
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Booting the board again, as after a reset, brings the sketch globals
+  back to their state at the first boot, as the startup code would.
+  The loop runs as fast as the host can, the virtual
+  time advancing a step after each pass, so days go by in seconds.
+*/
+
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <stdio.h>
+#include <string>
+
+#include "hal.h"
+
+// The sketch
+void setup();
+void loop();
+void memPaint();
+void wdtOff();
+
+// The CS pin of the matrices chain and its devices
+#define HRN_CS      10
+#define HRN_DEVICES 4
+
+// A check, counted and printed when it fails
+#define CHECK(cond, ...) \
+  do { hrnChecks++; if (not (cond)) { hrnFailed++; \
+      fprintf(stderr, "%s:%d: FAIL %s: ", __FILE__, __LINE__, #cond); \
+      fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); } } while (0)
+
+extern uint32_t hrnChecks;
+extern uint32_t hrnFailed;
+// Virtual time to advance after each loop, us
+extern uint32_t hrnStep;
+// Called after each loop, if set
+extern void   (*hrnHook)();
+// Called at boot, before setup(), to wire the board otherwise, if set
+extern void   (*hrnWire)();
+
+void        hrnBoot(uint16_t Y, uint8_t m, uint8_t d, uint8_t H, uint8_t M, uint8_t S,
+                    uint32_t millis0 = 0);
+void        hrnRun(uint64_t us);
+bool        hrnRunUntil(bool (*done)(), uint64_t timeout);
+std::string hrnSerial();
+std::string hrnCommand(const char* cmd, uint64_t timeout = 2000000);
+std::string hrnFrame(uint8_t chain = 0);
+std::string hrnRtcTime();
+int         hrnDone(const char* name);
+
+#endif /* HARNESS_H */
@@ -0,0 +1,360 @@
+/**
+  run.cpp - Run the sketch on the emulated board, record and replay
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: run [-t "YYYY-MM-DD HH:MM:SS"] [-m MILLIS0] [-d SECONDS]
+             [-x FACTOR] [-s STEP] [-f] [-r TRACE | -p TRACE]
+
+  The lines typed on the standard input go to the serial port, the
+  serial output goes to the standard output.  The lines starting with
+  '!' drive the board:
+
+    !ir ADDR CMD    an IR remote frame, hex
+    !btn PIN        press a button for 100ms
+    !temp QUARTERS  the RTC temperature, in quarters of degree
+    !vcc MV         the supply voltage
+    !quit           stop
+
+  The virtual time runs FACTOR times faster than the wall clock, or as
+  fast as it can with -x 0, for the given seconds or until the input
+  ends.  -f prints the frames as they change.  -r records a trace: the
+  start, the inputs at their virtual times, the serial lines and the
+  frames they produce.  -p plays a trace back and checks that the same
+  lines and frames come out at the same times; the exit code is 1 if
+  they do not.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/select.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "harness.h"
+
+// A trace event
+struct event_t {
+  uint64_t    at;                 // Virtual time, us
+  char        type;               // '<' serial in, '>' serial out, 'F' frame, 'I' IR, 'B' pin, 'T' temperature, 'V' supply
+  std::string arg;
+};
+
+static std::deque<event_t>  inputs;     // Inputs to apply, in time order
+static std::vector<event_t> expected;   // Replay: the outputs to check
+static std::vector<event_t> produced;   // The outputs so far
+static FILE*        rec = nullptr;      // Trace being recorded
+static bool         frames = false;     // Print the frames
+static std::string  lastFrame;
+static std::string  serLine;            // Serial output, the line not ended yet
+static bool         quit = false;
+
+
+/**
+  Write an event to the trace being recorded
+*/
+static void record(const event_t &e) {
+  if (rec)
+    fprintf(rec, "%llu %c %s\n", (unsigned long long)e.at, e.type, e.arg.c_str());
+}
+
+/**
+  Print a frame, the leftmost column first, the top row first
+*/
+static void printFrame(const std::string &hex) {
+  size_t cols = hex.size() / 2;
+  for (uint8_t r = 0; r < 8; r++) {
+    std::string line;
+    for (size_t x = 0; x < cols; x++) {
+      uint8_t v = strtoul(hex.substr((cols - 1 - x) * 2, 2).c_str(), nullptr, 16);
+      line += (v & (0x80 >> r)) ? '#' : '.';
+    }
+    printf("%s\n", line.c_str());
+  }
+  printf("\n");
+}
+
+/**
+  Collect the outputs after a loop: the ended serial lines and the frame,
+  if changed
+*/
+static void collect() {
+  serLine += hrnSerial();
+  size_t eol;
+  while ((eol = serLine.find('\n')) != std::string::npos) {
+    std::string line = serLine.substr(0, eol);
+    serLine.erase(0, eol + 1);
+    while (not line.empty() and line.back() == '\r')
+      line.pop_back();
+    event_t e = {halNow, '>', line};
+    produced.push_back(e);
+    record(e);
+    if (expected.empty())
+      printf("%s\n", line.c_str());
+  }
+  // The pixels change only when the chain latches
+  static uint32_t latches = 0;
+  if (halChains[0].latches == latches)
+    return;
+  latches = halChains[0].latches;
+  std::string f = hrnFrame(0);
+  if (f != lastFrame) {
+    lastFrame = f;
+    event_t e = {halNow, 'F', f};
+    produced.push_back(e);
+    record(e);
+    if (frames)
+      printFrame(f);
+  }
+}
+
+/**
+  Apply an input to the board
+*/
+static void apply(const event_t &e) {
+  record(e);
+  switch (e.type) {
+    case '<': {
+        std::string line = e.arg + "\r";
+        halSerialIn(line.data(), line.size());
+        break;
+      }
+    case 'I': {
+        unsigned addr, cmd;
+        if (sscanf(e.arg.c_str(), "%x %x", &addr, &cmd) == 2)
+          halIR(addr, cmd);
+        break;
+      }
+    case 'B': {
+        unsigned pin, level;
+        if (sscanf(e.arg.c_str(), "%u %u", &pin, &level) == 2)
+          halPin(pin, level);
+        break;
+      }
+    case 'T':
+      halRtcTemp(atoi(e.arg.c_str()));
+      break;
+    case 'V':
+      halVcc(atoi(e.arg.c_str()));
+      break;
+  }
+}
+
+/**
+  Queue an input, in time order
+*/
+static void schedule(const event_t &e) {
+  auto it = inputs.begin();
+  while (it != inputs.end() and it->at <= e.at)
+    it++;
+  inputs.insert(it, e);
+}
+
+/**
+  Turn a typed line into inputs, now
+*/
+static void typed(std::string line) {
+  while (not line.empty() and (line.back() == '\n' or line.back() == '\r'))
+    line.pop_back();
+  if (line.empty() or line[0] != '!') {
+    schedule({halNow, '<', line});
+    return;
+  }
+  char what[8] = "";
+  char a[16] = "", b[16] = "";
+  sscanf(line.c_str() + 1, "%7s %15s %15s", what, a, b);
+  if (not strcmp(what, "ir"))
+    schedule({halNow, 'I', std::string(a) + " " + b});
+  else if (not strcmp(what, "btn")) {
+    schedule({halNow, 'B', std::string(a) + " 0"});
+    schedule({halNow + 100000, 'B', std::string(a) + " 1"});
+  }
+  else if (not strcmp(what, "temp"))
+    schedule({halNow, 'T', a});
+  else if (not strcmp(what, "vcc"))
+    schedule({halNow, 'V', a});
+  else if (not strcmp(what, "quit"))
+    quit = true;
+  else
+    fprintf(stderr, "Unknown: %s\n", line.c_str());
+}
+
+/**
+  Read the typed lines, if any, without waiting
+
+  @return false at the end of the input
+*/
+static bool poll() {
+  static std::string part;
+  fd_set fds;
+  struct timeval tv = {0, 0};
+  FD_ZERO(&fds);
+  FD_SET(0, &fds);
+  while (select(1, &fds, nullptr, nullptr, &tv) > 0) {
+    char buf[256];
+    ssize_t n = read(0, buf, sizeof(buf));
+    if (n <= 0)
+      return false;
+    part.append(buf, n);
+    size_t eol;
+    while ((eol = part.find('\n')) != std::string::npos) {
+      typed(part.substr(0, eol));
+      part.erase(0, eol + 1);
+    }
+  }
+  return true;
+}
+
+/**
+  Load a trace: the start, the inputs and the outputs to check
+
+  @return the end of the trace, us
+*/
+static uint64_t load(const char* name, char* start, uint32_t &millis0) {
+  FILE* f = fopen(name, "r");
+  if (f == nullptr) {
+    perror(name);
+    exit(2);
+  }
+  uint64_t end = 0;
+  char line[1024];
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '#' or line[0] == '\0')
+      continue;
+    if (line[0] == '@') {
+      char date[11], time[9];
+      if (sscanf(line, "@ %10s %8s %u", date, time, &millis0) >= 2)
+        snprintf(start, 20, "%s %s", date, time);
+      continue;
+    }
+    unsigned long long at;
+    char type;
+    int pos = 0;
+    if (sscanf(line, "%llu %c %n", &at, &type, &pos) < 2)
+      continue;
+    event_t e = {at, type, line + pos};
+    if (type == '>' or type == 'F')
+      expected.push_back(e);
+    else if (type == 'E')
+      end = at;
+    else
+      inputs.push_back(e);
+  }
+  fclose(f);
+  return end;
+}
+
+/**
+  Compare the outputs to the expected ones
+
+  @return true if the same
+*/
+static bool check(const char* name) {
+  size_t n = min(expected.size(), produced.size());
+  for (size_t i = 0; i < n; i++) {
+    const event_t &x = expected[i], &y = produced[i];
+    if (x.at != y.at or x.type != y.type or x.arg != y.arg) {
+      fprintf(stderr, "%s: event %zu differs\n  expected %llu %c %s\n  got      %llu %c %s\n", name, i,
+              (unsigned long long)x.at, x.type, x.arg.c_str(),
+              (unsigned long long)y.at, y.type, y.arg.c_str());
+      return false;
+    }
+  }
+  if (expected.size() != produced.size()) {
+    fprintf(stderr, "%s: %zu events expected, %zu produced\n", name, expected.size(), produced.size());
+    return false;
+  }
+  printf("%s: %zu events replayed\n", name, produced.size());
+  return true;
+}
+
+int main(int argc, char** argv) {
+  char      start[20] = "2018-01-01 12:00:00";
+  uint32_t  millis0 = 0;
+  double    seconds = 0, factor = 1;
+  const char* replay = nullptr;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:m:d:x:s:fr:p:")) != -1)
+    switch (opt) {
+      case 't': snprintf(start, sizeof(start), "%s", optarg); break;
+      case 'm': millis0 = strtoul(optarg, nullptr, 0); break;
+      case 'd': seconds = atof(optarg); break;
+      case 'x': factor = atof(optarg); break;
+      case 's': hrnStep = atoi(optarg); break;
+      case 'f': frames = true; break;
+      case 'r':
+        rec = fopen(optarg, "w");
+        if (rec == nullptr) {
+          perror(optarg);
+          return 2;
+        }
+        break;
+      case 'p': replay = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-t START] [-m MILLIS0] [-d SECONDS] [-x FACTOR] [-s STEP] [-f] [-r TRACE | -p TRACE]\n", argv[0]);
+        return 2;
+    }
+  uint64_t end = seconds * 1e6;
+  if (replay) {
+    end = load(replay, start, millis0);
+    factor = 0;
+  }
+  unsigned Y, m, d, H, M, S;
+  if (sscanf(start, "%u-%u-%u %u:%u:%u", &Y, &m, &d, &H, &M, &S) != 6) {
+    fprintf(stderr, "Bad start: %s\n", start);
+    return 2;
+  }
+  if (rec)
+    fprintf(rec, "# Recorded by run, replay with run -p\n@ %s %u\n", start, millis0);
+
+  hrnBoot(Y, m, d, H, M, S, millis0);
+  collect();
+  struct timespec t0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  bool typing = replay == nullptr;
+  while (not quit and (end ? halNow < end : typing)) {
+    if (typing and not poll())
+      typing = false;
+    while (not inputs.empty() and inputs.front().at <= halNow) {
+      apply(inputs.front());
+      inputs.pop_front();
+    }
+    halCall(loop);
+    collect();
+    halAdvance(hrnStep);
+    // Keep the pace, the virtual time is FACTOR times the wall clock
+    if (factor > 0) {
+      struct timespec t;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      double wall = (t.tv_sec - t0.tv_sec) + (t.tv_nsec - t0.tv_nsec) / 1e9;
+      double ahead = halNow / 1e6 / factor - wall;
+      if (ahead > 0.001)
+        usleep(ahead * 1e6);
+    }
+  }
+  if (rec) {
+    fprintf(rec, "%llu E\n", (unsigned long long)halNow);
+    fclose(rec);
+  }
+  if (replay)
+    return check(replay) ? 0 : 1;
+  return 0;
+}
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""
+  sketch.py - Turn the sketch into a C++ translation unit for the host
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: sketch.py SKETCH.ino OUTPUT.cpp
+
+  As the Arduino builder does: include Arduino.h first and declare the
+  prototypes of the functions before the first function, the default
+  arguments left to the definitions.  The #line directives keep the
+  compiler messages pointing into the sketch.
+"""
+
+import re
+import sys
+
+# A function definition at the start of a line
+FUNC = re.compile(r'^([A-Za-z_][\w<>\*&: \t]*?[\s\*&]+(\w+)\s*\(([^;{)]*)\))\s*\{', re.M)
+# Not functions
+KEYWORDS = ('if', 'while', 'for', 'switch', 'return', 'ISR')
+
+
+def prototypes(src):
+    """ The prototypes of the functions defined in the sketch """
+    protos = []
+    for m in FUNC.finditer(src):
+        if m.group(2) in KEYWORDS or m.group(1).split()[0] in ('struct', 'class', 'enum', 'union'):
+            continue
+        # Drop the default arguments
+        sig = re.sub(r'\s*=\s*[^,)]+', '', m.group(1))
+        protos.append((m.start(), ' '.join(sig.split()) + ';'))
+    return protos
+
+
+def main():
+    ino, out = sys.argv[1], sys.argv[2]
+    src = open(ino).read()
+    protos = prototypes(src)
+    if not protos:
+        sys.exit('%s: no functions' % ino)
+    # Before the first function, and before its doc comment
+    pos = protos[0][0]
+    end = src.rfind('*/', 0, pos)
+    if end >= 0 and src[end + 2:pos].strip() == '':
+        pos = src.rfind('/*', 0, end)
+    line = src.count('\n', 0, pos) + 1
+    with open(out, 'w') as f:
+        f.write('#include <Arduino.h>\n')
+        f.write('#line 1 "%s"\n' % ino)
+        f.write(src[:pos])
+        f.write('\n'.join(p for _, p in protos) + '\n')
+        f.write('#line %d "%s"\n' % (line, ino))
+        f.write(src[pos:])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+"""
+  stack.py - The worst case stack depth, from the compiler call graph
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: stack.py [-q] [--isr FUNC] [--extern BYTES] [--call BYTES] FILE.ci...
+
+  Reads the call graphs gcc writes with -fcallgraph-info=su, a frame
+  size on each function, and walks them from setup() and loop(), and
+  from each interrupt handler, the deepest path first.  The virtual
+  calls go to each override of the method, found in the class
+  declarations of the headers; the other indirect calls, recursion and
+  unbounded dynamic frames can not be bounded and fail.
+
+  An interrupt may come on top of the deepest main path, so the bound
+  is the main depth and the deepest handler.  On the host, the handlers
+  are called from FUNC instead, its indirect calls go to them and the
+  graph already holds them.  The frames of the functions without a call
+  graph, the libraries, are taken as BYTES each, and each call is
+  charged BYTES more on targets whose frame sizes do not hold the
+  return address.  -q prints only the bound.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+NODE = re.compile(r'node: \{ title: "([^"]*)" label: "([^"]*)"( shape : ellipse)? \}')
+EDGE = re.compile(r'edge: \{ sourcename: "([^"]*)" targetname: "([^"]*)"(?: label: "([^"]*)")? \}')
+SIZE = re.compile(r'(\d+) bytes \((static|dynamic,bounded|dynamic)\)')
+CLASS = re.compile(r'\b(?:class|struct)\s+(\w+)\s*(?::\s*([^{;]+))?\{')
+VIRTUAL = re.compile(r'\bvirtual\s+[^;{(]*?\b(~?\w+)\s*\(')
+# The interrupt handlers: the host names, see hal/Arduino.h, and the avr-gcc ones
+ISR = re.compile(r'^isr[A-Z]\w*$|_vect$|^__vector_\d+$')
+ROOTS = ('_Z5setupv', '_Z4loopv')
+INDIRECT = '__indirect_call'
+
+
+class Func:
+    """ A function: its name, where it is defined and its frame """
+
+    def __init__(self, title, label):
+        lines = label.split('\\n')
+        self.title = title
+        self.name = lines[0]
+        self.where = lines[1] if len(lines) > 1 else ''
+        self.size = None
+        self.kind = 'extern'
+        m = SIZE.match(lines[2]) if len(lines) > 2 else None
+        if m:
+            self.size, self.kind = int(m.group(1)), m.group(2)
+        self.calls = []         # (target, call site)
+
+    def arity(self):
+        """ The parameters """
+        return arity(self.name[self.name.find('('):], True)
+
+    def method(self):
+        """ The class and the method name, or None """
+        head = self.name[:self.name.find('(')]
+        # The qualified name, the last word outside the template arguments
+        depth, start = 0, 0
+        for i, c in enumerate(head):
+            if c == '<':
+                depth += 1
+            elif c == '>':
+                depth -= 1
+            elif c == ' ' and depth == 0:
+                start = i + 1
+        qual = head[start:]
+        if '::' not in qual:
+            return None
+        cls, name = qual.rsplit('::', 1)
+        return re.sub(r'<.*>', '', cls).split('::')[-1], name
+
+
+def load(files):
+    """ The functions of all the call graphs, merged by name """
+    funcs = {}
+    for name in files:
+        edges = []
+        for line in open(name):
+            m = NODE.match(line)
+            if m:
+                f = Func(m.group(1), m.group(2))
+                old = funcs.get(f.title)
+                # Defined inline in several units, the largest frame
+                if old is None or old.size is None or (f.size or 0) > old.size:
+                    if old:
+                        f.calls = old.calls
+                    funcs[f.title] = f
+                continue
+            m = EDGE.match(line)
+            if m:
+                edges.append(m.groups())
+        seen = set()
+        for src, dst, site in edges:
+            if (src, dst, site) not in seen and src in funcs:
+                seen.add((src, dst, site))
+                funcs[src].calls.append((dst, site))
+    for f in funcs.values():
+        f.calls = sorted(set(f.calls), key=lambda c: (c[0], c[1] or ''))
+    return funcs
+
+
+class Classes:
+    """ The classes of the headers and their bases """
+
+    def __init__(self, dirs):
+        self.bases, self.src = {}, ''
+        for d in dirs:
+            for name in sorted(os.listdir(d)):
+                if name.endswith('.h'):
+                    src = re.sub(r'//[^\n]*|/\*.*?\*/', '', open(os.path.join(d, name)).read(), flags=re.S)
+                    self.src += src
+                    for m in CLASS.finditer(src):
+                        self.bases.setdefault(m.group(1), set()).update(
+                            re.sub(r'<.*>', '', b.split()[-1]) for b in (m.group(2) or '').split(',') if b.strip())
+
+    def derives(self, cls, base, seen=()):
+        """ The class is the base or derives from it """
+        return cls == base or any(self.derives(b, base, seen + (cls,))
+                                  for b in self.bases.get(cls, ()) if b not in seen)
+
+    def type(self, var):
+        """ The class a pointer or a reference is declared to, or None """
+        m = re.search(r'\b(\w+)\s*[\*&]\s*' + re.escape(var) + r'\b', self.src)
+        return m.group(1) if m else None
+
+
+def arity(args, angle=False):
+    """ The arguments in the parenthesized list the text starts with """
+    opens, closes = ('(<[{', ')>]}') if angle else ('([{', ')]}')
+    depth, n, empty = 0, 0, True
+    for c in args:
+        if c in opens:
+            depth += 1
+            if depth == 1:
+                continue
+        elif c in closes:
+            depth -= 1
+            if depth == 0:
+                break
+        elif c == ',' and depth == 1:
+            n += 1
+        if depth >= 1 and not c.isspace():
+            empty = False
+    return 0 if empty or args.startswith('(void)') else n + 1
+
+
+def callee(site):
+    """ The receiver, the name and the arguments at a call site """
+    path, line, col = site.rsplit(':', 2)
+    try:
+        lines = open(path).read().split('\n')
+    except IOError:
+        return None, None, 0
+    line, col = int(line), int(col)
+    m = re.search(r'(?:(\w+)\s*(?:->|\.)\s*)?(~?\w+)\s*$', lines[line - 1][:col - 1])
+    if not m:
+        return None, None, 0
+    return m.group(1), m.group(2), arity('\n'.join([lines[line - 1][col - 1:]] + lines[line:line + 10]))
+
+
+class Graph:
+    """ The call graph, the worst paths from a function """
+
+    def __init__(self, funcs, classes, isr, extern, call):
+        self.funcs = funcs
+        self.classes = classes
+        self.isr = isr
+        self.extern = extern
+        self.call = call
+        self.isrs = sorted(t for t in funcs if ISR.search(t) and funcs[t].size is not None)
+        self.errors = []
+        self.externs = set()
+        self.memo = {}
+        self.virtuals = set(g.method()[1] for g in funcs.values() if g.name.startswith('virtual '))
+
+    def targets(self, f, site, inisr):
+        """ The functions an indirect call may go to """
+        if f.title == self.isr:
+            # The interrupts do not nest
+            return [] if inisr else self.isrs
+        recv, name, args = callee(site) if site else (None, None, 0)
+        if name not in self.virtuals:
+            self.errors.append('%s: indirect call in %s, not bounded' % (site, f.name))
+            return []
+        # The overrides in the class of the receiver, this one if none
+        base = self.classes.type(recv) if recv else (f.method() or (None,))[0]
+        found = sorted(t for t, g in self.funcs.items()
+                       if g.size is not None and g.name.startswith('virtual ') and g.method()[1] == name
+                       and g.arity() == args and (base is None or self.classes.derives(g.method()[0], base)))
+        if not found:
+            self.errors.append('%s: virtual call in %s, no override found' % (site, f.name))
+        return found
+
+    def depth(self, title, inisr=False, stack=()):
+        """ The deepest path from a function: the bytes and the path """
+        inisr = inisr or title in self.isrs
+        if (title, inisr) in self.memo:
+            return self.memo[title, inisr]
+        f = self.funcs.get(title)
+        if f is None or f.size is None:
+            self.externs.add(title)
+            return self.extern, [f.name if f else title]
+        if (title, inisr) in stack:
+            self.errors.append('recursion: %s' % ' -> '.join(self.funcs[t].name for t, i in stack + ((title, inisr),)))
+            return 0, []
+        if f.kind == 'dynamic':
+            self.errors.append('%s: %s, unbounded dynamic frame' % (f.where, f.name))
+        best, path = 0, []
+        for dst, site in f.calls:
+            for t in (self.targets(f, site, inisr) if dst == INDIRECT else [dst]):
+                d, p = self.depth(t, inisr, stack + ((title, inisr),))
+                if d > best:
+                    best, path = d, p
+        result = f.size + self.call + best, ['%s %u' % (f.name, f.size)] + path
+        self.memo[title, inisr] = result
+        return result
+
+
+def main():
+    ap = argparse.ArgumentParser(description='The worst case stack depth')
+    ap.add_argument('-q', action='store_true', help='print only the bound')
+    ap.add_argument('--isr', help='the function the interrupt handlers are called from')
+    ap.add_argument('--extern', type=int, default=0, help='bytes for a function with no call graph')
+    ap.add_argument('--call', type=int, default=0, help='bytes for each call')
+    ap.add_argument('files', nargs='+')
+    args = ap.parse_args()
+
+    funcs = load(args.files)
+    isr = next((t for t, f in funcs.items() if f.name.split('(')[0].split()[-1] == args.isr), None)
+    if args.isr and isr is None:
+        sys.exit('%s: not found' % args.isr)
+    # The headers next to the sources the call graphs come from
+    dirs = sorted(set(os.path.dirname(f.where.rsplit(':', 2)[0]) or '.'
+                      for f in funcs.values() if f.size is not None))
+    g = Graph(funcs, Classes([d for d in dirs if os.path.isdir(d)]), isr, args.extern, args.call)
+
+    roots = [t for t in ROOTS if t in funcs]
+    if not roots:
+        sys.exit('No setup() nor loop()')
+    main_depth, main_path = max(g.depth(t) for t in roots)
+    isr_depth, isr_path = max([g.depth(t) for t in g.isrs] or [(0, [])])
+    bound = main_depth if isr else main_depth + isr_depth
+    if args.q:
+        print(bound)
+    else:
+        print('main %u bytes:\n  %s' % (main_depth, '\n  '.join(main_path)))
+        print('interrupts %u bytes%s:\n  %s' % (isr_depth, ', in the main path' if isr else '',
+                                                '\n  '.join(isr_path)))
+        if g.externs:
+            print('no call graph, %u bytes each: %s' % (args.extern, ' '.join(sorted(g.externs))))
+        print('bound %u bytes' % bound)
+    for e in sorted(set(g.errors)):
+        print(e, file=sys.stderr)
+    sys.exit(1 if g.errors else 0)
+
+
+if __name__ == '__main__':
+    main()
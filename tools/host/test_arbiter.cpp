@@ -0,0 +1,135 @@
+/**
+  test_arbiter.cpp - Two matrices chains sharing the SPI bus
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: test_arbiter
+
+  Built with MTX2_CS_PIN, see "make arbiter": the sketch drives a second
+  chain, showing the temperature at its own pace, and both chains share
+  the bus through the arbiter.  Each chain must show its own content,
+  changing at its own pace, with no byte on the bus going to both
+  chains or to none.  The second chain runs at
+  the clock tuned for the main one and keeps its font while the main
+  one changes to another, the RAM copy of the font being shared.  The frame write latency of each
+  chain, from its first queued frame to the end of its write, is read
+  with AT*QL and must keep to the budget, with the clock turning each
+  second and the seconds mode changing the frame each second.
+*/
+
+#include <string.h>
+
+#include "harness.h"
+#include "DotMatrix.h"
+
+#ifndef MTX2_CS_PIN
+#error "Build with -DMTX2_CS_PIN, see the Makefile"
+#endif
+
+// The sketch
+extern DotMatrixFixed<HRN_DEVICES, 8> mtx, mtx2;
+
+// The frame write latency, at most: the render of the other chain and
+// both writes, whole frames, us
+#define ARB_LATENCY 500
+// The refresh of the second chain, us, see mtx2DisplayWait
+#define ARB_WAIT2   10000000UL
+
+/**
+  The latencies of a chain, as AT*QL reports them
+
+  @param reply the reply
+  @param chain the chain
+  @param last the last latency, us
+  @param avg the average latency, us
+  @param max the maximum latency, us
+  @param cnt the writes
+  @return true if reported
+*/
+static bool arbLatency(const std::string &reply, uint8_t chain, unsigned &last, unsigned &avg, unsigned &max, unsigned &cnt) {
+  char head[8];
+  snprintf(head, sizeof(head), "*QL%u: ", chain);
+  size_t pos = reply.find(head);
+  return pos != std::string::npos and
+         sscanf(reply.c_str() + pos + strlen(head), "%u %u %uus, %u", &last, &avg, &max, &cnt) == 4;
+}
+
+/**
+  The frame a chain should show, as hrnFrame()
+
+  @param chain the chain
+  @return the columns of its front framebuffer, two hex digits each
+*/
+static std::string arbFront(DotMatrixFixed<HRN_DEVICES, 8> &chain) {
+  std::string s;
+  char hex[3];
+  for (uint8_t c = 0; c < HRN_DEVICES * 8; c++) {
+    snprintf(hex, sizeof(hex), "%02x", chain.fbFront()[c]);
+    s += hex;
+  }
+  return s;
+}
+
+int main() {
+  hrnStep = 1000;
+  hrnBoot(2020, 3, 1, 12, 0, 0);
+  halRtcTemp(22 * 4);
+  hrnRun(3000000);
+  CHECK(mtx2.speed() == mtx.speed(), "second chain at %u Hz, main at %u Hz", mtx2.speed(), mtx.speed());
+
+  // The temperature on the second chain, at its own pace
+  hrnRun(ARB_WAIT2);
+  std::string f1 = hrnFrame(1);
+  CHECK(f1 != std::string(f1.size(), '0'), "second chain dark");
+  CHECK(f1 == arbFront(mtx2), "second chain shows %s, not its frame", f1.c_str());
+
+  // The seconds on the main chain, in another font, the second one
+  // keeps the temperature, in its font, then shows the new one
+  hrnCommand("AT*O1");
+  hrnCommand("AT*F3");
+  hrnCommand("AT*Q0");
+  uint32_t latches0 = halChains[0].latches, latches1 = halChains[1].latches;
+  std::string f0 = hrnFrame(0);
+  hrnRun(3 * ARB_WAIT2);
+  CHECK(hrnFrame(0) != f0, "main chain still");
+  CHECK(hrnFrame(1) == f1, "second chain changed");
+  halRtcTemp(31 * 4);
+  hrnRun(3 * ARB_WAIT2);
+  CHECK(hrnFrame(1) != f1 and hrnFrame(1) == arbFront(mtx2), "second chain shows %s, not the new temperature",
+        hrnFrame(1).c_str());
+  // Rendered again, in its font, not in the last one loaded
+  halRtcTemp(22 * 4);
+  hrnRun(3 * ARB_WAIT2);
+  CHECK(hrnFrame(1) == f1, "second chain shows %s, not %s, in its font", hrnFrame(1).c_str(), f1.c_str());
+  uint32_t rate0 = halChains[0].latches - latches0, rate1 = halChains[1].latches - latches1;
+  CHECK(rate1 > 0 and rate1 < rate0, "second chain latched %u times, main %u", rate1, rate0);
+  CHECK(halSpiStray == 0 and halSpiClash == 0, "SPI %u stray, %u clashing", halSpiStray, halSpiClash);
+
+  // The latency of each chain
+  std::string reply = hrnCommand("AT*QL");
+  for (uint8_t c = 0; c < 2; c++) {
+    unsigned last, avg, max, cnt;
+    bool found = arbLatency(reply, c, last, avg, max, cnt);
+    CHECK(found, "no latency of chain %u: '%s'", c, reply.c_str());
+    if (not found)
+      continue;
+    CHECK(cnt > 0, "chain %u: no writes", c);
+    CHECK(max <= ARB_LATENCY, "chain %u: latency up to %u us", c, max);
+    printf("arbiter: chain %u, %u writes, %u latches, latency %u us average, %u us at most\n",
+           c, cnt, c ? rate1 : rate0, avg, max);
+  }
+  return hrnDone("arbiter");
+}
@@ -0,0 +1,154 @@
+/**
+  test_backends.cpp - The display drivers on their emulated hardware
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: test_backends
+
+  The same matrices, with the MAX7219 chain, the HT16K33 backpacks and
+  the APA102 LEDs, each on its emulated hardware, show the same frames:
+  a clock counting minutes and seconds in each font, brightness changes
+  and the display off and on again.  After each frame, the pixels the
+  hardware shows are decoded and must be the front framebuffer, or dark
+  when off; the back framebuffer, swapped, must have caught up with
+  it, in another buffer.  The current each driver estimates must grow
+  with the lit pixels and the brightness.  The bytes, the bus time and
+  the host time of the frames, and the current of all pixels lit at
+  full brightness, are printed for each driver, to compare them.
+*/
+
+#include <string.h>
+#include <time.h>
+
+#include "harness.h"
+#include "DotMatrix.h"
+
+// The seconds counted in each font
+#define BCK_SECONDS 300
+
+// A driver and its hardware
+struct bckDriver_t {
+  const char*     name;
+  MatrixBackend*  drv;                    // nullptr for the MAX7219 chain
+  void          (*attach)();
+  void          (*pixels)(uint8_t* cols);
+};
+
+static HT16K33Backend htDrv(HAL_HT_ADDR);
+static APA102Backend  apaDrv(HRN_CS, 0xFF, 0x40, 0x00);
+
+static void maxAttach()                 { halChainAttach(0, HRN_CS, HRN_DEVICES); }
+static void maxPixels(uint8_t* cols)    { halChainPixels(0, cols); }
+static void htAttach()                  { halHtAttach(HRN_DEVICES); }
+static void apaAttach()                 { halLedsAttach(HRN_CS, HRN_DEVICES); }
+
+static const bckDriver_t drivers[] = {
+  {"MAX7219", nullptr, maxAttach, maxPixels},
+  {"HT16K33", &htDrv, htAttach, halHtPixels},
+  {"APA102",  &apaDrv, apaAttach, halLedsPixels},
+};
+
+/**
+  Check the pixels the hardware shows
+
+  @param d the driver
+  @param mtx the matrices
+  @param on the display is on
+  @param what the frame, for the failures
+*/
+static void bckCheck(const bckDriver_t &d, DotMatrixFixed<HRN_DEVICES, 8> &mtx, bool on, const char* what) {
+  uint8_t cols[HRN_DEVICES * 8], want[HRN_DEVICES * 8];
+  d.pixels(cols);
+  if (on)
+    memcpy(want, mtx.fbFront(), sizeof(want));
+  else
+    memset(want, 0, sizeof(want));
+  CHECK(memcmp(cols, want, sizeof(cols)) == 0, "%s: %s shown wrong", d.name, what);
+}
+
+/**
+  Run the frames on a driver and print its figures
+
+  @param d the driver
+*/
+static void bckRun(const bckDriver_t &d) {
+  DotMatrixFixed<HRN_DEVICES, 8> mtx;
+  halPowerOn();
+  d.attach();
+  if (d.drv)
+    mtx.backend(d.drv);
+  mtx.init(HRN_CS);
+  mtx.decodemode(0);
+  mtx.clear();
+  mtx.intensity(4);
+  mtx.shutdown(false);
+
+  uint32_t frames = 0, bytes = 0, busUs = 0;
+  uint64_t hostNs = 0;
+  char text[8];
+  for (uint8_t font = 0; font < fontCount; font++) {
+    mtx.loadFont(font);
+    for (uint16_t s = 0; s < BCK_SECONDS; s++) {
+      snprintf(text, sizeof(text), "%02u:%02u", s / 60, s % 60);
+      uint32_t sent = mtx.spiBytes;
+      uint64_t start = halNow;
+      struct timespec t0, t1;
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      mtx.fbClear();
+      mtx.fbPrint(text);
+      mtx.fbDisplay();
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      busUs += halNow - start;
+      hostNs += (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+      frames++;
+      bytes += mtx.spiBytes - sent;
+      bckCheck(d, mtx, true, text);
+      CHECK(mtx.fbData != mtx.fbFront() and memcmp(mtx.fbData, mtx.fbFront(), HRN_DEVICES * 8) == 0,
+            "%s: %s, the back framebuffer is not the frame", d.name, text);
+      halAdvance(1000000);
+    }
+  }
+  // The brightness, then the display off and on
+  for (uint8_t level = 0; level < 16; level += 5) {
+    mtx.intensity(level);
+    mtx.fbDisplay();
+    bckCheck(d, mtx, true, "brightness");
+  }
+  if (d.drv == &htDrv)
+    CHECK(halHts[0].dim == mtx.level(), "%s: dimming %u, level %u", d.name, halHts[0].dim, mtx.level());
+  mtx.shutdown(true);
+  mtx.fbDisplay();
+  bckCheck(d, mtx, false, "off");
+  mtx.shutdown(false);
+  mtx.fbDisplay();
+  bckCheck(d, mtx, true, "on again");
+  CHECK(halSpiStray == 0 and halSpiClash == 0, "%s: SPI %u stray, %u clashing", d.name, halSpiStray, halSpiClash);
+  // The current estimate
+  const uint16_t all = HRN_DEVICES * 64;
+  CHECK(mtx.current(0, 0) < mtx.current(all, 0), "%s: no current lit", d.name);
+  CHECK(mtx.current(all, 0) < mtx.current(all, 8) and mtx.current(all, 8) < mtx.current(all, 15),
+        "%s: the current does not grow with the brightness", d.name);
+
+  printf("backends: %-8s %5u frames, %6.1f bytes, %7.1f us on the bus, %6.0f ns on the host per frame, "
+         "%4u mA all lit\n", d.name, frames, (double)bytes / frames, (double)busUs / frames,
+         (double)hostNs / frames, mtx.current(all, 15));
+}
+
+int main() {
+  for (const bckDriver_t &d : drivers)
+    bckRun(d);
+  return hrnDone("backends");
+}
@@ -0,0 +1,94 @@
+/**
+  test_chain.cpp - The matrices chain self-test and the SPI clock tuning
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: test_chain
+
+  The board is booted with the chain wired otherwise than the sketch
+  expects: no loopback, fewer devices, a broken module, bit errors above
+  some SPI clock.  The boot must report what the self-test found and
+  AT*Q the devices and the clock in use; AT*QT tests and tunes the chain
+  again, at runtime.
+*/
+
+#include <string.h>
+
+#include "harness.h"
+
+/**
+  Boot with the chain wired as set, then check the boot report and the
+  devices and the clock AT*Q reports
+
+  @param what the wiring, for the failures
+  @param wire set the wiring, after the chain is attached
+  @param error the error at boot, nullptr for none
+  @param query the end of the AT*Q reply
+*/
+static void chnBoot(const char* what, void (*wire)(), const char* error, const char* query) {
+  hrnWire = wire;
+  hrnBoot(2020, 1, 1, 12, 0, 0);
+  hrnWire = nullptr;
+  std::string boot = hrnSerial();
+  if (error)
+    CHECK(boot.find(error) != std::string::npos, "%s: no '%s' at boot", what, error);
+  else
+    CHECK(boot.find("Matrix chain") == std::string::npos, "%s: chain error at boot", what);
+  std::string reply = hrnCommand("AT*Q");
+  CHECK(reply.find(query) != std::string::npos, "%s: AT*Q '%s', expected '%s'", what, reply.c_str(), query);
+}
+
+int main() {
+  // Looped back, as in the harness: all devices found, the fastest clock
+  chnBoot("looped back", nullptr, nullptr, "8000000Hz, chain 4");
+  CHECK(halChains[0].errors == 0, "bit errors with none injected");
+
+  // No loopback, MISO idle: nothing found, not an error, the default clock
+  chnBoot("no loopback", [] { halChains[0].loop = false; }, nullptr, "1000000Hz, chain 0");
+
+  // Fewer devices than configured: found, reported, not tuned
+  chnBoot("3 devices", [] { halChainAttach(0, HRN_CS, 3); }, "ERROR Matrix chain 3", "1000000Hz, chain 3");
+
+  // A broken module, the stream is lost past it, and the last one broken
+  chnBoot("module 2 broken", [] { halChains[0].broken = 2; }, "ERROR Matrix chain fault", "chain fault");
+  chnBoot("module 4 broken", [] { halChains[0].broken = 4; }, "ERROR Matrix chain fault", "chain fault");
+
+  // Bit errors above 2MHz: tuned up to it
+  chnBoot("errors above 2MHz", [] { halChains[0].errClock = 2000000; }, nullptr, "2000000Hz, chain 4");
+  CHECK(halChains[0].errors > 0, "no bit errors while tuning");
+  // Now and then only, still found
+  chnBoot("rare errors above 4MHz", [] { halChains[0].errClock = 4000000; halChains[0].errEvery = 200; },
+          nullptr, "4000000Hz, chain 4");
+
+  // Bit errors at any clock: a fault, the default clock
+  chnBoot("errors at 1MHz", [] { halChains[0].errClock = 1; }, "ERROR Matrix chain fault", "1000000Hz, chain fault");
+
+  // Tested again at runtime, after the wiring got worse, then better
+  chnBoot("runtime", nullptr, nullptr, "8000000Hz, chain 4");
+  halChains[0].errClock = 1000000;
+  std::string reply = hrnCommand("AT*QT");
+  CHECK(reply.find("1000000Hz, chain 4") != std::string::npos, "AT*QT with errors above 1MHz: '%s'", reply.c_str());
+  halChains[0].broken = 1;
+  reply = hrnCommand("AT*QT");
+  CHECK(reply.find("chain fault") != std::string::npos and reply.find("ERROR") != std::string::npos,
+        "AT*QT with a broken module: '%s'", reply.c_str());
+  halChains[0].broken = 0;
+  halChains[0].errClock = 0;
+  reply = hrnCommand("AT*QT");
+  CHECK(reply.find("8000000Hz, chain 4") != std::string::npos and reply.find("OK") != std::string::npos,
+        "AT*QT repaired: '%s'", reply.c_str());
+  return hrnDone("chain");
+}
@@ -0,0 +1,177 @@
+/**
+  test_config.cpp - The stored configuration, in each of its layouts
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: test_config
+
+  The board is booted with a configuration stored in the EEPROM in each
+  layout: the current one must be used as is; one in a previous layout,
+  version 0 or 1, must keep its fields, take the defaults for the new
+  ones and be stored again in the current layout; one in a layout never
+  released, with another version where the current one keeps it, must
+  not be taken, the defaults are used.
+*/
+
+#include <string.h>
+
+#include "harness.h"
+#include "EEPROM.h"
+
+// The configuration record, see cfgEE_t: 16 bytes and the CRC8
+#define CFG_ADDR    0x0180
+#define CFG_SIZE    17
+// The version byte, in the current layout and in version 1
+#define CFG_VERS    13
+#define CFG_V1_VERS 9
+
+// The record stored before the boot, if any
+static uint8_t cfgStored[CFG_SIZE];
+static bool    cfgStore = false;
+
+/**
+  The CRC8 of the sketch
+
+  @param crc the CRC so far
+  @param data the next byte
+  @return the CRC
+*/
+static uint8_t cfgCrc(uint8_t crc, uint8_t data) {
+  crc ^= data;
+  for (uint8_t i = 0; i < 8; i++)
+    crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+  return crc;
+}
+
+/**
+  Store the record in the EEPROM, after the power on
+*/
+static void cfgWire() {
+  if (cfgStore)
+    memcpy(EEPROM.data + CFG_ADDR, cfgStored, CFG_SIZE);
+}
+
+/**
+  Boot with a record stored, or none
+
+  @param rec the record, CFG_SIZE bytes, nullptr for none
+*/
+static void cfgBoot(const uint8_t* rec) {
+  cfgStore = rec != nullptr;
+  if (rec)
+    memcpy(cfgStored, rec, CFG_SIZE);
+  hrnWire = cfgWire;
+  hrnBoot(2020, 1, 1, 12, 0, 0);
+  hrnWire = nullptr;
+  hrnRun(1000000);
+}
+
+/**
+  The font in use, as *F reports it
+
+  @return the font, -1 if not reported
+*/
+static int cfgFont() {
+  std::string reply = hrnCommand("AT*F?");
+  size_t pos = reply.find("*F: ");
+  int font = -1;
+  if (pos != std::string::npos)
+    sscanf(reply.c_str() + pos, "*F: %d", &font);
+  return font;
+}
+
+/**
+  Check the record in the EEPROM keeps the first bytes of another and
+  has the defaults after them, in the current layout
+
+  @param what the record, for the failures
+  @param old the record it was migrated from
+  @param used the bytes kept
+  @param def the default record
+*/
+static void cfgMigrated(const char* what, const uint8_t* old, uint8_t used, const uint8_t* def) {
+  const uint8_t* now = EEPROM.data + CFG_ADDR;
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < CFG_SIZE - 1; i++)
+    crc = cfgCrc(crc, now[i]);
+  CHECK(now[CFG_SIZE - 1] == crc, "%s: stored with a bad CRC8", what);
+  CHECK(memcmp(now, old, used) == 0, "%s: the old fields not kept", what);
+  CHECK(memcmp(now + used, def + used, CFG_SIZE - 1 - used) == 0, "%s: the new fields not the defaults", what);
+  CHECK(now[CFG_VERS] == def[CFG_VERS], "%s: stored as version %u", what, now[CFG_VERS]);
+}
+
+int main() {
+  hrnStep = 1000;
+  // None stored: the defaults, stored as they are
+  cfgBoot(nullptr);
+  int font0 = cfgFont();
+  hrnCommand("AT&W");
+  uint8_t def[CFG_SIZE];
+  memcpy(def, EEPROM.data + CFG_ADDR, CFG_SIZE);
+  CHECK(def[CFG_VERS] == 2, "the current layout is version %u", def[CFG_VERS]);
+
+  // The current layout, another font: used as is, not stored again
+  uint8_t rec[CFG_SIZE];
+  memcpy(rec, def, CFG_SIZE);
+  rec[0] = (rec[0] & 0xF0) | ((font0 + 1) & 0x0F);
+  rec[CFG_SIZE - 1] = 0;
+  for (uint8_t i = 0; i < CFG_SIZE - 1; i++)
+    rec[CFG_SIZE - 1] = cfgCrc(rec[CFG_SIZE - 1], rec[i]);
+  cfgBoot(rec);
+  CHECK(cfgFont() == font0 + 1, "current layout: font %d, not %d", cfgFont(), font0 + 1);
+  CHECK(memcmp(EEPROM.data + CFG_ADDR, rec, CFG_SIZE) == 0, "current layout: stored again");
+
+  // Version 0: 7 bytes, another font, the CRC8 in the 9th
+  uint8_t v0[CFG_SIZE];
+  memset(v0, 0xFF, sizeof(v0));
+  memcpy(v0, def, 7);
+  v0[0] = (v0[0] & 0xF0) | ((font0 + 2) & 0x0F);
+  v0[7] = 0;
+  v0[8] = 0;
+  for (uint8_t i = 0; i < 8; i++)
+    v0[8] = cfgCrc(v0[8], v0[i]);
+  cfgBoot(v0);
+  CHECK(cfgFont() == font0 + 2, "version 0: font %d, not %d", cfgFont(), font0 + 2);
+  cfgMigrated("version 0", v0, 7, def);
+
+  // Version 1: 9 bytes, another font, then the version, then unused
+  uint8_t v1[CFG_SIZE];
+  memset(v1, 0, sizeof(v1));
+  memcpy(v1, def, 9);
+  v1[0] = (v1[0] & 0xF0) | ((font0 + 3) & 0x0F);
+  v1[CFG_V1_VERS] = 1;
+  for (uint8_t i = 0; i < CFG_SIZE - 1; i++)
+    v1[CFG_SIZE - 1] = cfgCrc(v1[CFG_SIZE - 1], v1[i]);
+  cfgBoot(v1);
+  CHECK(cfgFont() == font0 + 3, "version 1: font %d, not %d", cfgFont(), font0 + 3);
+  cfgMigrated("version 1", v1, 9, def);
+
+  // Never released, the layout with the current budget only: version 1
+  // a byte further; the defaults, the record left alone
+  uint8_t vx[CFG_SIZE];
+  memcpy(vx, v1, sizeof(vx));
+  vx[CFG_V1_VERS] = def[CFG_V1_VERS];
+  vx[CFG_V1_VERS + 1] = 1;
+  vx[CFG_SIZE - 1] = 0;
+  for (uint8_t i = 0; i < CFG_SIZE - 1; i++)
+    vx[CFG_SIZE - 1] = cfgCrc(vx[CFG_SIZE - 1], vx[i]);
+  cfgBoot(vx);
+  CHECK(cfgFont() == font0, "unreleased layout: font %d, not the default %d", cfgFont(), font0);
+  CHECK(memcmp(EEPROM.data + CFG_ADDR, vx, CFG_SIZE) == 0, "unreleased layout: overwritten");
+
+  printf("config: version %u, versions 0 and 1 migrated\n", def[CFG_VERS]);
+  return hrnDone("config");
+}
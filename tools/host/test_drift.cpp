@@ -0,0 +1,145 @@
+/**
+  test_drift.cpp - The drift discipline on a drifting RTC oscillator
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: test_drift
+
+  The emulated RTC runs fast, then, aged, slow, while the host syncs it
+  with AT*Y every few hours, from the virtual time with a few ms of
+  jitter, the only noise: the automatic brightness is off.  The sketch
+  must correct the aging offset, in the right direction, until the
+  drift left is within an aging step, and keep it there: the offset
+  must stay about still over the last day.  The drift estimated at each
+  correction, the steps and the offsets are printed.
+*/
+
+#include <string.h>
+#include <time.h>
+
+#include "harness.h"
+#include "DS3231.h"
+
+// The hours between syncs
+#define DRF_EVERY   4
+// The days each oscillator drift runs
+#define DRF_DAYS    4
+// The jitter of the host time, up to, ms
+#define DRF_JITTER  5
+// The offset change allowed over the last day: an aging step, 8.6ms a
+// day, and the jitter, ms
+#define DRF_STILL   20
+// Bytes on the serial line, 9600 baud, see hal.cpp
+#define SER_BYTE_US 1042
+
+// The command line, fixed width, the line end in place of the NUL
+#define DRF_LINE    "AT*Y=0000000000 000"
+
+// The epoch of the boot time, local
+static uint32_t drfEpoch;
+// The jitter generator state
+static uint32_t drfSeed = 1;
+
+/**
+  Sync with the host time, as the virtual time, when the command line
+  ends, and read the offset
+
+  @param ofs the offset the sketch measured, ms
+  @return true if synced
+*/
+static bool drfSync(int32_t &ofs) {
+  char cmd[32];
+  drfSeed = drfSeed * 1103515245 + 12345;
+  int32_t jitter = (int32_t)(drfSeed >> 16) % (2 * DRF_JITTER + 1) - DRF_JITTER;
+  uint64_t at = halNow + sizeof(DRF_LINE) * SER_BYTE_US + jitter * 1000;
+  snprintf(cmd, sizeof(cmd), "AT*Y=%010u %03u", drfEpoch + (uint32_t)(at / 1000000), (unsigned)(at % 1000000 / 1000));
+  uint32_t step = hrnStep;
+  hrnStep = 1000;
+  std::string reply = hrnCommand(cmd);
+  hrnStep = step;
+  size_t pos = reply.find("*Y: ");
+  return pos != std::string::npos and sscanf(reply.c_str() + pos, "*Y: %d ms", &ofs) == 1;
+}
+
+/**
+  Run the oscillator with a drift, syncing it, and check the aging
+  offset converges and holds
+
+  @param ppm the oscillator drift, 1/100 ppm, positive is fast
+*/
+static void drfRun(int16_t ppm) {
+  halRtc.ppm = ppm;
+  hrnCommand("AT*Y0");
+  int8_t aging0 = (int8_t)halRtc.regs[RTC_AGING];
+  int32_t ofs, dayOfs = 0;
+  uint8_t corr = 0;
+  const uint16_t syncs = DRF_DAYS * 24 / DRF_EVERY;
+  for (uint16_t i = 0; i <= syncs; i++) {
+    int8_t aging = (int8_t)halRtc.regs[RTC_AGING];
+    if (not drfSync(ofs)) {
+      CHECK(false, "%+.2f ppm: sync %u failed", ppm / 100.0, i);
+      return;
+    }
+    // The aging offset written at this sync
+    if ((int8_t)halRtc.regs[RTC_AGING] != aging) {
+      int8_t now = (int8_t)halRtc.regs[RTC_AGING];
+      // Toward the drift
+      CHECK((now - aging) * (ppm - aging * 10) > 0, "%+.2f ppm: aging %d to %d, the wrong way",
+            ppm / 100.0, aging, now);
+      std::string reply = hrnCommand("AT*Y?");
+      size_t pos = reply.find("*Y: ");
+      float est = 0;
+      if (pos != std::string::npos)
+        sscanf(reply.c_str() + pos, "*Y: %*u %*uh %f", &est);
+      printf("drift: %+.2f ppm, after %3uh, offset %+5d ms, estimated %+.2f ppm, aging %+4d to %+4d\n",
+             ppm / 100.0, i * DRF_EVERY, ofs, est, aging, now);
+      corr++;
+    }
+    if (i == syncs - 24 / DRF_EVERY)
+      dayOfs = ofs;
+    if (i < syncs)
+      hrnRun(DRF_EVERY * 3600000000ULL);
+  }
+  int8_t aging = (int8_t)halRtc.regs[RTC_AGING];
+  int16_t left = ppm - aging * 10;
+  CHECK(corr > 0, "%+.2f ppm: never corrected, aging %d", ppm / 100.0, aging);
+  CHECK(abs(left) <= 10, "%+.2f ppm: aging %d from %d, %+.2f ppm left",
+        ppm / 100.0, aging, aging0, left / 100.0);
+  CHECK(abs(ofs - dayOfs) <= DRF_STILL, "%+.2f ppm: offset %+d ms over the last day",
+        ppm / 100.0, ofs - dayOfs);
+  printf("drift: %+.2f ppm, %u corrections, aging %+d, %+.2f ppm left, %+d ms over the last day\n",
+         ppm / 100.0, corr, aging, left / 100.0, ofs - dayOfs);
+}
+
+int main() {
+  hrnStep = 100000;
+  // In winter, the DST is not changed
+  struct tm boot = {};
+  boot.tm_year = 120;
+  boot.tm_mday = 6;
+  boot.tm_hour = 12;
+  drfEpoch = timegm(&boot);
+  hrnBoot(2020, 1, 6, 12, 0, 0);
+  hrnRun(2000000);
+  // The automatic brightness blocks the loop 10ms each check, the syncs
+  // would be received late now and then
+  hrnCommand("AT*A0");
+  // Fast, then aged and slow
+  drfRun(537);
+  drfRun(-284);
+  CHECK(halWdtResets == 0, "%u watchdog resets", halWdtResets);
+  return hrnDone("drift");
+}
@@ -0,0 +1,281 @@
+/**
+  test_golden.cpp - Golden frames of every mode and font, and the budgets
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: test_golden [-u]
+
+  For each font, each mode is shown with some representative values,
+  then a text in the three alignments.  The frames are decoded from the
+  registers the MAX7219 chain latched from the SPI stream and compared
+  to the ASCII art in golden/fontNN.txt, the top row and the leftmost
+  column first.  -u writes the files again, after a wanted change.
+
+  Each frame must also keep to the budgets: the SPI bytes and the bus
+  time of the frame writes, whole frames and single digits, and the
+  time to render a text on the host.
+*/
+
+#include <string.h>
+#include <time.h>
+
+#include "harness.h"
+#include "DotMatrix.h"
+
+// The sketch
+extern DotMatrixFixed<HRN_DEVICES, 8> mtx;
+#define MODE_HHMM 0
+#define MODE_SS   1
+#define MODE_DDMM 2
+#define MODE_YY   3
+#define MODE_TEMP 4
+#define MODE_VCC  5
+#define MODE_MCU  6
+#define MODE_CHRN 7
+#define MODE_CNTD 8
+#define MODE_SPLT 9
+#define LAYOUTS   3
+
+// A frame write: all the lines and a control register scrubbed, a
+// register per device each
+#define BDG_FULL_BYTES  (9 * 2 * HRN_DEVICES)
+// Its bus time, at the default SPI clock, us
+#define BDG_FULL_US     200
+// A single digit changed: at most its lines and a line scrubbed
+#define BDG_DIGIT_BYTES (6 * 2 * HRN_DEVICES)
+// A text rendered and the changed lines found, on the host, ns
+#define BDG_RENDER_NS   2000
+
+static bool         update = false;
+static std::string  frames;           // The frames of the current font, as ASCII art
+static uint32_t     spiMark;          // The bytes sent, at the last mark
+static uint16_t     maxBytes;         // The largest frame write since the last mark, bytes
+static uint16_t     maxUs;            // The longest frame write since the last mark, us
+
+/**
+  Keep the largest frame write, if any, after each loop
+*/
+static void watch() {
+  static uint32_t last = 0;
+  if (mtx.spiBytes != last) {
+    last     = mtx.spiBytes;
+    maxBytes = max(maxBytes, mtx.frameBytes);
+    maxUs    = max(maxUs, mtx.frameTime);
+  }
+}
+
+/**
+  Start watching the frame writes
+*/
+static void mark() {
+  spiMark  = mtx.spiBytes;
+  maxBytes = 0;
+  maxUs    = 0;
+}
+
+/**
+  Set the RTC, ten seconds into the minute so no new minute comes while
+  a frame is taken, unless asked
+*/
+static void at(uint8_t H, uint8_t M, uint8_t S = 10) {
+  halRtcSet(2020, 2, 29, H, M, S);
+}
+
+/**
+  Take the frame shown, as ASCII art, after a caption line
+
+  @param caption what is shown
+*/
+static void take(const char* caption) {
+  uint8_t cols[HAL_DEVICES * 8];
+  uint8_t n = halChains[0].devices * 8;
+  halChainPixels(0, cols);
+  frames += ": ";
+  frames += caption;
+  frames += '\n';
+  for (uint8_t r = 0; r < 8; r++) {
+    for (uint8_t x = 0; x < n; x++)
+      frames += (cols[n - 1 - x] & (0x80 >> r)) ? '#' : '.';
+    frames += '\n';
+  }
+}
+
+/**
+  Show a mode and take its frame, a whole frame must keep to the budget
+
+  @param mode the mode
+  @param caption what is shown
+*/
+static void show(uint8_t mode, const char* caption) {
+  char cmd[8];
+  snprintf(cmd, sizeof(cmd), "AT*O%u", mode);
+  mark();
+  hrnCommand(cmd);
+  hrnRun(1500000);
+  take(caption);
+  CHECK(maxBytes <= BDG_FULL_BYTES, "%s: %u bytes, budget %u", caption, maxBytes, BDG_FULL_BYTES);
+  CHECK(maxUs <= BDG_FULL_US, "%s: %uus on the bus, budget %u", caption, maxUs, BDG_FULL_US);
+}
+
+/**
+  Print a text, in an alignment, and take its frame
+
+  @param text the text
+  @param align the alignment
+  @param caption what is shown
+*/
+static void print(const char* text, uint8_t align, const char* caption) {
+  mtx.fbPrint(text, align);
+  hrnRun(100000);
+  take(caption);
+}
+
+/**
+  Compare the frames of a font to its golden file, or write it
+
+  @param font the font
+*/
+static void golden(uint8_t font) {
+  char name[32];
+  snprintf(name, sizeof(name), "golden/font%02u.txt", font);
+  if (update) {
+    FILE* f = fopen(name, "w");
+    CHECK(f != nullptr, "%s: can not write", name);
+    if (f) {
+      fputs(frames.c_str(), f);
+      fclose(f);
+    }
+    return;
+  }
+  std::string gold;
+  FILE* f = fopen(name, "r");
+  CHECK(f != nullptr, "%s: missing, write it with -u", name);
+  if (f == nullptr)
+    return;
+  char buf[256];
+  while (fgets(buf, sizeof(buf), f))
+    gold += buf;
+  fclose(f);
+  // Report the first frame that differs, with both images
+  size_t g = 0, s = 0;
+  while (g < gold.size() and s < frames.size()) {
+    size_t ge = gold.find("\n: ", g + 1), se = frames.find("\n: ", s + 1);
+    std::string a = gold.substr(g, ge == std::string::npos ? std::string::npos : ge + 1 - g);
+    std::string b = frames.substr(s, se == std::string::npos ? std::string::npos : se + 1 - s);
+    CHECK(a == b, "%s: frame differs\nexpected:\n%sgot:\n%s", name, a.c_str(), b.c_str());
+    if (a != b or ge == std::string::npos or se == std::string::npos)
+      break;
+    g = ge + 1;
+    s = se + 1;
+  }
+  CHECK(gold.size() == frames.size(), "%s: %zu bytes expected, %zu taken", name, gold.size(), frames.size());
+}
+
+/**
+  A single digit changing must send only its lines
+*/
+static void digitBudget() {
+  at(12, 34, 58);
+  hrnCommand("AT*O0");
+  hrnRun(1000000);
+  mark();
+  // The new minute, 12:35
+  hrnRun(2000000);
+  CHECK(hrnRtcTime() == "12:35", "RTC %s", hrnRtcTime().c_str());
+  uint32_t sent = mtx.spiBytes - spiMark;
+  CHECK(sent > 0 and maxBytes <= BDG_DIGIT_BYTES, "12:34 to 12:35: %u bytes, budget %u", maxBytes, BDG_DIGIT_BYTES);
+}
+
+/**
+  The time to render a text and find the changed lines, on the host
+*/
+static void renderBudget() {
+  const uint32_t reps = 20000;
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t0);
+  for (uint32_t i = 0; i < reps; i++) {
+    // The widths change, so the layout is computed each time
+    mtx.fbPrint((i & 1) ? "12:34" : "-7.5", DotMatrix::CENTER);
+  }
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t1);
+  uint64_t ns = ((t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec) / reps;
+  CHECK(ns <= BDG_RENDER_NS, "render %lluns, budget %u", (unsigned long long)ns, BDG_RENDER_NS);
+}
+
+int main(int argc, char** argv) {
+  update = argc > 1 and strcmp(argv[1], "-u") == 0;
+  hrnStep = 10000;
+  hrnHook = watch;
+  hrnBoot(2020, 2, 29, 23, 59, 10);
+  hrnRun(3000000);
+  for (uint8_t font = 0; font < fontCount; font++) {
+    char cmd[8];
+    snprintf(cmd, sizeof(cmd), "AT*F%u", font);
+    hrnCommand(cmd);
+    frames.clear();
+    // The time, the seconds, the date and the year
+    at(23, 59);
+    show(MODE_HHMM, "HHMM 23:59");
+    at(10, 8);
+    show(MODE_HHMM, "HHMM 10:08");
+    at(0, 0, 7);
+    show(MODE_SS, "SS 08");
+    show(MODE_DDMM, "DDMM 29.02");
+    show(MODE_YY, "YY 2020");
+    // The RTC temperature, in Celsius and Fahrenheit, both signs, two and three digits
+    hrnCommand("AT*UC");
+    halRtcTemp(23 * 4);
+    show(MODE_TEMP, "TEMP 23C");
+    halRtcTemp(-7 * 4);
+    show(MODE_TEMP, "TEMP -7C");
+    hrnCommand("AT*UF");
+    show(MODE_TEMP, "TEMP 19F");
+    halRtcTemp(40 * 4);
+    show(MODE_TEMP, "TEMP 104F");
+    hrnCommand("AT*UC");
+    halRtcTemp(25 * 4);
+    // The supply and the MCU temperature
+    halVcc(4987);
+    show(MODE_VCC, "VCC 4.987");
+    halMcuTemp(3200);
+    show(MODE_MCU, "MCU 31C");
+    halMcuTemp(-1200);
+    show(MODE_MCU, "MCU -12C");
+    halMcuTemp(2500);
+    // The timers, stopped
+    show(MODE_CHRN, "CHRN 00:00.00");
+    show(MODE_CNTD, "CNTD 05:00.00");
+    // The split layouts
+    at(12, 34);
+    for (uint8_t l = 1; l <= LAYOUTS; l++) {
+      char caption[16];
+      snprintf(cmd, sizeof(cmd), "AT*K%u", l);
+      hrnCommand(cmd);
+      snprintf(caption, sizeof(caption), "SPLT %u", l);
+      show(MODE_SPLT, caption);
+    }
+    // A text in the three alignments, over the time
+    show(MODE_HHMM, "HHMM 12:34");
+    print("42", DotMatrix::LEFT,   "LEFT 42");
+    print("42", DotMatrix::CENTER, "CENTER 42");
+    print("42", DotMatrix::RIGHT,  "RIGHT 42");
+    golden(font);
+  }
+  hrnCommand("AT*F0");
+  digitBudget();
+  renderBudget();
+  return hrnDone("golden");
+}
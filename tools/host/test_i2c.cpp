@@ -0,0 +1,121 @@
+/**
+  test_i2c.cpp - The RTC on a faulty I2C bus
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: test_i2c
+
+  The RTC is NACKed for a few transactions, then for long, then SDA is
+  held low for a few clocks and then until released, while AT*T? reads
+  the time.  The retries must hide the short faults, the long ones must
+  take the RTC down and count its errors, the bus clear must release
+  SDA and the RTC must be back once the bus is, keeping the time.  The watchdog must not fire,
+  the timeouts bound the waits.
+*/
+
+#include <string.h>
+
+#include "harness.h"
+#include "DS3231.h"
+
+// The sketch
+extern DS3231 rtc;
+// The probe of a down RTC, us, see rtcCheckWait
+#define I2C_PROBE   10000000UL
+
+/**
+  The errors counted for all registers
+
+  @return the failed transactions
+*/
+static uint16_t i2cErrors() {
+  uint16_t n = 0;
+  for (uint8_t r = 0; r < RTC_REGS; r++)
+    n += rtc.errors[r];
+  return n;
+}
+
+/**
+  Check the RTC is up, with the time of the emulated one, and clear its
+  errors
+
+  @param what the fault, for the failures
+*/
+static void i2cUp(const char* what) {
+  CHECK(rtc.rtcOk, "%s: RTC down", what);
+  std::string reply = hrnCommand("AT*R");
+  CHECK(reply.find("*R: 1 ") != std::string::npos, "%s: AT*R '%s'", what, reply.c_str());
+  hrnCommand("AT*R0");
+}
+
+int main() {
+  hrnStep = 1000;
+  hrnBoot(2020, 7, 1, 8, 0, 0);
+  hrnRun(2000000);
+  i2cUp("boot");
+
+  // A NACK less than the retries: hidden
+  halI2c.nacks = RTC_I2C_RETRIES - 1;
+  halI2c.nackAddr = I2C_RTC;
+  hrnCommand("AT*T?");
+  CHECK(halI2c.nacks == 0 and halI2c.nacked == RTC_I2C_RETRIES - 1, "%u NACKs taken", halI2c.nacked);
+  CHECK(i2cErrors() == 0 and rtc.rtcOk, "short NACK: %u errors", i2cErrors());
+
+  // NACKed long: errors counted, the RTC down, then back at the probe
+  halI2c.nacks = RTC_I2C_RETRIES * RTC_MAX_FAILS;
+  for (uint8_t i = 0; i < RTC_MAX_FAILS and halI2c.nacks; i++)
+    hrnCommand("AT*T?");
+  CHECK(not rtc.rtcOk, "RTC up, NACKed");
+  CHECK(i2cErrors() == RTC_MAX_FAILS, "%u errors, %u expected", i2cErrors(), RTC_MAX_FAILS);
+  CHECK(halI2c.nacks == 0, "%u NACKs left", halI2c.nacks);
+  hrnRun(I2C_PROBE + 1000000);
+  i2cUp("NACK");
+
+  // SDA held low for a few clocks: the bus clear releases it, the retry
+  // goes through
+  uint8_t clears = rtc.busClears;
+  halI2c.stuck = 5;
+  hrnCommand("AT*T?");
+  CHECK(halI2c.stuck == 0, "SDA still held low");
+  CHECK(rtc.busClears == clears + 1 and halI2c.timeouts == 1, "%u bus clears, %u timeouts",
+        rtc.busClears - clears, halI2c.timeouts);
+  CHECK(i2cErrors() == 0, "SDA low, released: %u errors", i2cErrors());
+  i2cUp("SDA low, released");
+
+  // SDA held low until released: the bus cleared at each attempt, the
+  // RTC down, then back
+  clears = rtc.busClears;
+  halI2c.stuck = 0xFF;
+  for (uint8_t i = 0; i < RTC_MAX_FAILS and rtc.rtcOk; i++)
+    hrnCommand("AT*T?");
+  CHECK(not rtc.rtcOk, "RTC up, SDA low");
+  CHECK(rtc.busClears - clears >= RTC_I2C_RETRIES * RTC_MAX_FAILS, "%u bus clears", rtc.busClears - clears);
+  hrnRun(3 * I2C_PROBE);
+  CHECK(not rtc.rtcOk, "RTC up, SDA still low");
+  halI2c.stuck = 0;
+  hrnRun(I2C_PROBE + 1000000);
+  i2cUp("SDA low");
+  // The time read again, as the RTC kept it
+  unsigned hh, mm;
+  hrnCommand("AT*T?");
+  sscanf(hrnRtcTime().c_str(), "%u:%u", &hh, &mm);
+  CHECK(rtc.H == hh and rtc.M == mm, "time read %02u:%02u, RTC %02u:%02u", rtc.H, rtc.M, hh, mm);
+
+  CHECK(halWdtResets == 0, "%u watchdog resets", halWdtResets);
+  printf("i2c: %u NACKs, %u timeouts, %u SCL clocks to clear the bus\n",
+         halI2c.nacked, halI2c.timeouts, halI2c.clocks);
+  return hrnDone("i2c");
+}
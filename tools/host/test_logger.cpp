@@ -0,0 +1,114 @@
+/**
+  test_logger.cpp - The data logger on the emulated AT24C32
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: test_logger
+
+  The logger writes a record a minute, past the end of the ring buffer.
+  Each record must take a single write cycle, inside a page, with no
+  wait for a previous one, and the pages must wear evenly: the write
+  amplification is the page size for each record.  Then AT*GD dumps
+  the ring, the oldest record first: all records, in sequence, as fast
+  as the serial line goes.
+*/
+
+#include <string.h>
+#include <string>
+
+#include "harness.h"
+#include "AT24C32.h"
+
+// The sketch
+extern AT24C32 eep;
+extern uint16_t logHead, logCount;
+#define LOG_REC   8
+#define LOG_RECS  (EEP_SIZE / LOG_REC)
+
+// Records written, past the end of the ring
+#define LOG_WRITTEN 600
+// Bytes on the bus for a record: the memory address and the record
+#define LOG_BUS   (2 + LOG_REC)
+// The serial line must be busy this part of the dump, percent
+#define LOG_BUSY  90
+// Bytes on the serial line, 9600 baud, see hal.cpp
+#define SER_BYTE_US 1042
+
+int main() {
+  hrnStep = 10000;
+  hrnBoot(2020, 6, 1, 0, 0, 0);
+  hrnRun(1000000);
+  CHECK(eep.eepOk, "no EEPROM found");
+  CHECK(logCount == 1, "%u records after boot in a blank EEPROM", logCount);
+
+  // A record a minute, the first one at boot, none waiting for a write
+  // cycle, the minute between them is long enough
+  hrnCommand("AT*G1");
+  hrnRun((LOG_WRITTEN - 1) * 60000000ULL + 30000000ULL);
+  uint32_t recs = eep.pageWrites;
+  CHECK(recs == LOG_WRITTEN, "%u records written, %u expected", recs, LOG_WRITTEN);
+  CHECK(halRtc.eepCycles == recs, "%u write cycles for %u records", halRtc.eepCycles, recs);
+  CHECK(halRtc.eepWrapped == 0, "%u bytes wrapped in their page", halRtc.eepWrapped);
+  CHECK(eep.ackPolls == 0, "%u ACK polls, the cycles overlap", eep.ackPolls);
+  CHECK(logCount == LOG_RECS and logHead == LOG_WRITTEN % LOG_RECS,
+        "head %u, count %u", logHead, logCount);
+  // Even wear: each page a cycle for each record written in it, the
+  // ring goes over all of them in turn
+  for (uint16_t p = 0; p < EEP_SIZE / EEP_PAGE; p++) {
+    uint16_t want = 0;
+    for (uint32_t r = 0; r < recs; r++)
+      if ((r % LOG_RECS) * LOG_REC / EEP_PAGE == p)
+        want++;
+    if (halRtc.eepWear[p] != want) {
+      CHECK(halRtc.eepWear[p] == want, "page %u: %u write cycles, %u expected", p, halRtc.eepWear[p], want);
+      break;
+    }
+  }
+
+  // The dump: the header, then the records oldest first, a page a line
+  hrnCommand("AT*G0");
+  uint64_t start = halNow;
+  std::string dump = hrnCommand("AT*GD", 30000000);
+  uint64_t took = halNow - start;
+  char head[32];
+  snprintf(head, sizeof(head), "*G: %u %u\r\n", LOG_RECS, LOG_REC);
+  size_t pos = dump.find(head);
+  CHECK(pos != std::string::npos, "no '*G: %u %u' header", LOG_RECS, LOG_REC);
+  std::string hex;
+  if (pos != std::string::npos)
+    for (pos += strlen(head); pos < dump.size() and dump.compare(pos, 2, "OK") != 0; pos++)
+      if (isxdigit(dump[pos]))
+        hex += dump[pos];
+  CHECK(hex.size() == LOG_RECS * LOG_REC * 2, "%zu bytes dumped, %u expected", hex.size() / 2, LOG_RECS * LOG_REC);
+  // The sequence numbers follow each other, modulo 255, from the oldest
+  for (uint16_t r = 0; r < LOG_RECS and (size_t)(r + 1) * LOG_REC * 2 <= hex.size(); r++) {
+    uint8_t want = (LOG_WRITTEN - LOG_RECS + r) % 0xFF;
+    uint8_t seq = strtoul(hex.substr(r * LOG_REC * 2, 2).c_str(), nullptr, 16);
+    if (seq != want) {
+      CHECK(seq == want, "record %u: sequence %u, expected %u", r, seq, want);
+      break;
+    }
+  }
+  // The serial line is the bottleneck, the EEPROM reads fit in its gaps
+  uint32_t busy = dump.size() * SER_BYTE_US * 100 / took;
+  CHECK(busy >= LOG_BUSY, "serial line busy %u%% of the dump", busy);
+
+  printf("logger: %u records, %u write cycles, %u bus bytes each, %ux write amplification; "
+         "dump %u bytes in %.2fs, %.0f B/s, line %u%% busy\n",
+         recs, halRtc.eepCycles, LOG_BUS, EEP_PAGE / LOG_REC,
+         LOG_RECS * LOG_REC, took / 1e6, LOG_RECS * LOG_REC * 1e6 / took, busy);
+  return hrnDone("logger");
+}
@@ -0,0 +1,88 @@
+/**
+  test_scrub.cpp - The MAX7219 control registers scrubbed on a still display
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: test_scrub
+
+  The clock shows the time, HHMM, which changes once a minute only.
+  Within the minute, each control register of a module is glitched in
+  turn: test mode, shutdown, a wrong scan limit, intensity and decode
+  mode.  No frame is presented meanwhile, yet each register must be
+  back, and the module show the time again, within the scrubbing round,
+  CT_COUNT * SCRUB_WAIT.  The recovery times are printed.
+*/
+
+#include <string.h>
+
+#include "harness.h"
+#include "DotMatrix.h"
+
+// The sketch
+extern DotMatrixFixed<HRN_DEVICES, 8> mtx;
+
+// The glitched module
+#define SCR_DEVICE  1
+// The scrubbing round, and a loop, us
+#define SCR_ROUND   ((uint64_t)CT_COUNT * SCRUB_WAIT * 1000 + 10000)
+
+// The registers before the glitch
+static uint8_t scrRegs[HRN_DEVICES][16];
+
+/**
+  Check if the glitched module has its registers back
+*/
+static bool scrBack() {
+  return memcmp(halChains[0].regs[SCR_DEVICE], scrRegs[SCR_DEVICE], 16) == 0;
+}
+
+int main() {
+  hrnStep = 1000;
+  hrnBoot(2020, 1, 1, 12, 0, 0);
+  // The automatic brightness would change the intensity meanwhile
+  hrnCommand("AT*A0");
+  hrnRun(1000000);
+  std::string frame = hrnFrame();
+  CHECK(frame != std::string(frame.size(), '0'), "the time is not shown");
+  memcpy(scrRegs, halChains[0].regs, sizeof(scrRegs));
+  uint16_t frames = mtx.frames;
+
+  // Each glitch: the control register and its wrong value
+  static const struct {
+    const char* name;
+    uint8_t     ctrl;
+    uint8_t     value;
+  } glitches[] = {
+    {"test mode",  CT_DSPTST, 0x01},
+    {"shutdown",   CT_SHTDWN, 0x00},
+    {"scan limit", CT_SCNLMT, 0x02},
+    {"intensity",  CT_INTENS, 0x0F},
+    {"decode",     CT_DECODE, 0xFF},
+  };
+  for (auto &g : glitches) {
+    uint8_t reg = pgm_read_byte(&ctrlRegs[g.ctrl]);
+    halChains[0].regs[SCR_DEVICE][reg] = g.value == scrRegs[SCR_DEVICE][reg] ? g.value ^ 0x01 : g.value;
+    CHECK(not scrBack(), "%s: no glitch", g.name);
+    uint64_t start = halNow;
+    bool back = hrnRunUntil(scrBack, SCR_ROUND);
+    CHECK(back, "%s: register 0x%02x not restored in %u ms", g.name, reg, (unsigned)(SCR_ROUND / 1000));
+    CHECK(hrnFrame() == frame, "%s: shows %s, not the time", g.name, hrnFrame().c_str());
+    printf("scrub: %-10s restored in %4.0f ms\n", g.name, (halNow - start) / 1000.0);
+  }
+  // The display was still all along
+  CHECK(mtx.frames == frames, "%u frames presented", mtx.frames - frames);
+  return hrnDone("scrub");
+}
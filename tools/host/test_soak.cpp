@@ -0,0 +1,168 @@
+/**
+  test_soak.cpp - Sixty days on the emulated board
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  From the last evening of 2019, two hours before millis() wraps, to the
+  first night of March 2020: the year, the leap day and the months roll
+  over, micros() wraps every 72 minutes and the data logger ring wraps
+  every five days.  Each minute shown must be the RTC time and follow
+  the previous one, the date and the year shown after each rollover must
+  be right, the watchdog must never fire and the commands must still be
+  answered at the end.
+*/
+
+#include <EEPROM.h>
+
+#include "harness.h"
+#include "DS3231.h"
+#include "AT24C32.h"
+
+// The sketch
+extern uint16_t logHead, logCount;
+extern uint8_t  logSeq;
+void logInit();
+// The log records, 8 bytes each, fill the AT24C32
+#define LOG_RECS  (EEP_SIZE / 8)
+
+// The display modes, as switched by the remote
+#define MODE_HHMM 0
+#define MODE_DDMM 2
+#define MODE_YY   3
+
+static std::string out;               // Serial output, the line not ended yet
+static int        lastMin = -1;       // The last minute shown, minutes of the day
+static bool       away = false;       // Showing another mode, the minutes stop
+static uint32_t   minutes = 0;        // Different minutes shown
+static uint32_t   dates = 0;          // Dates and years shown
+
+/**
+  The RTC date, as the sketch prints it
+*/
+static std::string rtcDate() {
+  char s[6];
+  snprintf(s, sizeof(s), "%02x.%02x", halRtc.regs[RTC_DATE], halRtc.regs[RTC_MONTH] & 0x1F);
+  return s;
+}
+
+/**
+  The RTC year, as the sketch prints it
+*/
+static std::string rtcYear() {
+  char s[6];
+  snprintf(s, sizeof(s), "%s%02x", (halRtc.regs[RTC_MONTH] & 0x80) ? "20" : "19", halRtc.regs[RTC_YEAR]);
+  return s;
+}
+
+/**
+  Check the lines printed by the last loop
+*/
+static void watch() {
+  out += hrnSerial();
+  size_t eol;
+  while ((eol = out.find('\n')) != std::string::npos) {
+    std::string line = out.substr(0, eol);
+    out.erase(0, eol + 1);
+    if (not line.empty() and line.back() == '\r')
+      line.pop_back();
+    if (line.compare(0, 5, "*O0: ") == 0) {
+      std::string hhmm = line.substr(5);
+      CHECK(hhmm == hrnRtcTime(), "shown %s, RTC %s", hhmm.c_str(), hrnRtcTime().c_str());
+      int now = atoi(hhmm.c_str()) * 60 + atoi(hhmm.c_str() + 3);
+      if (lastMin >= 0 and not away)
+        CHECK(now == (lastMin + 1) % 1440, "minute %s after %02d:%02d", hhmm.c_str(), lastMin / 60, lastMin % 60);
+      // Shown again after a command or another mode
+      if (now != lastMin)
+        minutes++;
+      lastMin = now;
+      away = false;
+    }
+    else if (line.compare(0, 5, "*O2: ") == 0) {
+      CHECK(line.substr(5) == rtcDate(), "date %s, RTC %s", line.c_str() + 5, rtcDate().c_str());
+      dates++;
+    }
+    else if (line.compare(0, 5, "*O3: ") == 0) {
+      CHECK(line.substr(5) == rtcYear(), "year %s, RTC %s", line.c_str() + 5, rtcYear().c_str());
+      dates++;
+    }
+  }
+}
+
+/**
+  Show a mode from the remote, the minutes stop until it expires
+*/
+static void showMode(uint8_t mode) {
+  halIR(0x728D, mode);
+  away = true;
+}
+
+/**
+  Run to a time of the RTC, then check the date and the year there
+
+  @param hours the hours to run
+*/
+static void runAndShowDate(uint32_t hours) {
+  hrnRun(hours * 3600000000ULL);
+  showMode(MODE_DDMM);
+  hrnRun(10000000ULL);
+  showMode(MODE_YY);
+  hrnRun(10000000ULL);
+}
+
+int main() {
+  // Four loops a second, the sketch polls the display once a second
+  hrnStep = 250000;
+  hrnHook = watch;
+  hrnBoot(2019, 12, 31, 22, 0, 0, 0xFFFFFFFFUL - 7200000UL);
+
+  // The new year, then the days up to the leap day and the next one
+  runAndShowDate(2);
+  CHECK(rtcDate() == "01.01" and rtcYear() == "2020", "new year %s %s", rtcDate().c_str(), rtcYear().c_str());
+  CHECK(millis() < 60000UL, "millis() %u, not wrapped", millis());
+  runAndShowDate(24 * 31);
+  CHECK(rtcDate() == "01.02", "February %s", rtcDate().c_str());
+  runAndShowDate(24 * 28);
+  CHECK(rtcDate() == "29.02", "leap day %s", rtcDate().c_str());
+  runAndShowDate(24);
+  CHECK(rtcDate() == "01.03", "March %s", rtcDate().c_str());
+  hrnRun(2 * 3600000000ULL);
+
+  // The minutes, all shown but those while the date and the year were
+  uint32_t total = halNow / 60000000;
+  CHECK(minutes + 4 >= total, "%u minutes shown of %u", minutes, total);
+  CHECK(dates == 2 * 4, "%u dates and years shown", dates);
+
+  // The watchdog, fed each loop
+  CHECK(halWdtIrqs == 0 and halWdtResets == 0, "watchdog fired %u, reset %u", halWdtIrqs, halWdtResets);
+  CHECK(halWdtMaxGap <= 2 * hrnStep, "watchdog fed after %.3fs", halWdtMaxGap / 1e6);
+  // The bus
+  CHECK(halSpiStray == 0 and halSpiClash == 0, "SPI stray %u, clash %u", halSpiStray, halSpiClash);
+  // The internal EEPROM is not written by itself
+  CHECK(EEPROM.writes == 0, "%u EEPROM writes", EEPROM.writes);
+
+  // The data logger ring has wrapped and its head is found again
+  uint16_t head = logHead, count = logCount;
+  uint8_t  seq = logSeq;
+  CHECK(count == LOG_RECS, "%u of %u log records", count, LOG_RECS);
+  logInit();
+  CHECK(logHead == head and logCount == count and logSeq == seq,
+        "log head %u/%u, count %u/%u, seq %u/%u", logHead, head, logCount, count, logSeq, seq);
+
+  // Still answering
+  std::string reply = hrnCommand("ATI1");
+  CHECK(reply.find("MatrixChronograph\r\nOK") != std::string::npos, "ATI1: %s", reply.c_str());
+  return hrnDone("soak");
+}
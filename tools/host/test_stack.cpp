@@ -0,0 +1,109 @@
+/**
+  test_stack.cpp - The stack watermark against the call graph bound
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: test_stack BOUND
+
+  The sketch runs on the stack at the end of the emulated RAM, painted
+  at boot as on the board.  Each mode in each font, each report and
+  each query of the console, the remote and the buttons are driven,
+  then ATI7 reports the paint left.  The stack used, the painted area
+  less the paint left, must be within the worst case depth BOUND that
+  stack.py finds in the call graphs of the same build.
+*/
+
+#include <string.h>
+
+#include "harness.h"
+#include "DotMatrix.h"
+#include "DotMatrix.h"
+
+// The sketch
+extern char __heap_start;
+#define MODES     10
+#define BTN1_PIN  4
+#define BTN2_PIN  6
+
+// The frames below the sketch ones: halTrampoline() and the context start
+#define STK_ENTRY 64
+
+// Reports and queries, the deepest paths of the console
+static const char* commands[] = {
+  "ATI", "AT&V", "AT?", "AT*GD", "AT*Q", "AT*QL", "AT*QT", "AT*P", "AT*I",
+  "AT*R", "AT*T?", "AT*X", "AT*Y?", "AT*W?", "AT*S?", "AT*D?", "AT*E?",
+  "AT*N?", "AT*M?", "AT*L?", "AT*H?", "AT*B?", "AT*C?", "AT*A?", "AT*V?",
+  "AT*Z?", "ATL?", "ATM?", "ATQ?", "ATE?", "AT&W", "AT&Y?"
+};
+
+/**
+  The paint left, as ATI7 reports it
+
+  @return the bytes, or -1 if not reported
+*/
+static long unused() {
+  std::string reply = hrnCommand("ATI7");
+  size_t pos = reply.find(" unused ");
+  return pos == std::string::npos ? -1 : atol(reply.c_str() + pos + 8);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s BOUND\n", argv[0]);
+    return 2;
+  }
+  long bound = atol(argv[1]);
+  halStack = true;
+  hrnStep = 10000;
+  hrnBoot(2020, 2, 29, 23, 59, 10);
+  hrnRun(3000000);
+  // Each mode in each font
+  for (uint8_t font = 0; font < fontCount; font++) {
+    char cmd[8];
+    snprintf(cmd, sizeof(cmd), "AT*F%u", font);
+    hrnCommand(cmd);
+    for (uint8_t mode = 0; mode < MODES; mode++) {
+      snprintf(cmd, sizeof(cmd), "AT*O%u", mode);
+      hrnCommand(cmd);
+      hrnRun(1100000);
+    }
+  }
+  // The console
+  for (const char* cmd : commands)
+    hrnCommand(cmd, 5000000);
+  // The remote, the buttons, and some minutes with the logger
+  for (uint8_t key = 0; key < MODES; key++) {
+    halIR(0x728D, key);
+    hrnRun(500000);
+  }
+  halIR(0x728D, 0x1D);
+  for (uint8_t pin : {BTN1_PIN, BTN2_PIN}) {
+    halPin(pin, LOW);
+    hrnRun(100000);
+    halPin(pin, HIGH);
+    hrnRun(500000);
+  }
+  hrnCommand("AT*G1");
+  hrnRun(180000000);
+
+  long left = unused();
+  long painted = halRam + sizeof(halRam) - &__heap_start;
+  CHECK(left > 0, "ATI7: no unused bytes reported");
+  long used = painted - left;
+  CHECK(used <= bound + STK_ENTRY, "stack %ld bytes, bound %ld", used, bound);
+  printf("stack: %ld bytes used, bound %ld, %ld headroom\n", used, bound, bound + STK_ENTRY - used);
+  return hrnDone("stack");
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""
+  timesync.py - Set the MatrixChronograph clock from the host clock
+
+  Copyright (C) 2017-2018 Costin STROIE <costinstroie@eridu.eu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  Usage: timesync.py PORT [SAMPLES]
+
+  Runs AT*X exchanges: the host sends at T1, the clock receives the line
+  at T2 and replies at T3, the host reads the reply at T4.  The sample
+  with the shortest round trip gives the host time at the clock millis()
+  zero, which is sent with AT*X=s,ms.  The clock then sets the RTC on a
+  host second boundary and replies the offsets before and after.
+"""
+
+import sys
+import time
+
+import serial
+
+BAUD = 9600
+# One character on the wire: start, 8 data bits, stop
+CHAR = 10.0 / BAUD
+# The clock sends an empty line after each command line
+EOL = 4
+
+
+def readline(port):
+    """Read a line, None on timeout"""
+    line = port.readline()
+    if not line:
+        return None
+    return line.decode("ascii", "replace").strip()
+
+
+def command(port, line):
+    """Send a command, return the result and the reply lines"""
+    port.write((line + "\r").encode("ascii"))
+    lines = []
+    while True:
+        reply = readline(port)
+        if reply is None:
+            return False, lines
+        if reply in ("OK", "ERROR"):
+            return reply == "OK", lines
+        if reply:
+            lines.append(reply)
+
+
+def sample(port):
+    """One exchange, return the round trip and the host time at millis() 0, ms"""
+    cmd = "AT*X\r"
+    t1 = time.time()
+    port.write(cmd.encode("ascii"))
+    while True:
+        reply = readline(port)
+        if reply is None:
+            return None
+        if reply.startswith("*X:"):
+            t4 = time.time()
+            break
+    if readline(port) != "OK":
+        return None
+    t2, t3 = (int(x) for x in reply[3:].split())
+    # Remove the time on the wire: the request is received at its last
+    # character, the reply is queued after the empty line
+    t1 = t1 * 1000 + len(cmd) * CHAR * 1000
+    t4 = t4 * 1000 - (EOL + len(reply) + 2) * CHAR * 1000
+    rtt = (t4 - t1) - (t3 - t2)
+    epoch = ((t1 - t2) + (t4 - t3)) / 2
+    return rtt, epoch
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: timesync.py PORT [SAMPLES]")
+        sys.exit(1)
+    samples = int(sys.argv[2]) if len(sys.argv) > 2 else 8
+    port = serial.Serial(sys.argv[1], BAUD, timeout=6)
+    # The board resets when the port is opened
+    time.sleep(2)
+    port.reset_input_buffer()
+    # No local echo and no display lines, they would delay the replies
+    command(port, "ATE0")
+    command(port, "ATQ1")
+
+    best = None
+    for _ in range(samples):
+        result = sample(port)
+        if result and (best is None or result[0] < best[0]):
+            best = result
+    if best is None:
+        print("No reply")
+        sys.exit(1)
+    rtt, epoch = best
+    # The clock keeps the local time
+    epoch += time.localtime().tm_gmtoff * 1000
+    epoch = int(round(epoch))
+    print("Round trip: %.1f ms" % rtt)
+
+    ok, lines = command(port, "AT*X=%d,%d" % (epoch // 1000, epoch % 1000))
+    for line in lines:
+        print(line)
+    command(port, "ATQ0")
+    command(port, "ATE1")
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()